@@ -9,179 +9,1162 @@ License: MIT (see LICENSE file at the top of the source tree)
 
 #include "../VKQuick/DescriptorSetBuilder.h"
 #include "../VKQuick/DescriptorSetLayoutBuilder.h"
+#include "../VKQuick/Instance.h"
 #include "../VKQuick/MemoryManager.h"
 #include "../VKQuick/Mesh.h"
+#include "../VKQuick/Utils.h"
+
+#include "MeshletBuilder.h"
+#include "VulkanMeshArena.h"
 
 #include "./Shaders/VK/GLSLInterop.h"
 
 #define BINDLESS_SET 1
 #include "./Shaders/VK/VKQuick/bindless.glslh"
 
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <string_view>
+
 using namespace VKQuick;
+using namespace NCL;
+using namespace NCL::Maths;
+using namespace NCL::Rendering;
+using namespace NCL::Rendering::Vulkan;
 
 const int TEXTURE_SLOT = 4;
 
-BindlessManager::BindlessManager(vk::Device device, vk::DescriptorPool pool, MemoryManager& memManager, uint32_t initialBufferSizes)
-	: m_memoryManager(memManager), m_device(device)
-{
-	m_meshesBuffer = memManager.CreateBuffer(
-		{
-			.size = initialBufferSizes,
-			.usage = vk::BufferUsageFlagBits::eStorageBuffer
-		},
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		"BindlessManager MeshEntry Buffer"
-	);
+//Used when there's no physical device to ask for its limits
+const uint32_t DEFAULT_TEXTURE_CAPACITY = 1024;
+//Left over for the textures of any other sets bound alongside the bindless ones
+const uint32_t RESERVED_TEXTURES = 64;
 
-	m_meshLayersBuffer = memManager.CreateBuffer(
-		{
-			.size = initialBufferSizes,
-			.usage = vk::BufferUsageFlagBits::eStorageBuffer
-		},
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		"BindlessManager MeshLayerEntry Buffer"
-	);
+const size_t MATERIAL_ALIGNMENT		= 16;
+const size_t MATERIAL_POOL_GROWTH	= 64;
 
-	m_materialsBuffer = memManager.CreateBuffer(
-		{
-			.size	= initialBufferSizes,
-			.usage	= vk::BufferUsageFlagBits::eStorageBuffer
-		},
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		"BindlessManager Materials Buffer"
-	);
+//A negative radius means the layer can't be culled by itself
+const Vector4 NO_LAYER_BOUNDS(0.0f, 0.0f, 0.0f, -1.0f);
 
-	m_allBuffers = memManager.CreateBuffer(
-		{
-			.size = sizeof(vk::DeviceAddress) * initialBufferSizes,
-			.usage = vk::BufferUsageFlagBits::eStorageBuffer
-		},
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-		"BindlessManager Buffer Pointer Buffer"
-	);
+//Smallest sphere enclosing spheres a and b
+static Vector4 MergeSpheres(const Vector4& a, const Vector4& b) {
+	Vector3 offset(b.x - a.x, b.y - a.y, b.z - a.z);
+	float	distance = Vector::Length(offset);
 
-	size_t _NumSamplers = 1024; //TODO!
+	if (distance + b.w <= a.w) {
+		return a;
+	}
+	if (distance + a.w <= b.w) {
+		return b;
+	}
+	float radius = (distance + a.w + b.w) * 0.5f;
+	float t		 = (radius - a.w) / distance;
+	return Vector4(a.x + offset.x * t, a.y + offset.y * t, a.z + offset.z * t, radius);
+}
+
+//Layers past the end of the list, such as LOD ranges, reuse its materials. With no materials at all, layers get none.
+static int32_t LayerMaterial(std::span<const int32_t> materials, size_t layer) {
+	return materials.empty() ? -1 : materials[layer % materials.size()];
+}
+
+static void AddDirtyRange(std::vector<std::pair<size_t, size_t>>& ranges, size_t offset, size_t size) {
+	if (size == 0) {
+		return;
+	}
+	//Entries tend to be written in order, so most ranges just extend the last one
+	if (!ranges.empty() && ranges.back().first + ranges.back().second == offset) {
+		ranges.back().second += size;
+		return;
+	}
+	ranges.push_back({ offset, size });
+}
+
+BindlessHandle BindlessManager::SlotList::Allocate() {
+	uint32_t index;
+	if (!freeSlots.empty()) {
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		index = (uint32_t)generations.size();
+		generations.push_back(0);
+	}
+	return { index, generations[index] };
+}
+
+bool BindlessManager::SlotList::IsCurrent(BindlessHandle handle) const {
+	return handle.index < generations.size() && generations[handle.index] == handle.generation;
+}
+
+void BindlessManager::SlotList::Release(uint32_t index) {
+	generations[index]++;
+}
+
+BindlessHandle BindlessManager::AddressLookup::Find(const void* address, const SlotList& slots) {
+	auto entry = handles.find(address);
+	if (entry == handles.end() || !slots.IsCurrent(entry->second)) {
+		return {};
+	}
+	refs[entry->second.index]++;
+	return entry->second;
+}
+
+void BindlessManager::AddressLookup::Insert(const void* address, BindlessHandle handle) {
+	if (handle.index >= addresses.size()) {
+		addresses.resize(handle.index + 1, nullptr);
+		refs.resize(handle.index + 1, 0);
+	}
+	handles[address]			= handle;
+	addresses[handle.index]		= address;
+	refs[handle.index]			= 1;
+}
+
+void BindlessManager::AddressLookup::Rebind(BindlessHandle handle, const void* address) {
+	auto entry = handles.find(addresses[handle.index]);
+	if (entry != handles.end() && entry->second.index == handle.index) {
+		handles.erase(entry);
+	}
+	handles[address]		= handle;
+	addresses[handle.index] = address;
+}
+
+bool BindlessManager::AddressLookup::Release(BindlessHandle handle) {
+	if (--refs[handle.index] > 0) {
+		return false;
+	}
+	auto entry = handles.find(addresses[handle.index]);
+	if (entry != handles.end() && entry->second.index == handle.index) {
+		handles.erase(entry);
+	}
+	addresses[handle.index] = nullptr;
+	return true;
+}
+
+BindlessManager::BindlessManager(vk::Device device, vk::DescriptorPool pool, MemoryManager& memManager, uint32_t initialBufferSizes, uint32_t framesInFlight,
+	vk::PhysicalDevice gpu, BindlessBackend backend, const VKQuickInitialisation* deviceInit)
+	: m_memoryManager(memManager), m_device(device), m_framesInFlight(framesInFlight)
+{
+	m_useDescriptorBuffer	= backend == BindlessBackend::DescriptorBuffer && gpu && deviceInit && SupportsDescriptorBuffers(gpu, *deviceInit);
+	m_textureCapacity		= ChooseTextureCapacity(gpu);
+	m_staging.resize(framesInFlight);
+
+	CreateTable(m_allBuffers,	initialBufferSizes, "BindlessManager Buffer Pointer Buffer");
+	CreateTable(m_meshEntries,	initialBufferSizes, "BindlessManager MeshEntry Buffer");
+	CreateTable(m_meshLayers,	initialBufferSizes, "BindlessManager MeshLayerEntry Buffer");
+	CreateTable(m_materials,	initialBufferSizes, "BindlessManager Materials Buffer");
+
+	CreateTable(m_meshletRanges,	initialBufferSizes, "BindlessManager MeshletRange Buffer");
+	CreateTable(m_meshlets,			initialBufferSizes, "BindlessManager MeshletEntry Buffer");
+	CreateTable(m_meshletVertices,	initialBufferSizes, "BindlessManager Meshlet Vertex Buffer");
+	CreateTable(m_meshletTriangles,	initialBufferSizes, "BindlessManager Meshlet Triangle Buffer");
+	CreateTable(m_meshLODRanges,	initialBufferSizes, "BindlessManager MeshLODRange Buffer");
+	CreateTable(m_meshLODs,			initialBufferSizes, "BindlessManager MeshLODEntry Buffer");
+	CreateTable(m_layerBounds,		initialBufferSizes, "BindlessManager Layer Bounds Buffer");
+
+	//Storage buffers are update after bind too, so that tables can be moved into bigger buffers while the frame is being recorded.
+	//Descriptor buffers don't have update after bind, but are written straight into memory the GPU isn't yet reading.
+	vk::DescriptorSetLayoutCreateFlags	layoutFlags		= vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+	vk::DescriptorBindingFlags			bindingFlags	= vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+	vk::DescriptorBindingFlags			textureFlags	= vk::DescriptorBindingFlagBits::eVariableDescriptorCount;
+	if (m_useDescriptorBuffer) {
+		layoutFlags		= vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT;
+		bindingFlags	= {};
+		textureFlags	= {};
+	}
 
 	m_bindlessLayout = VKQuick::DescriptorSetLayoutBuilder(device)	
 		.WithStorageBuffers(0, 1)	//Aliased buffers
 		.WithStorageBuffers(1, 1)	//MeshesBuffer
 		.WithStorageBuffers(2, 1)	//MeshLayersBuffer
 		.WithStorageBuffers(3, 1)	//MaterialsBuffer
-		.WithImageSamplers(TEXTURE_SLOT, _NumSamplers, vk::ShaderStageFlagBits::eAll, vk::DescriptorBindingFlagBits::eVariableDescriptorCount)		//allTextures
+		.WithImageSamplers(TEXTURE_SLOT, m_textureCapacity, vk::ShaderStageFlagBits::eAll, textureFlags)		//allTextures
 
-		.WithCreationFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
-		.WithGlobalBindingFlags(vk::DescriptorBindingFlagBits::ePartiallyBound)
+		.WithCreationFlags(layoutFlags)
+		.WithGlobalBindingFlags(bindingFlags | vk::DescriptorBindingFlagBits::ePartiallyBound)
 		.Build("Bindless Texture Data");
 
-	m_bindlessSet = VKQuick::DescriptorSetBuilder(device, pool, *m_bindlessLayout, _NumSamplers)
-		.WriteBuffer(0, m_allBuffers, vk::DescriptorType::eStorageBuffer)
-		.WriteBuffer(1, m_meshesBuffer, vk::DescriptorType::eStorageBuffer)
-		.WriteBuffer(2, m_meshLayersBuffer, vk::DescriptorType::eStorageBuffer)
-		.WriteBuffer(3, m_materialsBuffer, vk::DescriptorType::eStorageBuffer)
+	m_geometryLayout = VKQuick::DescriptorSetLayoutBuilder(device)
+		.WithStorageBuffers(0, 1)	//MeshletRanges, indexed as MeshLayers
+		.WithStorageBuffers(1, 1)	//Meshlets
+		.WithStorageBuffers(2, 1)	//MeshletVertices
+		.WithStorageBuffers(3, 1)	//MeshletTriangles
+		.WithStorageBuffers(4, 1)	//MeshLODRanges, indexed as Meshes
+		.WithStorageBuffers(5, 1)	//MeshLODs
+		.WithStorageBuffers(6, 1)	//LayerBounds, indexed as MeshLayers
+		.WithCreationFlags(layoutFlags)
+		.WithGlobalBindingFlags(bindingFlags)
+		.Build("Bindless Geometry Data");
+
+	if (m_useDescriptorBuffer) {
+		CreateDescriptorBuffers(gpu);
+	}
+	else {
+		//A texture array sized from the device's limits could be more than the pool passed in has room for
+		if (gpu) {
+			vk::DescriptorPoolSize poolSizes[] = {
+				{ .type = vk::DescriptorType::eStorageBuffer,			.descriptorCount = 11 * framesInFlight },
+				{ .type = vk::DescriptorType::eCombinedImageSampler,	.descriptorCount = m_textureCapacity * framesInFlight }
+			};
+			m_ownPool = device.createDescriptorPoolUnique({
+				.flags			= vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+				.maxSets		= 2 * framesInFlight,
+				.poolSizeCount	= (uint32_t)std::size(poolSizes),
+				.pPoolSizes		= poolSizes
+			});
+			pool = *m_ownPool;
+		}
+		m_setCopies.resize(framesInFlight);
+		for (SetCopy& copy : m_setCopies) {
+			copy.main		= VKQuick::DescriptorSetBuilder(device, pool, *m_bindlessLayout, m_textureCapacity).Build();
+			copy.geometry	= VKQuick::CreateDescriptorSet(device, pool, *m_geometryLayout);
+		}
+	}
+
+	BindTable(m_allBuffers,		MAIN_SET, 0);
+	BindTable(m_meshEntries,	MAIN_SET, 1);
+	BindTable(m_meshLayers,		MAIN_SET, 2);
+	BindTable(m_materials,		MAIN_SET, 3);
+
+	BindTable(m_meshletRanges,		GEOMETRY_SET, 0);
+	BindTable(m_meshlets,			GEOMETRY_SET, 1);
+	BindTable(m_meshletVertices,	GEOMETRY_SET, 2);
+	BindTable(m_meshletTriangles,	GEOMETRY_SET, 3);
+	BindTable(m_meshLODRanges,		GEOMETRY_SET, 4);
+	BindTable(m_meshLODs,			GEOMETRY_SET, 5);
+	BindTable(m_layerBounds,		GEOMETRY_SET, 6);
 
-	.Build();
+	m_tables = { &m_allBuffers, &m_meshEntries, &m_meshLayers, &m_materials, &m_meshletRanges, &m_meshlets,
+		&m_meshletVertices, &m_meshletTriangles, &m_meshLODRanges, &m_meshLODs, &m_layerBounds };
+
+	m_layerAllocator			= RangeAllocator(initialBufferSizes / sizeof(MeshLayerEntry));
+	m_meshletAllocator			= RangeAllocator(initialBufferSizes / sizeof(MeshletEntry));
+	m_meshletVertexAllocator	= RangeAllocator(initialBufferSizes / sizeof(uint32_t));
+	m_meshletTriangleAllocator	= RangeAllocator(initialBufferSizes / sizeof(uint32_t));
+	m_lodAllocator				= RangeAllocator(initialBufferSizes / sizeof(MeshLODEntry));
+	m_materialAllocator			= RangeAllocator(initialBufferSizes);
+
+	Flush();
 }
 
-uint32_t BindlessManager::AddMesh(const VKQuick::Mesh& mesh, std::vector< int32_t > materials) {
-	auto entry = m_meshes.insert({ &mesh , (uint32_t)m_meshes.size() });
+BindlessManager::~BindlessManager() {
+	for (Table* t : m_tables) {
+		m_memoryManager.DiscardBuffer(t->buffer, DiscardMode::Immediate);
+	}
+	for (StagingBuffer& staging : m_staging) {
+		if (staging.data) {
+			staging.buffer.Unmap();
+			m_memoryManager.DiscardBuffer(staging.buffer, DiscardMode::Immediate);
+		}
+	}
+	for (DescriptorCopy& copy : m_descriptorCopies) {
+		copy.buffer.Unmap();
+		m_memoryManager.DiscardBuffer(copy.buffer, DiscardMode::Immediate);
+	}
+	for (auto& [frame, buffer] : m_retiredBuffers) {
+		m_memoryManager.DiscardBuffer(buffer, DiscardMode::Immediate);
+	}
+}
 
-	if (entry.second) {
-		//This was a new mesh!
-		//We need a new entry for it
-		//and then new entries for all of the submeshes
+bool BindlessManager::SupportsDescriptorBuffers(vk::PhysicalDevice gpu, const VKQuickInitialisation& deviceInit) {
+	//Being listed by the gpu isn't enough, the device must have been created with it
+	bool extensionEnabled = std::any_of(deviceInit.deviceExtensions.begin(), deviceInit.deviceExtensions.end(), [](const auto& e) {
+		return std::string_view(e) == VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME;
+	});
+	if (!extensionEnabled) {
+		return false;
+	}
+	//Feature structs may be chained from one another, as well as being listed separately
+	bool featureEnabled = false;
+	for (void* features : deviceInit.features) {
+		for (const vk::BaseInStructure* s = (const vk::BaseInStructure*)features; s; s = s->pNext) {
+			if (s->sType == vk::StructureType::ePhysicalDeviceDescriptorBufferFeaturesEXT) {
+				featureEnabled |= ((const vk::PhysicalDeviceDescriptorBufferFeaturesEXT*)s)->descriptorBuffer == VK_TRUE;
+			}
+		}
+	}
+	if (!featureEnabled) {
+		return false;
+	}
+	auto supported = gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorBufferFeaturesEXT>();
+	return supported.get<vk::PhysicalDeviceDescriptorBufferFeaturesEXT>().descriptorBuffer;
+}
 
-		const std::vector<MeshRange>& ranges = mesh.GetRanges();
-		int32_t* matIndex = materials.data();
+uint32_t BindlessManager::ChooseTextureCapacity(vk::PhysicalDevice gpu) const {
+	if (!gpu) {
+		return DEFAULT_TEXTURE_CAPACITY;
+	}
+	uint32_t capacity = MAX_BINDLESS_TEXTURES;
+	//Each combined image sampler counts as both a sampler and a sampled image
+	auto limitTo = [&](uint32_t limit) {
+		capacity = std::min(capacity, limit > RESERVED_TEXTURES ? limit - RESERVED_TEXTURES : limit);
+	};
+	if (m_useDescriptorBuffer) {
+		//Descriptor buffer layouts can't be update after bind, so the ordinary limits apply
+		vk::PhysicalDeviceLimits limits = gpu.getProperties().limits;
+		limitTo(limits.maxPerStageDescriptorSamplers);
+		limitTo(limits.maxPerStageDescriptorSampledImages);
+		limitTo(limits.maxDescriptorSetSamplers);
+		limitTo(limits.maxDescriptorSetSampledImages);
+	}
+	else {
+		auto properties = gpu.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingProperties>();
+		const vk::PhysicalDeviceDescriptorIndexingProperties& indexing = properties.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+		limitTo(indexing.maxPerStageDescriptorUpdateAfterBindSamplers);
+		limitTo(indexing.maxPerStageDescriptorUpdateAfterBindSampledImages);
+		limitTo(indexing.maxDescriptorSetUpdateAfterBindSamplers);
+		limitTo(indexing.maxDescriptorSetUpdateAfterBindSampledImages);
+	}
+	return capacity;
+}
 
-		MeshEntry& meshEntry = m_meshesBuffer.Map<MeshEntry>()[entry.first->second];
+void BindlessManager::CreateDescriptorBuffers(vk::PhysicalDevice gpu) {
+	auto properties = gpu.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+	const vk::PhysicalDeviceDescriptorBufferPropertiesEXT& bufferProperties = properties.get<vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
 
-		uint32_t bufferIndex = AddBuffer(mesh.GetBuffer());
-		AttributeData attributeData;
-		IndexData indexData;
+	m_storageDescriptorSize = bufferProperties.storageBufferDescriptorSize;
+	m_textureDescriptorSize = bufferProperties.combinedImageSamplerDescriptorSize;
 
-		mesh.GetIndexData(indexData);
+	//Both sets live in the same buffer, the geometry set after the main one
+	vk::DeviceSize alignment	= bufferProperties.descriptorBufferOffsetAlignment;
+	vk::DeviceSize mainSize		= m_device.getDescriptorSetLayoutSizeEXT(*m_bindlessLayout);
+	m_geometryDescriptorOffset	= (mainSize + alignment - 1) / alignment * alignment;
+	m_textureDescriptorOffset	= m_device.getDescriptorSetLayoutBindingOffsetEXT(*m_bindlessLayout, TEXTURE_SLOT);
 
-		size_t attribIndex = 0;
-		if (mesh.GetAttributeIndex(VKQuick::AttributeType::Position, attribIndex) && 
-			mesh.GeAttributeData(attribIndex, attributeData)) {
+	size_t totalSize = m_geometryDescriptorOffset + m_device.getDescriptorSetLayoutSizeEXT(*m_geometryLayout);
+	m_descriptorShadow.resize(totalSize);
 
-			meshEntry.positionBufferIndex  = bufferIndex;
-			meshEntry.positionBufferOffset = attributeData.offset;
+	m_descriptorCopies.resize(m_framesInFlight);
+	for (DescriptorCopy& copy : m_descriptorCopies) {
+		copy.buffer = m_memoryManager.CreateBuffer(
+			{
+				.size	= totalSize,
+				.usage	= vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT | vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT | vk::BufferUsageFlagBits::eShaderDeviceAddress
+			},
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			"BindlessManager Descriptor Buffer"
+		);
+		copy.data = copy.buffer.Map<char>();
+		memset(copy.data, 0, totalSize);
+	}
+}
+
+void BindlessManager::WriteDescriptor(const vk::DescriptorGetInfoEXT& info, size_t descriptorSize, size_t offset) {
+	m_device.getDescriptorEXT(info, descriptorSize, m_descriptorShadow.data() + offset);
+	for (DescriptorCopy& copy : m_descriptorCopies) {
+		AddDirtyRange(copy.dirty, offset, descriptorSize);
+	}
+}
+
+void BindlessManager::UpdateDescriptorCopy(DescriptorCopy& copy) {
+	for (const auto& [offset, size] : copy.dirty) {
+		memcpy(copy.data + offset, m_descriptorShadow.data() + offset, size);
+	}
+	copy.dirty.clear();
+}
+
+void BindlessManager::Bind(vk::CommandBuffer cmdBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet) const {
+	if (!m_useDescriptorBuffer) {
+		vk::DescriptorSet sets[] = { GetDescriptorSet(), GetGeometryDescriptorSet() };
+		cmdBuffer.bindDescriptorSets(bindPoint, layout, firstSet, (uint32_t)std::size(sets), sets, 0, nullptr);
+		return;
+	}
+	const DescriptorCopy& copy = m_descriptorCopies[m_frame % m_framesInFlight];
+	cmdBuffer.bindDescriptorBuffersEXT(vk::DescriptorBufferBindingInfoEXT{
+		.address	= copy.buffer.GetDeviceAddress(),
+		.usage		= vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT | vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT
+	});
+	uint32_t		bufferIndices[]	= { 0, 0 };
+	vk::DeviceSize	offsets[]		= { 0, m_geometryDescriptorOffset };
+	cmdBuffer.setDescriptorBufferOffsetsEXT(bindPoint, layout, firstSet, bufferIndices, offsets);
+}
+
+void BindlessManager::CreateTable(Table& table, size_t size, const std::string& name) {
+	table.name		= name;
+	table.buffer	= m_memoryManager.CreateBuffer(
+		{
+			.size	= size,
+			.usage	= vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress
+		},
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		name
+	);
+	table.shadow.resize(size);
+}
+
+void BindlessManager::BindTable(Table& table, uint32_t set, uint32_t binding) {
+	table.set		= set;
+	table.binding	= binding;
+	table.rebind	= true;
+}
+
+void BindlessManager::ReserveTable(Table& table, size_t size) {
+	if (size <= table.buffer.size) {
+		return;
+	}
+	//Doubling keeps the cost of copying the old contents over constant per entry
+	size_t newSize = std::max(size, (size_t)table.buffer.size * 2);
+
+	VKQuick::Buffer oldBuffer = std::move(table.buffer);
+	CreateTable(table, newSize, table.name);
+
+	//The shadow copy keeps its contents, but the new buffer starts off empty
+	MarkDirty(table, 0, oldBuffer.size);
+
+	table.rebind = true;
+
+	//Frames already recorded still read from the old buffer
+	m_retiredBuffers.push_back({ m_frame, std::move(oldBuffer) });
+}
+
+BindlessManager::TableRange BindlessManager::AllocateRange(RangeAllocator& allocator, Table& table, size_t elementSize, size_t count, size_t alignment) {
+	TableRange range{ 0, count };
+	if (!allocator.Allocate(count, range.first, alignment)) {
+		//Whatever is free at the end of the table joins up with the new space, so this always fits
+		size_t newCapacity = std::max(allocator.GetCapacity() * 2, allocator.GetCapacity() + count + alignment);
+		ReserveTable(table, newCapacity * elementSize);
+		allocator.Grow(newCapacity);
+
+		bool allocated = allocator.Allocate(count, range.first, alignment);
+		assert(allocated);
+	}
+	return range;
+}
+
+void BindlessManager::ReserveRange(RangeAllocator& allocator, Table& table, size_t elementSize, size_t count) {
+	if (allocator.GetLargestFreeRange() >= count) {
+		return;
+	}
+	size_t newCapacity = std::max(allocator.GetCapacity() * 2, allocator.GetCapacity() + count);
+	ReserveTable(table, newCapacity * elementSize);
+	allocator.Grow(newCapacity);
+}
+
+void BindlessManager::FreeRange(RangeAllocator& allocator, TableRange& range) {
+	if (range.count > 0) {
+		Retire([&allocator, range]() { allocator.Free(range.first, range.count); });
+	}
+	range = {};
+}
+
+void BindlessManager::Retire(std::function<void()> func) {
+	m_retired.push_back({ m_frame, std::move(func) });
+}
+
+void BindlessManager::MarkDirty(Table& table, size_t offset, size_t size) {
+	AddDirtyRange(table.dirty, offset, size);
+}
+
+void BindlessManager::RecordUpdates(vk::CommandBuffer cmdBuffer) {
+	std::lock_guard lock(m_mutex);
+
+	//Overlapping and touching ranges are merged, so each byte is only copied once
+	size_t totalSize = 0;
+	for (Table* t : m_tables) {
+		std::sort(t->dirty.begin(), t->dirty.end());
+
+		size_t merged = 0;
+		for (size_t i = 0; i < t->dirty.size(); ++i) {
+			auto [offset, size] = t->dirty[i];
+			if (merged > 0 && t->dirty[merged - 1].first + t->dirty[merged - 1].second >= offset) {
+				auto& previous = t->dirty[merged - 1];
+				previous.second = std::max(previous.first + previous.second, offset + size) - previous.first;
+				continue;
+			}
+			t->dirty[merged++] = { offset, size };
 		}
+		t->dirty.resize(merged);
 
-		if (mesh.GetAttributeIndex(VKQuick::AttributeType::Colour, attribIndex) &&
-			mesh.GeAttributeData(attribIndex, attributeData)) {
+		for (const auto& [offset, size] : t->dirty) {
+			totalSize += (size + 15) & ~15;
+		}
+	}
+	if (totalSize == 0) {
+		return;
+	}
 
-			meshEntry.colourBufferIndex = bufferIndex;
-			meshEntry.colourBufferOffset = attributeData.offset;
+	//Each frame in flight has its own staging buffer, which can't be in use by the time it comes round again
+	StagingBuffer& staging = m_staging[m_frame % m_framesInFlight];
+	if (staging.buffer.size < totalSize) {
+		if (staging.data) {
+			staging.buffer.Unmap();
+			m_memoryManager.DiscardBuffer(staging.buffer, DiscardMode::Immediate);
 		}
+		staging.buffer = m_memoryManager.CreateBuffer(
+			{
+				.size	= std::max(totalSize, (size_t)staging.buffer.size * 2),
+				.usage	= vk::BufferUsageFlagBits::eTransferSrc
+			},
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			"BindlessManager Staging Buffer"
+		);
+		staging.data = staging.buffer.Map<char>();
+	}
 
-		if (mesh.GetAttributeIndex(VKQuick::AttributeType::TexCoord, attribIndex) &&
-			mesh.GeAttributeData(attribIndex, attributeData)) {
+	//Earlier frames must have finished reading the tables before they are overwritten
+	vk::MemoryBarrier2 beforeCopy{
+		.srcStageMask	= vk::PipelineStageFlagBits2::eAllCommands,
+		.srcAccessMask	= vk::AccessFlagBits2::eNone,
+		.dstStageMask	= vk::PipelineStageFlagBits2::eTransfer,
+		.dstAccessMask	= vk::AccessFlagBits2::eTransferWrite
+	};
+	cmdBuffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &beforeCopy });
 
-			meshEntry.texCoordBufferIndex = bufferIndex;
-			meshEntry.texCoordBufferOffset = attributeData.offset;
+	size_t stagingOffset = 0;
+	std::vector<vk::BufferCopy> regions;
+	for (Table* t : m_tables) {
+		if (t->dirty.empty()) {
+			continue;
+		}
+		regions.clear();
+		for (const auto& [offset, size] : t->dirty) {
+			memcpy(staging.data + stagingOffset, t->shadow.data() + offset, size);
+			regions.push_back({ .srcOffset = stagingOffset, .dstOffset = offset, .size = size });
+			stagingOffset += (size + 15) & ~15;
 		}
+		cmdBuffer.copyBuffer(staging.buffer.buffer, t->buffer.buffer, regions);
+		t->dirty.clear();
+	}
+
+	vk::MemoryBarrier2 afterCopy{
+		.srcStageMask	= vk::PipelineStageFlagBits2::eTransfer,
+		.srcAccessMask	= vk::AccessFlagBits2::eTransferWrite,
+		.dstStageMask	= vk::PipelineStageFlagBits2::eAllCommands,
+		.dstAccessMask	= vk::AccessFlagBits2::eShaderStorageRead
+	};
+	cmdBuffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &afterCopy });
+}
+
+void BindlessManager::Flush() {
+	std::lock_guard lock(m_mutex);
+
+	if (m_useDescriptorBuffer) {
+		FlushDescriptorBuffer();
+		return;
+	}
+
+	for (Table* t : m_tables) {
+		if (!t->rebind) {
+			continue;
+		}
+		for (SetCopy& copy : m_setCopies) {
+			if (std::find(copy.tables.begin(), copy.tables.end(), t) == copy.tables.end()) {
+				copy.tables.push_back(t);
+			}
+		}
+		t->rebind = false;
+	}
+	for (SetCopy& copy : m_setCopies) {
+		copy.textures.insert(copy.textures.end(), m_pendingTextures.begin(), m_pendingTextures.end());
+	}
+	m_pendingTextures.clear();
+
+	//Only the current frame's copy can be written now, as the others may still be in use. They catch up in NextFrame.
+	UpdateSetCopy(m_setCopies[m_frame % m_framesInFlight]);
+}
+
+void BindlessManager::UpdateSetCopy(SetCopy& copy) {
+	std::vector<vk::DescriptorBufferInfo>	bufferInfos;
+	std::vector<vk::WriteDescriptorSet>		writes;
+
+	bufferInfos.reserve(copy.tables.size());
+	for (const Table* t : copy.tables) {
+		bufferInfos.push_back({ .buffer = t->buffer.buffer, .offset = 0, .range = t->buffer.size });
+		writes.push_back({
+			.dstSet				= t->set == MAIN_SET ? *copy.main : *copy.geometry,
+			.dstBinding			= t->binding,
+			.descriptorCount	= 1,
+			.descriptorType		= vk::DescriptorType::eStorageBuffer,
+			.pBufferInfo		= &bufferInfos.back()
+		});
+	}
+	copy.tables.clear();
+
+	//Later writes to an index replace earlier ones, and runs of neighbouring indices share a write
+	std::stable_sort(copy.textures.begin(), copy.textures.end(),
+		[](const PendingTexture& a, const PendingTexture& b) { return a.index < b.index; });
 
-		if (mesh.GetAttributeIndex(VKQuick::AttributeType::Normals, attribIndex) &&
-			mesh.GeAttributeData(attribIndex, attributeData)) {
+	std::vector<vk::DescriptorImageInfo> imageInfos;
+	imageInfos.reserve(copy.textures.size());
+	for (size_t i = 0; i < copy.textures.size(); ++i) {
+		const PendingTexture& p = copy.textures[i];
+		if (i + 1 < copy.textures.size() && copy.textures[i + 1].index == p.index) {
+			continue;
+		}
+		bool extendsRun = !writes.empty() && writes.back().dstBinding == TEXTURE_SLOT && writes.back().dstSet == *copy.main
+			&& writes.back().dstArrayElement + writes.back().descriptorCount == p.index;
 
-			meshEntry.normalBufferIndex = bufferIndex;
-			meshEntry.normalBufferOffset = attributeData.offset;
+		imageInfos.push_back(p.info);
+		if (extendsRun) {
+			writes.back().descriptorCount++;
+			continue;
 		}
+		writes.push_back({
+			.dstSet				= *copy.main,
+			.dstBinding			= TEXTURE_SLOT,
+			.dstArrayElement	= p.index,
+			.descriptorCount	= 1,
+			.descriptorType		= vk::DescriptorType::eCombinedImageSampler,
+			.pImageInfo			= &imageInfos.back()
+		});
+	}
+	copy.textures.clear();
 
-		if (mesh.GetAttributeIndex(VKQuick::AttributeType::Tangents, attribIndex) &&
-			mesh.GeAttributeData(attribIndex, attributeData)) {
+	if (!writes.empty()) {
+		m_device.updateDescriptorSets(writes, {});
+	}
+}
 
-			meshEntry.tangentBufferIndex = bufferIndex;
-			meshEntry.tangentBufferOffset = attributeData.offset;
+void BindlessManager::FlushDescriptorBuffer() {
+	for (Table* t : m_tables) {
+		if (!t->rebind) {
+			continue;
 		}
+		vk::DescriptorAddressInfoEXT address{ .address = t->buffer.GetDeviceAddress(), .range = t->buffer.size };
 
-		meshEntry.indexBufferIndex	= bufferIndex;
-		meshEntry.indexBufferOffset = indexData.offset;
+		vk::DescriptorGetInfoEXT info{ .type = vk::DescriptorType::eStorageBuffer };
+		info.data.pStorageBuffer = &address;
 
-		//Now copy the info for each of the submeshes / sublayers / whatevers
-		meshEntry.subMeshCount		= ranges.size();
-		meshEntry.firstSubMeshIndex = m_subLayersUsed;
-		m_subLayersUsed += meshEntry.subMeshCount;
+		vk::DeviceSize offset = t->set == MAIN_SET
+			? m_device.getDescriptorSetLayoutBindingOffsetEXT(*m_bindlessLayout, t->binding)
+			: m_device.getDescriptorSetLayoutBindingOffsetEXT(*m_geometryLayout, t->binding) + m_geometryDescriptorOffset;
 
-		MeshLayerEntry* meshLayer = &m_meshLayersBuffer.Map<MeshLayerEntry>()[meshEntry.firstSubMeshIndex];
+		WriteDescriptor(info, m_storageDescriptorSize, offset);
+		t->rebind = false;
+	}
 
-		for (auto& range : ranges) {
-			meshLayer->firstElement		= range.start;
-			meshLayer->elementCount		= range.count;
-			meshLayer->base				= range.base;
-			meshLayer->materialIndex	= *matIndex;
+	//Writing in the order they were added leaves each index with its latest texture
+	for (const PendingTexture& p : m_pendingTextures) {
+		vk::DescriptorGetInfoEXT info{ .type = vk::DescriptorType::eCombinedImageSampler };
+		info.data.pCombinedImageSampler = &p.info;
+
+		WriteDescriptor(info, m_textureDescriptorSize, m_textureDescriptorOffset + p.index * m_textureDescriptorSize);
+	}
+	m_pendingTextures.clear();
+
+	//Only the current frame's copy can be written now, as the others may still be in use. They catch up in NextFrame.
+	UpdateDescriptorCopy(m_descriptorCopies[m_frame % m_framesInFlight]);
+}
+
+void BindlessManager::NextFrame() {
+	Flush();
+
+	std::lock_guard lock(m_mutex);
+	m_frame++;
+
+	if (m_useDescriptorBuffer) {
+		UpdateDescriptorCopy(m_descriptorCopies[m_frame % m_framesInFlight]);
+	}
+	else {
+		UpdateSetCopy(m_setCopies[m_frame % m_framesInFlight]);
+	}
 
-			meshLayer++;
-			matIndex++;
+	auto isComplete = [&](uint64_t frame) { return frame + m_framesInFlight <= m_frame; };
+
+	for (auto& [frame, func] : m_retired) {
+		if (isComplete(frame)) {
+			func();
+		}
+	}
+	std::erase_if(m_retired, [&](const auto& r) { return isComplete(r.first); });
+
+	for (auto& [frame, buffer] : m_retiredBuffers) {
+		if (isComplete(frame)) {
+			m_memoryManager.DiscardBuffer(buffer, DiscardMode::Immediate);
+		}
+	}
+	std::erase_if(m_retiredBuffers, [&](const auto& r) { return isComplete(r.first); });
+}
+
+BindlessHandle BindlessManager::AllocateMesh(size_t layerCount, MeshRecord*& record) {
+	BindlessHandle handle = m_meshSlots.Allocate();
+
+	ReserveTable(m_meshEntries,		(handle.index + 1) * sizeof(MeshEntry));
+	ReserveTable(m_meshLODRanges,	(handle.index + 1) * sizeof(MeshLODRange));
+	if (m_meshRecords.size() <= handle.index) {
+		m_meshRecords.resize(handle.index + 1);
+	}
+	record			= &m_meshRecords[handle.index];
+	*record			= {};
+	record->layers	= AllocateRange(m_layerAllocator, m_meshLayers, sizeof(MeshLayerEntry), layerCount);
+	ReserveTable(m_meshletRanges, m_layerAllocator.GetCapacity() * sizeof(MeshletRange));
+	ReserveTable(m_layerBounds, m_layerAllocator.GetCapacity() * sizeof(Vector4));
+
+	//Recycled entries may still describe whatever used them last
+	*WriteTable<MeshLODRange>(m_meshLODRanges, handle.index) = { 0, 0 };
+
+	MeshletRange* ranges = WriteTable<MeshletRange>(m_meshletRanges, record->layers.first, layerCount);
+	Vector4* bounds = WriteTable<Vector4>(m_layerBounds, record->layers.first, layerCount);
+	for (size_t i = 0; i < layerCount; ++i) {
+		ranges[i] = { 0, 0 };
+		bounds[i] = NO_LAYER_BOUNDS;
+	}
+
+	return handle;
+}
+
+void BindlessManager::ReserveMeshes(size_t count, size_t layerCount) {
+	size_t maxMeshes = m_meshSlots.generations.size() + count;
+
+	ReserveTable(m_meshEntries,		maxMeshes * sizeof(MeshEntry));
+	ReserveTable(m_meshLODRanges,	maxMeshes * sizeof(MeshLODRange));
+	ReserveRange(m_layerAllocator, m_meshLayers, sizeof(MeshLayerEntry), layerCount);
+	ReserveTable(m_meshletRanges, m_layerAllocator.GetCapacity() * sizeof(MeshletRange));
+	ReserveTable(m_layerBounds, m_layerAllocator.GetCapacity() * sizeof(Vector4));
+	m_meshRecords.reserve(maxMeshes);
+}
+
+BindlessHandle BindlessManager::AddMesh(const VKQuick::Mesh& mesh, std::vector< int32_t > materials) {
+	std::lock_guard lock(m_mutex);
+	return WriteMesh(mesh, materials);
+}
+
+BindlessHandle BindlessManager::AddArenaMesh(const VulkanMesh& mesh, std::vector< int32_t > materials) {
+	std::lock_guard lock(m_mutex);
+	return WriteArenaMesh(mesh, materials);
+}
+
+std::vector<BindlessHandle> BindlessManager::AddMeshes(std::span<const MeshDesc> meshes) {
+	size_t layerCount = 0;
+	for (const MeshDesc& m : meshes) {
+		layerCount += m.mesh->GetRanges().size();
+	}
+	std::lock_guard lock(m_mutex);
+	ReserveMeshes(meshes.size(), layerCount);
+
+	std::vector<BindlessHandle> handles(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		handles[i] = WriteMesh(*meshes[i].mesh, meshes[i].materials);
+	}
+	return handles;
+}
+
+std::vector<BindlessHandle> BindlessManager::AddArenaMeshes(std::span<const ArenaMeshDesc> meshes) {
+	size_t layerCount = 0;
+	for (const ArenaMeshDesc& m : meshes) {
+		layerCount += m.mesh->GetGPURanges().empty() ? m.mesh->GetLODRanges(0).size() : m.mesh->GetGPURanges().size();
+	}
+	std::lock_guard lock(m_mutex);
+	ReserveMeshes(meshes.size(), layerCount);
+
+	std::vector<BindlessHandle> handles(meshes.size());
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		handles[i] = WriteArenaMesh(*meshes[i].mesh, meshes[i].materials);
+	}
+	return handles;
+}
+
+BindlessHandle BindlessManager::WriteMesh(const VKQuick::Mesh& mesh, std::span<const int32_t> materials) {
+	if (BindlessHandle existing = m_meshAddresses.Find(&mesh, m_meshSlots); existing.IsValid()) {
+		return existing;
+	}
+	const std::vector<MeshRange>& ranges = mesh.GetRanges();
+
+	MeshRecord* record = nullptr;
+	BindlessHandle handle = AllocateMesh(ranges.size(), record);
+	m_meshAddresses.Insert(&mesh, handle);
+
+	BindlessHandle bufferHandle = AcquireBuffer(mesh.GetBuffer());
+	record->buffers.push_back(bufferHandle);
+
+	uint32_t bufferIndex = bufferHandle.index;
+	AttributeData attributeData;
+	IndexData indexData;
+
+	mesh.GetIndexData(indexData);
+
+	MeshEntry& meshEntry = *WriteTable<MeshEntry>(m_meshEntries, handle.index);
+	meshEntry = {};
+
+	size_t attribIndex = 0;
+	if (mesh.GetAttributeIndex(VKQuick::AttributeType::Position, attribIndex) && 
+		mesh.GeAttributeData(attribIndex, attributeData)) {
+
+		meshEntry.positionBufferIndex  = bufferIndex;
+		meshEntry.positionBufferOffset = attributeData.offset;
+	}
+
+	if (mesh.GetAttributeIndex(VKQuick::AttributeType::Colour, attribIndex) &&
+		mesh.GeAttributeData(attribIndex, attributeData)) {
+
+		meshEntry.colourBufferIndex = bufferIndex;
+		meshEntry.colourBufferOffset = attributeData.offset;
+	}
+
+	if (mesh.GetAttributeIndex(VKQuick::AttributeType::TexCoord, attribIndex) &&
+		mesh.GeAttributeData(attribIndex, attributeData)) {
+
+		meshEntry.texCoordBufferIndex = bufferIndex;
+		meshEntry.texCoordBufferOffset = attributeData.offset;
+	}
+
+	if (mesh.GetAttributeIndex(VKQuick::AttributeType::Normals, attribIndex) &&
+		mesh.GeAttributeData(attribIndex, attributeData)) {
+
+		meshEntry.normalBufferIndex = bufferIndex;
+		meshEntry.normalBufferOffset = attributeData.offset;
+	}
+
+	if (mesh.GetAttributeIndex(VKQuick::AttributeType::Tangents, attribIndex) &&
+		mesh.GeAttributeData(attribIndex, attributeData)) {
+
+		meshEntry.tangentBufferIndex = bufferIndex;
+		meshEntry.tangentBufferOffset = attributeData.offset;
+	}
+
+	meshEntry.indexBufferIndex	= bufferIndex;
+	meshEntry.indexBufferOffset = indexData.offset;
+
+	//Now copy the info for each of the submeshes / sublayers / whatevers
+	meshEntry.subMeshCount		= ranges.size();
+	meshEntry.firstSubMeshIndex = (uint32_t)record->layers.first;
+
+	MeshLayerEntry* meshLayer = WriteTable<MeshLayerEntry>(m_meshLayers, meshEntry.firstSubMeshIndex, ranges.size());
+
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		meshLayer->firstElement		= ranges[i].start;
+		meshLayer->elementCount		= ranges[i].count;
+		meshLayer->base				= ranges[i].base;
+		meshLayer->materialIndex	= LayerMaterial(materials, i);
+
+		meshLayer++;
+	}
+
+	return handle;
+}
+
+BindlessHandle BindlessManager::WriteArenaMesh(const VulkanMesh& mesh, std::span<const int32_t> materials) {
+	const VulkanMeshArena* arena = mesh.GetArena();
+	assert(arena);
+
+	if (BindlessHandle existing = m_meshAddresses.Find(&mesh, m_meshSlots); existing.IsValid()) {
+		return existing;
+	}
+	const MeshArenaAllocation& allocation = mesh.GetArenaAllocation();
+	const std::vector<SubMesh> ranges = mesh.GetGPURanges().empty() ? mesh.GetLODRanges(0) : mesh.GetGPURanges();
+
+	MeshRecord* record = nullptr;
+	BindlessHandle handle = AllocateMesh(ranges.size(), record);
+	m_meshAddresses.Insert(&mesh, handle);
+
+	MeshEntry meshEntry = {};
+
+	//Every mesh in the arena shares the same pool buffers, just at different offsets
+	auto attributeFunc = [&](VertexAttribute::Type attribute, auto& bufferIndex, auto& bufferOffset) {
+		if (!(mesh.GetAttributeMask() & (1 << attribute))) {
+			return;
+		}
+		BindlessHandle bufferHandle = AcquireBuffer(arena->GetAttributeBuffer(attribute));
+		record->buffers.push_back(bufferHandle);
+
+		bufferIndex		= bufferHandle.index;
+		bufferOffset	= allocation.firstVertex * VulkanMesh::GetFormatSize(arena->GetAttributeFormat(attribute));
+	};
+	attributeFunc(VertexAttribute::Positions, meshEntry.positionBufferIndex, meshEntry.positionBufferOffset);
+	attributeFunc(VertexAttribute::Colours, meshEntry.colourBufferIndex, meshEntry.colourBufferOffset);
+	attributeFunc(VertexAttribute::TextureCoords, meshEntry.texCoordBufferIndex, meshEntry.texCoordBufferOffset);
+	attributeFunc(VertexAttribute::Normals, meshEntry.normalBufferIndex, meshEntry.normalBufferOffset);
+	attributeFunc(VertexAttribute::Tangents, meshEntry.tangentBufferIndex, meshEntry.tangentBufferOffset);
+
+	BindlessHandle indexHandle = AcquireBuffer(arena->GetIndexBuffer());
+	record->buffers.push_back(indexHandle);
+
+	meshEntry.indexBufferIndex	= indexHandle.index;
+	meshEntry.indexBufferOffset = allocation.firstIndex * sizeof(uint32_t);
+
+	meshEntry.subMeshCount		= ranges.size();
+	meshEntry.firstSubMeshIndex = (uint32_t)record->layers.first;
+
+	*WriteTable<MeshEntry>(m_meshEntries, handle.index) = meshEntry;
+
+	MeshLayerEntry* meshLayer = WriteTable<MeshLayerEntry>(m_meshLayers, meshEntry.firstSubMeshIndex, ranges.size());
+
+	for (size_t i = 0; i < ranges.size(); ++i) {
+		meshLayer->firstElement		= ranges[i].start;
+		meshLayer->elementCount		= ranges[i].count;
+		meshLayer->base				= ranges[i].base;
+		meshLayer->materialIndex	= LayerMaterial(materials, i);
+
+		meshLayer++;
+	}
+
+	return handle;
+}
+
+BindlessHandle BindlessManager::AddTexture(const VKQuick::Texture& tex, const vk::Sampler sampler) {
+	std::lock_guard lock(m_mutex);
+	return WriteTexture(tex, sampler);
+}
+
+BindlessHandle BindlessManager::WriteTexture(const VKQuick::Texture& tex, const vk::Sampler sampler) {
+	if (BindlessHandle existing = m_textureAddresses.Find(&tex, m_textureSlots); existing.IsValid()) {
+		return existing;
+	}
+	BindlessHandle handle = m_textureSlots.Allocate();
+	//The texture array can't grow, as its size is part of the descriptor set's layout.
+	//Nothing has seen the index yet, so it can go straight back on the free list.
+	if (handle.index >= m_textureCapacity) {
+		m_textureSlots.freeSlots.push_back(handle.index);
+		return {};
+	}
+	m_textureAddresses.Insert(&tex, handle);
+
+	m_pendingTextures.push_back({ handle.index, { sampler, tex.GetDefaultView(), vk::ImageLayout::eShaderReadOnlyOptimal } });
+
+	return handle;
+}
+
+std::vector<BindlessHandle> BindlessManager::AddTextures(std::span<const TextureDesc> textures) {
+	std::lock_guard lock(m_mutex);
+	m_pendingTextures.reserve(m_pendingTextures.size() + textures.size());
+
+	std::vector<BindlessHandle> handles(textures.size());
+	for (size_t i = 0; i < textures.size(); ++i) {
+		handles[i] = WriteTexture(*textures[i].texture, textures[i].sampler);
+	}
+	return handles;
+}
+
+void BindlessManager::UpdateTexture(BindlessHandle handle, const VKQuick::Texture& tex, const vk::Sampler sampler) {
+	std::lock_guard lock(m_mutex);
+	assert(m_textureSlots.IsCurrent(handle));
+	m_textureAddresses.Rebind(handle, &tex);
+
+	//The texture array is update after bind, or has a copy per frame in flight, so it can still be bound in commands that haven't been submitted yet
+	m_pendingTextures.push_back({ handle.index, { sampler, tex.GetDefaultView(), vk::ImageLayout::eShaderReadOnlyOptimal } });
+}
+
+BindlessHandle BindlessManager::AddBuffer(const VKQuick::Buffer& buffer) {
+	std::lock_guard lock(m_mutex);
+	return AcquireBuffer(buffer);
+}
+
+BindlessHandle BindlessManager::AcquireBuffer(const VKQuick::Buffer& buffer) {
+	vk::DeviceAddress address = buffer.GetDeviceAddress();
+
+	auto entry = m_bufferAddresses.find(address);
+	if (entry != m_bufferAddresses.end()) {
+		m_bufferRefs[entry->second.index]++;
+		return entry->second;
+	}
+
+	BindlessHandle handle = m_bufferSlots.Allocate();
+	if (m_slotAddresses.size() <= handle.index) {
+		m_slotAddresses.resize(handle.index + 1);
+		m_bufferRefs.resize(handle.index + 1);
+	}
+	m_slotAddresses[handle.index]	= address;
+	m_bufferRefs[handle.index]		= 1;
+	m_bufferAddresses[address]		= handle;
+
+	ReserveTable(m_allBuffers, (handle.index + 1) * sizeof(vk::DeviceAddress));
+	*WriteTable<vk::DeviceAddress>(m_allBuffers, handle.index) = address;
+
+	return handle;
+}
+
+void BindlessManager::AddMeshlets(BindlessHandle mesh, const MeshletData& meshlets) {
+	//Each layer is bounded by a sphere around its meshlets' spheres
+	std::vector<Vector4> layerBounds(meshlets.subMeshRanges.size(), NO_LAYER_BOUNDS);
+	for (size_t layer = 0; layer < layerBounds.size(); ++layer) {
+		const MeshletRange& range = meshlets.subMeshRanges[layer];
+		for (uint32_t i = 0; i < range.meshletCount; ++i) {
+			const Vector4& sphere = meshlets.meshlets[range.firstMeshlet + i].boundingSphere;
+			layerBounds[layer] = i == 0 ? sphere : MergeSpheres(layerBounds[layer], sphere);
 		}
+	}
+
+	std::lock_guard lock(m_mutex);
+	assert(m_meshSlots.IsCurrent(mesh));
+	MeshRecord& record = m_meshRecords[mesh.index];
+
+	assert(meshlets.subMeshRanges.size() <= record.layers.count);
+
+	//Anything added before is replaced
+	FreeRange(m_meshletAllocator, record.meshlets);
+	FreeRange(m_meshletVertexAllocator, record.meshletVertices);
+	FreeRange(m_meshletTriangleAllocator, record.meshletTriangles);
+
+	record.meshlets			= AllocateRange(m_meshletAllocator, m_meshlets, sizeof(MeshletEntry), meshlets.meshlets.size());
+	record.meshletVertices	= AllocateRange(m_meshletVertexAllocator, m_meshletVertices, sizeof(uint32_t), meshlets.vertices.size());
+	record.meshletTriangles	= AllocateRange(m_meshletTriangleAllocator, m_meshletTriangles, sizeof(uint32_t), meshlets.triangles.size());
+
+	uint32_t firstMeshlet	= (uint32_t)record.meshlets.first;
+	uint32_t firstVertex	= (uint32_t)record.meshletVertices.first;
+	uint32_t firstTriangle	= (uint32_t)record.meshletTriangles.first;
+
+	//Offsets within the MeshletData become offsets into the shared tables
+	MeshletRange* ranges = WriteTable<MeshletRange>(m_meshletRanges, record.layers.first, meshlets.subMeshRanges.size());
+	for (const MeshletRange& range : meshlets.subMeshRanges) {
+		ranges->firstMeshlet = range.firstMeshlet + firstMeshlet;
+		ranges->meshletCount = range.meshletCount;
+		ranges++;
+	}
+	memcpy(WriteTable<Vector4>(m_layerBounds, record.layers.first, layerBounds.size()), layerBounds.data(), layerBounds.size() * sizeof(Vector4));
 
-		m_meshLayersBuffer.Unmap();
-		m_meshesBuffer.Unmap();
+	MeshletEntry* entries = WriteTable<MeshletEntry>(m_meshlets, firstMeshlet, meshlets.meshlets.size());
+	for (const MeshletEntry& meshlet : meshlets.meshlets) {
+		*entries = meshlet;
+		entries->vertexOffset	+= firstVertex;
+		entries->triangleOffset += firstTriangle;
+		entries++;
 	}
 
-	return entry.first->second;
+	memcpy(WriteTable<uint32_t>(m_meshletVertices, firstVertex, meshlets.vertices.size()), meshlets.vertices.data(), meshlets.vertices.size() * sizeof(uint32_t));
+	memcpy(WriteTable<uint32_t>(m_meshletTriangles, firstTriangle, meshlets.triangles.size()), meshlets.triangles.data(), meshlets.triangles.size() * sizeof(uint32_t));
 }
 
-uint32_t BindlessManager::AddTexture(const VKQuick::Texture& tex, const vk::Sampler sampler) {
-	auto entry = m_textures.insert({ &tex , (uint32_t)m_textures.size() });
+void BindlessManager::AddMeshLODs(BindlessHandle mesh, const std::vector<float>& lodErrors) {
+	std::lock_guard lock(m_mutex);
+	assert(m_meshSlots.IsCurrent(mesh));
+	MeshRecord& record = m_meshRecords[mesh.index];
 
-	if (entry.second) { //This was a new texture!
-		WriteCombinedImageDescriptor(m_device, *m_bindlessSet, TEXTURE_SLOT, entry.first->second, tex, sampler);
+	//A mesh without LODs draws all of its ranges as LOD 0
+	static const std::vector<float> singleLOD = { 0.0f };
+	const std::vector<float>& errors = lodErrors.empty() ? singleLOD : lodErrors;
+	assert(record.layers.count % errors.size() == 0);
+
+	FreeRange(m_lodAllocator, record.lods);
+	record.lods = AllocateRange(m_lodAllocator, m_meshLODs, sizeof(MeshLODEntry), errors.size());
+
+	uint32_t firstSubMesh	= (uint32_t)record.layers.first;
+	uint32_t subMeshCount	= (uint32_t)record.layers.count / (uint32_t)errors.size();
+
+	MeshLODRange& range = *WriteTable<MeshLODRange>(m_meshLODRanges, mesh.index);
+	range.firstLOD = (uint32_t)record.lods.first;
+	range.lodCount = (uint32_t)errors.size();
+
+	MeshLODEntry* lods = WriteTable<MeshLODEntry>(m_meshLODs, record.lods.first, errors.size());
+	for (size_t i = 0; i < errors.size(); ++i) {
+		lods[i].firstSubMeshIndex	= firstSubMesh + (uint32_t)i * subMeshCount;
+		lods[i].error				= errors[i];
+	}
+}
+
+BindlessManager::MaterialPool& BindlessManager::GetMaterialPool(std::type_index type, size_t size) {
+	MaterialPool& pool = m_materialPools[type];
+	pool.stride = size;
+	return pool;
+}
+
+void BindlessManager::ReserveMaterials(MaterialPool& pool, size_t count) {
+	if (pool.freeSlots.size() >= count) {
+		return;
+	}
+	//Slots are added a run at a time, so materials of the same type sit together in memory
+	size_t newSlots = std::max(count - pool.freeSlots.size(), MATERIAL_POOL_GROWTH);
+
+	//Materials must start at a multiple of the stride, so they can be found by index, and be 16 byte aligned for std430
+	size_t		alignment	= std::lcm(pool.stride, MATERIAL_ALIGNMENT);
+	TableRange	range		= AllocateRange(m_materialAllocator, m_materials, 1, newSlots * pool.stride, alignment);
+
+	uint32_t firstIndex	= (uint32_t)(range.first / pool.stride);
+	uint32_t lastIndex	= firstIndex + (uint32_t)newSlots;
+	if (pool.generations.size() < lastIndex) {
+		pool.generations.resize(lastIndex);
+		pool.refs.resize(lastIndex);
+		pool.hashes.resize(lastIndex);
+	}
+	//Handed out lowest index first
+	for (uint32_t i = lastIndex; i > firstIndex; --i) {
+		pool.freeSlots.push_back(i - 1);
+	}
+}
+
+//FNV-1a
+uint64_t BindlessManager::HashMaterial(const void* data, size_t size) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ ((const uint8_t*)data)[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+BindlessHandle BindlessManager::AddMaterialData(MaterialPool& pool, const void* data, uint64_t hash) {
+	auto [first, last] = pool.byHash.equal_range(hash);
+	for (auto i = first; i != last; ++i) {
+		const char* existing = m_materials.shadow.data() + i->second * pool.stride;
+		if (memcmp(existing, data, pool.stride) == 0) {
+			pool.refs[i->second]++;
+			return { i->second, pool.generations[i->second] };
+		}
 	}
 
-	return entry.first->second;
+	ReserveMaterials(pool, 1);
+	uint32_t index = pool.freeSlots.back();
+	pool.freeSlots.pop_back();
+
+	memcpy(WriteTable<char>(m_materials, index * pool.stride, pool.stride), data, pool.stride);
+
+	pool.refs[index]	= 1;
+	pool.hashes[index]	= hash;
+	pool.byHash.insert({ hash, index });
+
+	return { index, pool.generations[index] };
+}
+
+void BindlessManager::RemoveMaterialData(MaterialPool& pool, BindlessHandle handle) {
+	bool isCurrent = handle.index < pool.generations.size() && pool.generations[handle.index] == handle.generation && pool.refs[handle.index] > 0;
+	assert(isCurrent);
+	if (!isCurrent || --pool.refs[handle.index] > 0) {
+		return;
+	}
+	//Nothing identical can be added to this index from now on, it gets a new one instead
+	auto [first, last] = pool.byHash.equal_range(pool.hashes[handle.index]);
+	for (auto i = first; i != last; ++i) {
+		if (i->second == handle.index) {
+			pool.byHash.erase(i);
+			break;
+		}
+	}
+	pool.generations[handle.index]++;
+	Retire([&pool, index = handle.index]() { pool.freeSlots.push_back(index); });
 }
 
-uint32_t BindlessManager::AddBuffer(const VKQuick::Buffer& buffer) {
-	auto entry = m_buffers.insert({ &buffer , (uint32_t)m_buffers.size() });
+void BindlessManager::RemoveMesh(BindlessHandle handle) {
+	std::lock_guard lock(m_mutex);
+	assert(m_meshSlots.IsCurrent(handle));
+	if (!m_meshSlots.IsCurrent(handle) || !m_meshAddresses.Release(handle)) {
+		return;
+	}
+	m_meshSlots.Release(handle.index);
 
-	if (entry.second) { //This was a new buffer!
-		vk::DeviceAddress& addresses = m_allBuffers.Map<vk::DeviceAddress>()[entry.first->second];
-		addresses = buffer.GetDeviceAddress();
-		m_allBuffers.Unmap();
+	MeshRecord& record = m_meshRecords[handle.index];
+	for (BindlessHandle buffer : record.buffers) {
+		ReleaseBuffer(buffer);
 	}
+	record.buffers.clear();
 
-	return entry.first->second;
+	FreeRange(m_layerAllocator, record.layers);
+	FreeRange(m_meshletAllocator, record.meshlets);
+	FreeRange(m_meshletVertexAllocator, record.meshletVertices);
+	FreeRange(m_meshletTriangleAllocator, record.meshletTriangles);
+	FreeRange(m_lodAllocator, record.lods);
+
+	Retire([this, index = handle.index]() { m_meshSlots.freeSlots.push_back(index); });
+}
+
+void BindlessManager::RemoveTexture(BindlessHandle handle) {
+	std::lock_guard lock(m_mutex);
+	assert(m_textureSlots.IsCurrent(handle));
+	if (!m_textureSlots.IsCurrent(handle) || !m_textureAddresses.Release(handle)) {
+		return;
+	}
+	//The descriptor is left as it is until the index is reused, which is fine as the array is partially bound
+	m_textureSlots.Release(handle.index);
+	Retire([this, index = handle.index]() { m_textureSlots.freeSlots.push_back(index); });
+}
+
+void BindlessManager::RemoveBuffer(BindlessHandle handle) {
+	std::lock_guard lock(m_mutex);
+	ReleaseBuffer(handle);
+}
+
+void BindlessManager::ReleaseBuffer(BindlessHandle handle) {
+	assert(m_bufferSlots.IsCurrent(handle));
+	if (!m_bufferSlots.IsCurrent(handle) || --m_bufferRefs[handle.index] > 0) {
+		return;
+	}
+	m_bufferAddresses.erase(m_slotAddresses[handle.index]);
+	m_bufferSlots.Release(handle.index);
+	Retire([this, index = handle.index]() { m_bufferSlots.freeSlots.push_back(index); });
 }
\ No newline at end of file
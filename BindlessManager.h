@@ -7,65 +7,459 @@ License: MIT (see LICENSE file at the top of the source tree)
 *//////////////////////////////////////////////////////////////////////////////
 #pragma once
 #include "../VKQuick/Buffer.h"
+#include "RangeAllocator.h"
+
+#include <mutex>
+#include <span>
+#include <typeindex>
+
+struct MeshEntry;
+struct MeshLayerEntry;
+
+namespace NCL::Rendering::Vulkan {
+	struct MeshletData;
+	class VulkanMesh;
+}
 
 namespace VKQuick {
 	class MemoryManager;
 	class Mesh;
 	class Texture;
 	class Buffer;
+	struct VKQuickInitialisation;
+
+	//Indexed the same as MeshEntry
+	struct MeshLODRange {
+		uint32_t firstLOD;
+		uint32_t lodCount;
+	};
+
+	struct MeshLODEntry {
+		uint32_t	firstSubMeshIndex;	//Into the MeshLayerEntry table
+		float		error;				//In model space units
+	};
+
+	//index is what shaders use. The generation changes each time an index is reused,
+	//so a handle to something that has since been removed is never mistaken for its replacement
+	struct BindlessHandle {
+		uint32_t index		= ~0u;
+		uint32_t generation = 0;
+
+		bool IsValid() const {
+			return index != ~0u;
+		}
+	};
 
+	enum class BindlessBackend {
+		DescriptorSets,		//Update after bind descriptor sets, allocated from a pool
+		DescriptorBuffer	//VK_EXT_descriptor_buffer, with descriptors written straight into mapped memory
+	};
+
+	/*
+	Every table grows geometrically as things are added, and removed entries
+	are recycled. Nothing removed is reused until framesInFlight frames have
+	passed, so frames still executing never see an entry change under them.
+	Call NextFrame once per frame, after the frame has begun.
+
+	Tables live in device local memory, and are edited through a CPU side
+	copy. RecordUpdates copies whatever has changed into the GPU tables, and
+	must be recorded once per frame, ahead of anything that reads them.
+
+	Descriptor writes are gathered up until Flush, which writes them all with
+	a single vkUpdateDescriptorSets. Flush before recording commands that use
+	anything added since the last flush. NextFrame flushes too.
+
+	A descriptor can't be rewritten while a frame still executing might read
+	it, so each frame in flight has its own copy of the sets. Flush writes
+	only the current frame's copy, and the others catch up as each comes
+	round again, so the sets to bind change every frame.
+
+	Given the physical device, the texture array is sized from its limits, up
+	to MAX_BINDLESS_TEXTURES, and the sets come from a pool of the manager's
+	own. Otherwise the array holds 1024 textures, and the pool passed in
+	needs room for framesInFlight of each set.
+
+	The descriptor buffer backend is used only if asked for, and the
+	initialisation the device was created from shows VK_EXT_descriptor_buffer
+	and its descriptorBuffer feature were enabled, falling back to descriptor
+	sets otherwise. Its copies are descriptor
+	buffers rather than sets. Pipelines using it must be created with
+	vk::PipelineCreateFlagBits::eDescriptorBufferEXT, can't bind descriptor
+	sets too, and should bind through Bind rather than the sets.
+
+	Meshes, textures, buffers and materials can be added, updated and removed
+	from any thread, such as by asset loaders. Everything else belongs to the
+	thread recording the frame. Only the table edits themselves are done
+	under the lock, so loaders spend little time waiting on each other.
+	*/
 	class BindlessManager {
 	public:
-		BindlessManager(vk::Device device, vk::DescriptorPool pool,  MemoryManager& memManager, uint32_t initialBufferSizes = 1024 * 1024);
+		struct MeshDesc {
+			const VKQuick::Mesh*		mesh;
+			std::span<const int32_t>	materials;
+		};
+
+		struct ArenaMeshDesc {
+			const NCL::Rendering::Vulkan::VulkanMesh*	mesh;
+			std::span<const int32_t>					materials;
+		};
+
+		struct TextureDesc {
+			const VKQuick::Texture*	texture;
+			vk::Sampler				sampler;
+		};
+
+		//Descriptor buffers can hold far more textures than are useful, so the array is kept to this many
+		static const uint32_t MAX_BINDLESS_TEXTURES = 65536;
+
+		//framesInFlight must match the renderer's, such as VKQuickInitialisation::framesInFlight, or
+		//removed entries and old descriptors could be reused while a frame still reads them
+		BindlessManager(vk::Device device, vk::DescriptorPool pool,  MemoryManager& memManager, uint32_t initialBufferSizes, uint32_t framesInFlight,
+			vk::PhysicalDevice gpu = {}, BindlessBackend backend = BindlessBackend::DescriptorSets, const VKQuickInitialisation* deviceInit = nullptr);
+		~BindlessManager();
 
-		~BindlessManager() {
+		//Adding the same mesh or texture again returns its existing handle, ignoring the new materials or
+		//sampler, and the index is kept until every Add has been removed. It must be removed before it
+		//is destroyed, so that something else created at the same address isn't mistaken for it.
+		BindlessHandle AddMesh(const VKQuick::Mesh& mesh, std::vector< int32_t > materials);
+		//Meshes in a VulkanMeshArena share the arena's pool addresses, with their offsets within them
+		BindlessHandle AddArenaMesh(const NCL::Rendering::Vulkan::VulkanMesh& mesh, std::vector< int32_t > materials);
+		//Returns an invalid handle once every index up to GetTextureCapacity is in use
+		BindlessHandle AddTexture(const VKQuick::Texture& tex, const vk::Sampler sampler);
 
-		} 
+		//Batched versions of the above, which grow each table at most once. Textures that don't fit are given invalid handles.
+		std::vector<BindlessHandle> AddMeshes(std::span<const MeshDesc> meshes);
+		std::vector<BindlessHandle> AddArenaMeshes(std::span<const ArenaMeshDesc> meshes);
+		std::vector<BindlessHandle> AddTextures(std::span<const TextureDesc> textures);
 
-		uint32_t AddMesh(const VKQuick::Mesh& mesh, std::vector< int32_t > materials);
-		uint32_t AddTexture(const VKQuick::Texture& tex, const vk::Sampler sampler);
-		uint32_t AddBuffer(const VKQuick::Buffer& buffer);
+		//Adding the same buffer again returns the same index, which is kept until every Add has been removed
+		BindlessHandle AddBuffer(const VKQuick::Buffer& buffer);
 
+		//Points an existing texture index at a different texture, such as a higher resolution version of it.
+		//Adding the new texture from then on returns this index.
+		void UpdateTexture(BindlessHandle handle, const VKQuick::Texture& tex, const vk::Sampler sampler);
+
+		//The mesh's MeshletRanges are indexed the same as its MeshLayerEntries
+		void AddMeshlets(BindlessHandle mesh, const NCL::Rendering::Vulkan::MeshletData& meshlets);
+
+		//The mesh's ranges must be split evenly between each of the LODs. No errors at all is taken as a single LOD 0.
+		void AddMeshLODs(BindlessHandle mesh, const std::vector<float>& lodErrors);
+
+		//Each material type has its own pool within the material table, with every material of
+		//type T at a multiple of sizeof(T), so shaders can index it as an array of T.
+		//Adding a material identical to an existing one of the same type returns the existing
+		//index, so padding within T should be zeroed.
 		template<typename T>
-		uint32_t AddMaterial(const T& mat) {
-			uint32_t index = m_materialsAdded;
+		BindlessHandle AddMaterial(const T& mat) {
+			uint64_t hash = HashMaterial(&mat, sizeof(T));
 
-			T& material = m_materialsBuffer.Map<T>()[index];
-			material = mat;
-			m_materialsBuffer.Unmap();
+			std::lock_guard lock(m_mutex);
+			return AddMaterialData(GetMaterialPool(typeid(T), sizeof(T)), &mat, hash);
+		}
+
+		template<typename T>
+		std::vector<BindlessHandle> AddMaterials(std::span<const T> mats) {
+			std::vector<uint64_t> hashes(mats.size());
+			for (size_t i = 0; i < mats.size(); ++i) {
+				hashes[i] = HashMaterial(&mats[i], sizeof(T));
+			}
+			std::lock_guard lock(m_mutex);
+			//No space is reserved up front, as most of a batch may turn out to be duplicates
+			MaterialPool& pool = GetMaterialPool(typeid(T), sizeof(T));
 
-			m_materialsAdded++;
+			std::vector<BindlessHandle> handles(mats.size());
+			for (size_t i = 0; i < mats.size(); ++i) {
+				handles[i] = AddMaterialData(pool, &mats[i], hashes[i]);
+			}
+			return handles;
+		}
 
-			return index;
+		//Every Add of an identical material must be removed before its index is reused
+		template<typename T>
+		void RemoveMaterial(BindlessHandle handle) {
+			std::lock_guard lock(m_mutex);
+			RemoveMaterialData(GetMaterialPool(typeid(T), sizeof(T)), handle);
 		}
 
+		void RemoveMesh(BindlessHandle handle);
+		void RemoveTexture(BindlessHandle handle);
+		void RemoveBuffer(BindlessHandle handle);
+
+		//Copies the tables' changes since the last call over to the GPU
+		void RecordUpdates(vk::CommandBuffer cmdBuffer);
+
+		//Writes every descriptor changed since the last Flush
+		void Flush();
+
+		void NextFrame();
+
+		//Binds the main set at firstSet, and the geometry set after it, whichever the backend
+		void Bind(vk::CommandBuffer cmdBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t firstSet = 0) const;
+
+		//Whether the gpu has the descriptorBuffer feature, and deviceInit, which the device was created
+		//from, enabled both it and VK_EXT_descriptor_buffer
+		static bool SupportsDescriptorBuffers(vk::PhysicalDevice gpu, const VKQuickInitialisation& deviceInit);
+
+		bool UsesDescriptorBuffer() const {
+			return m_useDescriptorBuffer;
+		}
+
+		uint32_t GetTextureCapacity() const {
+			return m_textureCapacity;
+		}
+
+		//The current frame's copy, so needs fetching again for each frame. Null when using the descriptor buffer backend.
 		vk::DescriptorSet GetDescriptorSet() const {
-			return *m_bindlessSet;
+			return m_setCopies.empty() ? vk::DescriptorSet() : *m_setCopies[m_frame % m_framesInFlight].main;
 		}
 
 		vk::DescriptorSetLayout GetDescriptorSetLayout() const {
 			return *m_bindlessLayout;
 		}
 
+		//Meshlet tables live in their own set, as the texture array must be the last binding of the main set.
+		//Like GetDescriptorSet, changes every frame, and is null when using the descriptor buffer backend.
+		vk::DescriptorSet GetGeometryDescriptorSet() const {
+			return m_setCopies.empty() ? vk::DescriptorSet() : *m_setCopies[m_frame % m_framesInFlight].geometry;
+		}
+
+		vk::DescriptorSetLayout GetGeometryDescriptorSetLayout() const {
+			return *m_geometryLayout;
+		}
+
+		//The CPU side copies of the tables, which the GPU will see once the next RecordUpdates has executed.
+		//Tables move as they grow, so these are only safe to read while nothing is being added.
+		const MeshEntry* GetMeshEntries() const {
+			return (const MeshEntry*)m_meshEntries.shadow.data();
+		}
+
+		const MeshLayerEntry* GetMeshLayers() const {
+			return (const MeshLayerEntry*)m_meshLayers.shadow.data();
+		}
+
+		const MeshLODRange* GetMeshLODRanges() const {
+			return (const MeshLODRange*)m_meshLODRanges.shadow.data();
+		}
+
+		const MeshLODEntry* GetMeshLODs() const {
+			return (const MeshLODEntry*)m_meshLODs.shadow.data();
+		}
+
+		//Model space bounding sphere of each mesh layer that has had meshlets added, and a negative radius otherwise
+		const NCL::Maths::Vector4* GetLayerBounds() const {
+			return (const NCL::Maths::Vector4*)m_layerBounds.shadow.data();
+		}
+
 	protected:
+		static const uint32_t MAIN_SET		= 0;
+		static const uint32_t GEOMETRY_SET	= 1;
+
+		//A storage buffer, and where it is bound
+		struct Table {
+			VKQuick::Buffer		buffer;
+			std::vector<char>	shadow;		//What the CPU edits
+			std::vector<std::pair<size_t, size_t>> dirty;	//Byte ranges of shadow to upload
+			uint32_t			set		= 0;	//MAIN_SET or GEOMETRY_SET
+			uint32_t			binding = 0;
+			bool				rebind	= false;	//Descriptors need to be written on the next Flush
+			std::string			name;
+		};
+
+		struct PendingTexture {
+			uint32_t				index;
+			vk::DescriptorImageInfo	info;
+		};
+
+		struct StagingBuffer {
+			VKQuick::Buffer	buffer;
+			char*			data = nullptr;
+		};
+
+		//One frame in flight's copy of the descriptor sets
+		struct SetCopy {
+			vk::UniqueDescriptorSet		main;
+			vk::UniqueDescriptorSet		geometry;
+			std::vector<PendingTexture>	textures;	//Texture writes not yet made to this copy
+			std::vector<const Table*>	tables;		//Tables that have moved since this copy was last written
+		};
+
+		//One frame in flight's copy of the descriptor buffer
+		struct DescriptorCopy {
+			VKQuick::Buffer	buffer;
+			char*			data = nullptr;
+			std::vector<std::pair<size_t, size_t>> dirty;	//Byte ranges of m_descriptorShadow not yet copied in
+		};
+
+		//Entries [first, first + count) of the table, which will be uploaded with the next RecordUpdates
+		template<typename T>
+		T* WriteTable(Table& table, size_t first, size_t count = 1) {
+			MarkDirty(table, first * sizeof(T), count * sizeof(T));
+			return (T*)table.shadow.data() + first;
+		}
+
+		void MarkDirty(Table& table, size_t offset, size_t size);
+
+		//Indices handed out with a generation each, and recycled once retired
+		struct SlotList {
+			std::vector<uint32_t> generations;
+			std::vector<uint32_t> freeSlots;
+
+			BindlessHandle Allocate();
+			bool IsCurrent(BindlessHandle handle) const;
+			//Stops handles to the index being current, but the index isn't reused until it is freed
+			void Release(uint32_t index);
+		};
+
+		//The handle each mesh or texture was added with, so that adding it again shares the index
+		struct AddressLookup {
+			std::unordered_map<const void*, BindlessHandle>	handles;
+			std::vector<const void*>	addresses;	//Of each index
+			std::vector<uint32_t>		refs;		//Of each index
+
+			//The handle for the address with another reference to it, or an invalid handle if it isn't current
+			BindlessHandle Find(const void* address, const SlotList& slots);
+			void Insert(const void* address, BindlessHandle handle);
+			//Moves the index over to a different address
+			void Rebind(BindlessHandle handle, const void* address);
+			//True once every reference to the handle has been released
+			bool Release(BindlessHandle handle);
+		};
+
+		//A run of entries in one of the variable length tables
+		struct TableRange {
+			size_t first = 0;
+			size_t count = 0;
+		};
+
+		struct MeshRecord {
+			TableRange					layers;
+			TableRange					meshlets;
+			TableRange					meshletVertices;
+			TableRange					meshletTriangles;
+			TableRange					lods;
+			std::vector<BindlessHandle>	buffers;
+		};
+
+		struct MaterialPool {
+			size_t					stride = 0;
+			std::vector<uint32_t>	generations;
+			std::vector<uint32_t>	refs;
+			std::vector<uint64_t>	hashes;
+			std::vector<uint32_t>	freeSlots;
+			std::unordered_multimap<uint64_t, uint32_t> byHash;	//Content hash -> index
+		};
+
+		static uint64_t	HashMaterial(const void* data, size_t size);
+
+		//Everything from here on expects m_mutex to be held
+		MaterialPool&	GetMaterialPool(std::type_index type, size_t size);
+		BindlessHandle	AddMaterialData(MaterialPool& pool, const void* data, uint64_t hash);
+		void			RemoveMaterialData(MaterialPool& pool, BindlessHandle handle);
+		//Adds slots to the pool's free list until there are at least count of them
+		void			ReserveMaterials(MaterialPool& pool, size_t count);
+		BindlessHandle	AllocateMesh(size_t layerCount, MeshRecord*& record);
+		//Makes room for count more meshes, with layerCount layers between them
+		void			ReserveMeshes(size_t count, size_t layerCount);
+
+		BindlessHandle	WriteMesh(const VKQuick::Mesh& mesh, std::span<const int32_t> materials);
+		BindlessHandle	WriteArenaMesh(const NCL::Rendering::Vulkan::VulkanMesh& mesh, std::span<const int32_t> materials);
+		BindlessHandle	WriteTexture(const VKQuick::Texture& tex, const vk::Sampler sampler);
+
+		//AddBuffer and RemoveBuffer, for callers already holding the lock
+		BindlessHandle	AcquireBuffer(const VKQuick::Buffer& buffer);
+		void			ReleaseBuffer(BindlessHandle handle);
+
+		void CreateTable(Table& table, size_t size, const std::string& name);
+		void BindTable(Table& table, uint32_t set, uint32_t binding);
+		//Grows the table's buffer to at least size bytes, moving over its contents
+		void ReserveTable(Table& table, size_t size);
+
+		TableRange	AllocateRange(NCL::Rendering::Vulkan::RangeAllocator& allocator, Table& table, size_t elementSize, size_t count, size_t alignment = 1);
+		//Grows the table if there isn't a free run of count elements
+		void		ReserveRange(NCL::Rendering::Vulkan::RangeAllocator& allocator, Table& table, size_t elementSize, size_t count);
+		//The range goes back to the allocator once retired
+		void		FreeRange(NCL::Rendering::Vulkan::RangeAllocator& allocator, TableRange& range);
+
+		uint32_t	ChooseTextureCapacity(vk::PhysicalDevice gpu) const;
+		void		CreateDescriptorBuffers(vk::PhysicalDevice gpu);
+		//Writes a descriptor into m_descriptorShadow, and marks it for copying into every descriptor buffer
+		void		WriteDescriptor(const vk::DescriptorGetInfoEXT& info, size_t descriptorSize, size_t offset);
+		void		UpdateDescriptorCopy(DescriptorCopy& copy);
+		//Makes the writes that the copy has missed since it was last in use
+		void		UpdateSetCopy(SetCopy& copy);
+		//Flush, for the descriptor buffer backend
+		void		FlushDescriptorBuffer();
+
+		//Runs once every frame that could have been using something has completed
+		void Retire(std::function<void()> func);
+
 		vk::Device			m_device;
 		MemoryManager&		m_memoryManager;
 
-		vk::UniqueDescriptorSet			m_bindlessSet;
+		//Guards every table, allocator and list below
+		std::mutex			m_mutex;
+
+		vk::UniqueDescriptorPool		m_ownPool;
+
 		vk::UniqueDescriptorSetLayout	m_bindlessLayout;
 
-		std::unordered_map<const VKQuick::Mesh*		, uint32_t>	m_meshes;
-		std::unordered_map<const VKQuick::Texture*	, uint32_t> m_textures;
-		std::unordered_map<const VKQuick::Buffer*	, uint32_t>	m_buffers;
+		Table	m_allBuffers;
+		Table	m_materials;
+		Table	m_meshEntries;
+		Table	m_meshLayers;
+
+		vk::UniqueDescriptorSetLayout	m_geometryLayout;
+
+		Table	m_meshletRanges;
+		Table	m_meshlets;
+		Table	m_meshletVertices;
+		Table	m_meshletTriangles;
+		Table	m_meshLODRanges;
+		Table	m_meshLODs;
+		Table	m_layerBounds;
+
+		std::vector<Table*> m_tables;
+
+		SlotList	m_meshSlots;
+		SlotList	m_textureSlots;
+		SlotList	m_bufferSlots;
+
+		AddressLookup	m_meshAddresses;
+		AddressLookup	m_textureAddresses;
+
+		std::vector<MeshRecord>	m_meshRecords;
+
+		//Buffers are shared between meshes, so are found by address and reference counted
+		std::unordered_map<vk::DeviceAddress, BindlessHandle>	m_bufferAddresses;
+		std::vector<vk::DeviceAddress>							m_slotAddresses;
+		std::vector<uint32_t>									m_bufferRefs;
+
+		NCL::Rendering::Vulkan::RangeAllocator	m_layerAllocator;
+		NCL::Rendering::Vulkan::RangeAllocator	m_meshletAllocator;
+		NCL::Rendering::Vulkan::RangeAllocator	m_meshletVertexAllocator;
+		NCL::Rendering::Vulkan::RangeAllocator	m_meshletTriangleAllocator;
+		NCL::Rendering::Vulkan::RangeAllocator	m_lodAllocator;
+		NCL::Rendering::Vulkan::RangeAllocator	m_materialAllocator;	//In bytes
+
+		std::unordered_map<std::type_index, MaterialPool> m_materialPools;
 
-		VKQuick::Buffer	m_allBuffers;
+		std::vector<std::pair<uint64_t, std::function<void()>>>	m_retired;
+		std::vector<std::pair<uint64_t, VKQuick::Buffer>>		m_retiredBuffers;
 
-		VKQuick::Buffer	m_materialsBuffer;
-		VKQuick::Buffer	m_meshesBuffer;
-		VKQuick::Buffer	m_meshLayersBuffer;
+		std::vector<PendingTexture>	m_pendingTextures;
+		std::vector<StagingBuffer>	m_staging;
+		std::vector<SetCopy>		m_setCopies;
 
-		uint32_t m_subLayersUsed = 0;
+		bool						m_useDescriptorBuffer = false;
+		std::vector<char>			m_descriptorShadow;
+		std::vector<DescriptorCopy>	m_descriptorCopies;
+		vk::DeviceSize				m_geometryDescriptorOffset	= 0;
+		vk::DeviceSize				m_textureDescriptorOffset	= 0;
+		size_t						m_storageDescriptorSize		= 0;
+		size_t						m_textureDescriptorSize		= 0;
 
-		uint32_t m_materialsAdded = 0;
+		uint32_t	m_textureCapacity;
+		uint32_t	m_framesInFlight;
+		uint64_t	m_frame				= 0;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,292 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "CullingBVH.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+//SSE2 is always there on x64, anything else falls back to the same tests one child at a time
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+//Behind every plane with a non-zero normal, so unused slots are always culled
+const BoundingBox EMPTY_BOUNDS = {
+	Vector3( FLT_MAX,  FLT_MAX,  FLT_MAX),
+	Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX)
+};
+
+//A frustum plane splatted across all four children, and the bounds rows holding
+//the corners of a box furthest in front of (positive) and behind (negative) it
+struct alignas(16) PlaneTest {
+	float	x[4];
+	float	y[4];
+	float	z[4];
+	float	w[4];
+	int		positiveRows[3];
+	int		negativeRows[3];
+};
+
+//Returns a bit for each child whose chosen corner is behind the plane
+static int BehindPlane(const float (&bounds)[6][4], const PlaneTest& plane, const int (&rows)[3]) {
+#ifdef CULLING_BVH_SSE
+	__m128 d = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(_mm_load_ps(plane.x), _mm_load_ps(bounds[rows[0]])), _mm_mul_ps(_mm_load_ps(plane.y), _mm_load_ps(bounds[rows[1]]))),
+		_mm_add_ps(_mm_mul_ps(_mm_load_ps(plane.z), _mm_load_ps(bounds[rows[2]])), _mm_load_ps(plane.w))
+	);
+	return _mm_movemask_ps(_mm_cmplt_ps(d, _mm_setzero_ps()));
+#else
+	int mask = 0;
+	for (int i = 0; i < 4; ++i) {
+		float d = (plane.x[i] * bounds[rows[0]][i] + plane.y[i] * bounds[rows[1]][i]) + (plane.z[i] * bounds[rows[2]][i] + plane.w[i]);
+		mask |= (d < 0.0f) << i;
+	}
+	return mask;
+#endif
+}
+
+void CullingBVH::Build(std::span<const BoundingBox> boxes) {
+	m_nodes.clear();
+	m_boxLocations.assign(boxes.size(), 0);
+	m_dirtyQueue = {};
+
+	if (!boxes.empty()) {
+		std::vector<uint32_t> items(boxes.size());
+		std::iota(items.begin(), items.end(), 0);
+
+		std::vector<Vector3> centres(boxes.size());
+		for (size_t i = 0; i < boxes.size(); ++i) {
+			centres[i] = (boxes[i].min + boxes[i].max) * 0.5f;
+		}
+		//Every node but the root has at least two children
+		m_nodes.reserve(boxes.size() / 2 + 1);
+		BuildNode(items, centres, boxes, NO_PARENT, 0);
+	}
+	m_dirtyNodes.assign(m_nodes.size(), 0);
+}
+
+//Halves items at the median centre along the widest axis of their centres
+static std::pair<std::span<uint32_t>, std::span<uint32_t>> SplitItems(std::span<uint32_t> items, const std::vector<Vector3>& centres) {
+	Vector3 minCentre = centres[items[0]];
+	Vector3 maxCentre = centres[items[0]];
+	for (uint32_t i : items) {
+		for (int axis = 0; axis < 3; ++axis) {
+			minCentre[axis] = std::min(minCentre[axis], centres[i][axis]);
+			maxCentre[axis] = std::max(maxCentre[axis], centres[i][axis]);
+		}
+	}
+	Vector3 extent = maxCentre - minCentre;
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	size_t half = items.size() / 2;
+	std::nth_element(items.begin(), items.begin() + half, items.end(),
+		[&](uint32_t a, uint32_t b) {
+			return centres[a][axis] < centres[b][axis];
+		}
+	);
+	return { items.subspan(0, half), items.subspan(half) };
+}
+
+uint32_t CullingBVH::BuildNode(std::span<uint32_t> items, const std::vector<Vector3>& centres, std::span<const BoundingBox> boxes, uint32_t parent, uint32_t parentSlot) {
+	uint32_t nodeIndex = (uint32_t)m_nodes.size();
+	Node& node = m_nodes.emplace_back();
+	node.parent		= parent;
+	node.parentSlot	= parentSlot;
+	for (uint32_t slot = 0; slot < 4; ++slot) {
+		node.children[slot] = EMPTY_CHILD;
+		SetChildBounds(node, slot, EMPTY_BOUNDS);
+	}
+
+	std::span<uint32_t> groups[4];
+	if (items.size() <= 4) {
+		for (size_t i = 0; i < items.size(); ++i) {
+			groups[i] = items.subspan(i, 1);
+		}
+	}
+	else {
+		auto [left, right] = SplitItems(items, centres);
+		std::tie(groups[0], groups[1]) = SplitItems(left, centres);
+		std::tie(groups[2], groups[3]) = SplitItems(right, centres);
+	}
+
+	for (uint32_t slot = 0; slot < 4; ++slot) {
+		if (groups[slot].empty()) {
+			continue;
+		}
+		if (groups[slot].size() == 1) {
+			uint32_t box = groups[slot][0];
+			m_nodes[nodeIndex].children[slot] = box | LEAF_FLAG;
+			SetChildBounds(m_nodes[nodeIndex], slot, boxes[box]);
+			m_boxLocations[box] = nodeIndex << 2 | slot;
+		}
+		else {
+			//Building the child can move m_nodes, so this node is looked up again afterwards
+			uint32_t child = BuildNode(groups[slot], centres, boxes, nodeIndex, slot);
+			m_nodes[nodeIndex].children[slot] = child;
+			SetChildBounds(m_nodes[nodeIndex], slot, GetNodeBounds(m_nodes[child]));
+		}
+	}
+	return nodeIndex;
+}
+
+void CullingBVH::UpdateBox(uint32_t index, const BoundingBox& box) {
+	uint32_t location = m_boxLocations[index];
+	SetChildBounds(m_nodes[location >> 2], location & 3, box);
+	MarkDirty(location >> 2);
+}
+
+void CullingBVH::Refit() {
+	while (!m_dirtyQueue.empty()) {
+		uint32_t index = m_dirtyQueue.top();
+		m_dirtyQueue.pop();
+		m_dirtyNodes[index] = 0;
+
+		const Node& node = m_nodes[index];
+		if (node.parent == NO_PARENT) {
+			continue;
+		}
+		BoundingBox bounds	= GetNodeBounds(node);
+		BoundingBox old		= GetChildBounds(m_nodes[node.parent], node.parentSlot);
+		//Nothing above needs to change if a move stayed within this node's old bounds
+		if (bounds.min.x == old.min.x && bounds.min.y == old.min.y && bounds.min.z == old.min.z &&
+			bounds.max.x == old.max.x && bounds.max.y == old.max.y && bounds.max.z == old.max.z) {
+			continue;
+		}
+		SetChildBounds(m_nodes[node.parent], node.parentSlot, bounds);
+		MarkDirty(node.parent);
+	}
+}
+
+void CullingBVH::MarkDirty(uint32_t node) {
+	if (!m_dirtyNodes[node]) {
+		m_dirtyNodes[node] = 1;
+		m_dirtyQueue.push(node);
+	}
+}
+
+void CullingBVH::Cull(const Vector4 planes[6], std::vector<uint32_t>& visible) const {
+	if (m_nodes.empty()) {
+		return;
+	}
+	//The corner of a box furthest along a plane's normal is the same for every box,
+	//so each plane's rows are chosen once here rather than per node
+	PlaneTest tests[6];
+	for (int p = 0; p < 6; ++p) {
+		const Vector4& plane = planes[p];
+		for (int i = 0; i < 4; ++i) {
+			tests[p].x[i] = plane.x;
+			tests[p].y[i] = plane.y;
+			tests[p].z[i] = plane.z;
+			tests[p].w[i] = plane.w;
+		}
+		for (int axis = 0; axis < 3; ++axis) {
+			bool positive = plane[axis] >= 0.0f;
+			tests[p].positiveRows[axis] = positive ? axis + 3 : axis;
+			tests[p].negativeRows[axis] = positive ? axis : axis + 3;
+		}
+	}
+
+	struct StackEntry {
+		uint32_t node;
+		uint32_t planeMask;	//Planes the node isn't already known to be inside of
+	};
+	std::vector<StackEntry> stack;
+	stack.push_back({ 0, 0x3F });
+
+	while (!stack.empty()) {
+		StackEntry entry = stack.back();
+		stack.pop_back();
+		const Node& node = m_nodes[entry.node];
+
+		int			outside = 0;
+		uint32_t	childPlanes[4] = { entry.planeMask, entry.planeMask, entry.planeMask, entry.planeMask };
+
+		for (int p = 0; p < 6; ++p) {
+			if (!(entry.planeMask & (1 << p))) {
+				continue;
+			}
+			outside |= BehindPlane(node.bounds, tests[p], tests[p].positiveRows);
+			int inside = ~BehindPlane(node.bounds, tests[p], tests[p].negativeRows);
+			for (int c = 0; c < 4; ++c) {
+				if (inside & (1 << c)) {
+					childPlanes[c] &= ~(1u << p);
+				}
+			}
+		}
+
+		for (int c = 0; c < 4; ++c) {
+			uint32_t child = node.children[c];
+			if ((outside & (1 << c)) || child == EMPTY_CHILD) {
+				continue;
+			}
+			if (child & LEAF_FLAG) {
+				visible.push_back(child & ~LEAF_FLAG);
+			}
+			else if (childPlanes[c] == 0) {
+				AddSubtree(child, visible);
+			}
+			else {
+				stack.push_back({ child, childPlanes[c] });
+			}
+		}
+	}
+}
+
+void CullingBVH::AddSubtree(uint32_t node, std::vector<uint32_t>& visible) const {
+	std::vector<uint32_t> stack = { node };
+	while (!stack.empty()) {
+		const Node& n = m_nodes[stack.back()];
+		stack.pop_back();
+		for (uint32_t child : n.children) {
+			if (child == EMPTY_CHILD) {
+				continue;
+			}
+			if (child & LEAF_FLAG) {
+				visible.push_back(child & ~LEAF_FLAG);
+			}
+			else {
+				stack.push_back(child);
+			}
+		}
+	}
+}
+
+void CullingBVH::SetChildBounds(Node& node, uint32_t slot, const BoundingBox& box) {
+	for (int axis = 0; axis < 3; ++axis) {
+		node.bounds[axis][slot]		= box.min[axis];
+		node.bounds[axis + 3][slot]	= box.max[axis];
+	}
+}
+
+BoundingBox CullingBVH::GetChildBounds(const Node& node, uint32_t slot) {
+	BoundingBox box;
+	for (int axis = 0; axis < 3; ++axis) {
+		box.min[axis] = node.bounds[axis][slot];
+		box.max[axis] = node.bounds[axis + 3][slot];
+	}
+	return box;
+}
+
+//Empty slots have inverted bounds, so they never affect the result
+BoundingBox CullingBVH::GetNodeBounds(const Node& node) {
+	BoundingBox box;
+	for (int axis = 0; axis < 3; ++axis) {
+		const float* mins = node.bounds[axis];
+		const float* maxs = node.bounds[axis + 3];
+		box.min[axis] = std::min(std::min(mins[0], mins[1]), std::min(mins[2], mins[3]));
+		box.max[axis] = std::max(std::max(maxs[0], maxs[1]), std::max(maxs[2], maxs[3]));
+	}
+	return box;
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <queue>
+#include <span>
+
+namespace NCL::Rendering::Vulkan {
+	struct BoundingBox {
+		Maths::Vector3 min;
+		Maths::Vector3 max;
+	};
+
+	/*
+	A 4 wide bounding volume hierarchy over a set of boxes, such as the world
+	space bounds of RenderObjects, for culling them against a view frustum on
+	the CPU. Each node stores the boxes of its four children side by side, so
+	all four are tested against a plane at once with SSE. Children found to be
+	entirely inside a plane skip it for the rest of their subtree.
+
+	Boxes that move are updated in place, and Refit then fixes up the nodes
+	above them, without changing the shape of the tree. The tree gets looser
+	as things move away from where it was built, so Build it again after large
+	changes, and whenever boxes are added or removed.
+	*/
+	class CullingBVH {
+	public:
+		void Build(std::span<const BoundingBox> boxes);
+
+		void UpdateBox(uint32_t index, const BoundingBox& box);
+		//Refits the nodes above every box updated since the last Refit or Build
+		void Refit();
+
+		//Appends the index of every box touching the frustum, whose planes point inwards
+		//as IndirectDrawGenerator::ExtractFrustumPlanes gives them. Boxes are only tested
+		//against the planes, so some near the frustum's corners may be included too.
+		void Cull(const Maths::Vector4 planes[6], std::vector<uint32_t>& visible) const;
+
+		uint32_t GetBoxCount() const {
+			return (uint32_t)m_boxLocations.size();
+		}
+
+		uint32_t GetNodeCount() const {
+			return (uint32_t)m_nodes.size();
+		}
+
+	protected:
+		static const uint32_t LEAF_FLAG		= 0x80000000;
+		static const uint32_t EMPTY_CHILD	= ~0u;
+		static const uint32_t NO_PARENT		= ~0u;
+
+		//Each bounds row holds one component of all four children, so it loads as one register
+		struct alignas(16) Node {
+			float		bounds[6][4];	//minX, minY, minZ, maxX, maxY, maxZ
+			uint32_t	children[4];	//A node index, a box index | LEAF_FLAG, or EMPTY_CHILD
+			uint32_t	parent;
+			uint32_t	parentSlot;
+		};
+
+		uint32_t	BuildNode(std::span<uint32_t> items, const std::vector<Maths::Vector3>& centres, std::span<const BoundingBox> boxes, uint32_t parent, uint32_t parentSlot);
+
+		static void			SetChildBounds(Node& node, uint32_t slot, const BoundingBox& box);
+		static BoundingBox	GetChildBounds(const Node& node, uint32_t slot);
+		static BoundingBox	GetNodeBounds(const Node& node);
+
+		void	AddSubtree(uint32_t node, std::vector<uint32_t>& visible) const;
+		void	MarkDirty(uint32_t node);
+
+		std::vector<Node>		m_nodes;
+		std::vector<uint32_t>	m_boxLocations;	//Node index << 2 | slot
+
+		//Children always come after their parents, so popping the highest index first
+		//refits every node after all of its dirty children
+		std::priority_queue<uint32_t>	m_dirtyQueue;
+		std::vector<uint8_t>			m_dirtyNodes;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "FrameAllocator.h"
+
+#include "../VKQuick/MemoryManager.h"
+#include "../VKQuick/Utils.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+//The largest minUniformBufferOffsetAlignment and minStorageBufferOffsetAlignment the spec allows,
+//so allocations suit any device without asking it
+const vk::DeviceSize ALLOCATION_ALIGNMENT = 256;
+
+static vk::UniqueDescriptorSetLayout CreateDynamicLayout(vk::Device device, vk::DescriptorType type) {
+	vk::DescriptorSetLayoutBinding binding{
+		.binding			= 0,
+		.descriptorType		= type,
+		.descriptorCount	= 1,
+		.stageFlags			= vk::ShaderStageFlagBits::eAll
+	};
+	return device.createDescriptorSetLayoutUnique({ .bindingCount = 1, .pBindings = &binding });
+}
+
+FrameAllocator::FrameAllocator(vk::Device device, vk::DescriptorPool pool, VKQuick::MemoryManager& memManager, uint32_t framesInFlight,
+	vk::DeviceSize frameSize, vk::DeviceSize uniformRange)
+	: m_memoryManager(memManager)
+{
+	m_frameSize = (frameSize + ALLOCATION_ALIGNMENT - 1) & ~(ALLOCATION_ALIGNMENT - 1);
+
+	//Shaders can read a whole uniformRange from the last allocation of the last frame, so that much is spare at the end
+	m_buffer = memManager.CreateBuffer(
+		{
+			.size	= m_frameSize * framesInFlight + uniformRange,
+			.usage	= vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer
+		},
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		"Frame Allocator Buffer"
+	);
+	m_data = m_buffer.Map<char>();
+
+	m_uniformLayout = CreateDynamicLayout(device, vk::DescriptorType::eUniformBufferDynamic);
+	m_storageLayout = CreateDynamicLayout(device, vk::DescriptorType::eStorageBufferDynamic);
+
+	m_uniformSet = VKQuick::CreateDescriptorSet(device, pool, *m_uniformLayout);
+	m_storageSet = VKQuick::CreateDescriptorSet(device, pool, *m_storageLayout);
+
+	//A whole size dynamic range runs from the dynamic offset to the end of the buffer
+	vk::DescriptorBufferInfo uniformInfo{ .buffer = m_buffer.buffer, .offset = 0, .range = uniformRange };
+	vk::DescriptorBufferInfo storageInfo{ .buffer = m_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE };
+
+	vk::WriteDescriptorSet writes[] = {
+		{
+			.dstSet				= *m_uniformSet,
+			.dstBinding			= 0,
+			.descriptorCount	= 1,
+			.descriptorType		= vk::DescriptorType::eUniformBufferDynamic,
+			.pBufferInfo		= &uniformInfo
+		},
+		{
+			.dstSet				= *m_storageSet,
+			.dstBinding			= 0,
+			.descriptorCount	= 1,
+			.descriptorType		= vk::DescriptorType::eStorageBufferDynamic,
+			.pBufferInfo		= &storageInfo
+		}
+	};
+	device.updateDescriptorSets(writes, {});
+}
+
+FrameAllocator::~FrameAllocator() {
+	m_buffer.Unmap();
+	m_memoryManager.DiscardBuffer(m_buffer, VKQuick::DiscardMode::Immediate);
+}
+
+void FrameAllocator::BeginFrame(uint32_t frameIndex) {
+	m_frameStart	= m_frameSize * frameIndex;
+	m_used			= 0;
+}
+
+FrameAllocator::Allocation FrameAllocator::Allocate(vk::DeviceSize size) {
+	vk::DeviceSize alignedSize	= (size + ALLOCATION_ALIGNMENT - 1) & ~(ALLOCATION_ALIGNMENT - 1);
+	vk::DeviceSize start		= m_used.fetch_add(alignedSize);
+	//Running out means frameSize is too small for what is being drawn
+	assert(start + alignedSize <= m_frameSize);
+
+	vk::DeviceSize offset = m_frameStart + start;
+	return { m_data + offset, (uint32_t)offset, size };
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "../VKQuick/Buffer.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace VKQuick {
+	class MemoryManager;
+}
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	Hands out space for data that only lives for a single frame, such as the
+	camera matrices, from one persistently mapped buffer. Each frame in flight
+	has its own region of the buffer, which is emptied by BeginFrame, so
+	nothing is overwritten while the GPU could still be reading it.
+
+	Allocations don't get descriptor sets of their own. Every allocation is
+	bound through the same set, with its offset as the set's dynamic offset.
+	The uniform set has a dynamic uniform buffer at binding 0, which shaders
+	see uniformRange bytes of. The storage set has a dynamic storage buffer at
+	binding 0, which shaders see the rest of the buffer through.
+
+	Allocate can be called from any thread.
+	*/
+	class FrameAllocator {
+	public:
+		struct Allocation {
+			void*			data	= nullptr;
+			uint32_t		offset	= 0;	//The dynamic offset to bind it with
+			vk::DeviceSize	size	= 0;
+		};
+
+		//frameSize must cover everything allocated in a frame.
+		//uniformRange must cover the largest uniform block read from an allocation.
+		FrameAllocator(vk::Device device, vk::DescriptorPool pool, VKQuick::MemoryManager& memManager, uint32_t framesInFlight,
+			vk::DeviceSize frameSize = 4 * 1024 * 1024, vk::DeviceSize uniformRange = 16 * 1024);
+		~FrameAllocator();
+
+		//Call once the frame's previous use has completed, such as with the FrameContext's cycleID
+		void BeginFrame(uint32_t frameIndex);
+
+		Allocation Allocate(vk::DeviceSize size);
+
+		//Allocates space for data, and copies it in
+		template<typename T>
+		Allocation Upload(const T& data) {
+			Allocation a = Allocate(sizeof(T));
+			memcpy(a.data, &data, sizeof(T));
+			return a;
+		}
+
+		vk::DescriptorSet GetUniformSet() const {
+			return *m_uniformSet;
+		}
+
+		vk::DescriptorSetLayout GetUniformLayout() const {
+			return *m_uniformLayout;
+		}
+
+		vk::DescriptorSet GetStorageSet() const {
+			return *m_storageSet;
+		}
+
+		vk::DescriptorSetLayout GetStorageLayout() const {
+			return *m_storageLayout;
+		}
+
+		//Bytes allocated so far this frame, including alignment padding
+		vk::DeviceSize GetFrameUsage() const {
+			return m_used;
+		}
+
+	protected:
+		VKQuick::MemoryManager&	m_memoryManager;
+
+		VKQuick::Buffer	m_buffer;
+		char*			m_data;
+
+		vk::UniqueDescriptorSetLayout	m_uniformLayout;
+		vk::UniqueDescriptorSetLayout	m_storageLayout;
+		vk::UniqueDescriptorSet			m_uniformSet;
+		vk::UniqueDescriptorSet			m_storageSet;
+
+		vk::DeviceSize	m_frameSize;
+		vk::DeviceSize	m_frameStart = 0;
+
+		std::atomic<vk::DeviceSize>	m_used = 0;
+	};
+}
\ No newline at end of file
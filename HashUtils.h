@@ -0,0 +1,29 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+	const uint64_t FNV_PRIME		= 1099511628211ull;
+
+	//64 bit FNV-1a. Pass a previous result as the seed to hash data in several pieces.
+	inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = FNV_OFFSET_BASIS) {
+		const uint8_t* bytes = (const uint8_t*)data;
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	template<typename T>
+	uint64_t HashValue(const T& value, uint64_t seed = FNV_OFFSET_BASIS) {
+		return HashBytes(&value, sizeof(T), seed);
+	}
+}
\ No newline at end of file
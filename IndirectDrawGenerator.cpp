@@ -0,0 +1,297 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "IndirectDrawGenerator.h"
+#include "BindlessManager.h"
+#include "MappedFile.h"
+#include "ShaderModuleCache.h"
+
+#include "../VKQuick/DescriptorSetLayoutBuilder.h"
+#include "../VKQuick/MemoryManager.h"
+#include "../VKQuick/Utils.h"
+
+#include "./Shaders/VK/GLSLInterop.h"
+
+#define BINDLESS_SET 1
+#include "./Shaders/VK/VKQuick/bindless.glslh"
+
+#include <algorithm>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+//Must match local_size_x in DrawGeneration.comp
+const uint32_t GENERATION_GROUP_SIZE = 64;
+
+//Written out term by term in the same order as DrawGeneration.comp, which marks them precise,
+//so that both sides round identically. Only adds, multiplies and compares are used, as they
+//are the operations Vulkan requires to be correctly rounded. This file is built with floating
+//point contraction off, so the compiler can't fuse them into FMAs either.
+static bool SphereOutsideFrustum(const Matrix4& m, const Vector4& sphere, const Vector4* planes) {
+	if (sphere.w < 0.0f) {
+		return false;
+	}
+	const auto& a = m.array;
+	float cx = a[0][0] * sphere.x + a[1][0] * sphere.y + a[2][0] * sphere.z + a[3][0];
+	float cy = a[0][1] * sphere.x + a[1][1] * sphere.y + a[2][1] * sphere.z + a[3][1];
+	float cz = a[0][2] * sphere.x + a[1][2] * sphere.y + a[2][2] * sphere.z + a[3][2];
+
+	//Squared radius, scaled by the largest axis scale
+	float s0 = a[0][0] * a[0][0] + a[0][1] * a[0][1] + a[0][2] * a[0][2];
+	float s1 = a[1][0] * a[1][0] + a[1][1] * a[1][1] + a[1][2] * a[1][2];
+	float s2 = a[2][0] * a[2][0] + a[2][1] * a[2][1] + a[2][2] * a[2][2];
+	float r2 = sphere.w * sphere.w * std::max(std::max(s0, s1), s2);
+
+	//Planes aren't normalised, so compare squared distances scaled by the squared normal length
+	for (int i = 0; i < 6; ++i) {
+		const Vector4& p = planes[i];
+		float d		= p.x * cx + p.y * cy + p.z * cz + p.w;
+		float n2	= p.x * p.x + p.y * p.y + p.z * p.z;
+		if (d < 0.0f && d * d > r2 * n2) {
+			return true;
+		}
+	}
+	return false;
+}
+
+IndirectDrawGenerator::IndirectDrawGenerator(vk::Device device, vk::DescriptorPool pool, VKQuick::MemoryManager& memManager, VKQuick::BindlessManager& bindless,
+	uint32_t framesInFlight, uint32_t maxInstances, uint32_t maxDraws, const std::string& shaderFile,
+	ShaderModuleCache* shaders, vk::PipelineCache pipelineCache)
+	: m_device(device), m_memoryManager(memManager), m_bindless(bindless), m_maxInstances(maxInstances), m_maxDraws(maxDraws)
+{
+	//The generator binds its own descriptor set alongside the bindless ones, which descriptor buffers can't be mixed with
+	assert(!bindless.UsesDescriptorBuffer());
+
+	m_layout = VKQuick::DescriptorSetLayoutBuilder(device)
+		.WithStorageBuffers(0, 1)	//Instances
+		.WithStorageBuffers(1, 1)	//Draw commands
+		.WithStorageBuffers(2, 1)	//DrawInfos
+		.WithStorageBuffers(3, 1)	//Draw count
+		.Build("Indirect Draw Generation");
+
+	//The outputs can be copied back, such as to compare them against GenerateReference
+	m_frames.resize(framesInFlight);
+	for (FrameResources& f : m_frames) {
+		f.instances = memManager.CreateBuffer(
+			{
+				.size	= sizeof(DrawInstance) * maxInstances,
+				.usage	= vk::BufferUsageFlagBits::eStorageBuffer
+			},
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			"Indirect Draw Instances"
+		);
+		f.instanceData = f.instances.Map<DrawInstance>();
+
+		f.commands = memManager.CreateBuffer(
+			{
+				.size	= sizeof(vk::DrawIndexedIndirectCommand) * maxDraws,
+				.usage	= vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc
+			},
+			vk::MemoryPropertyFlagBits::eDeviceLocal,
+			"Indirect Draw Commands"
+		);
+
+		f.drawInfos = memManager.CreateBuffer(
+			{
+				.size	= sizeof(DrawInfo) * maxDraws,
+				.usage	= vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc
+			},
+			vk::MemoryPropertyFlagBits::eDeviceLocal,
+			"Indirect Draw Infos"
+		);
+
+		f.drawCount = memManager.CreateBuffer(
+			{
+				.size	= sizeof(uint32_t),
+				.usage	= vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc
+			},
+			vk::MemoryPropertyFlagBits::eDeviceLocal,
+			"Indirect Draw Count"
+		);
+
+		f.descriptorSet = VKQuick::CreateDescriptorSet(device, pool, *m_layout);
+		VKQuick::WriteBufferDescriptor(device, *f.descriptorSet, 0, vk::DescriptorType::eStorageBuffer, f.instances);
+		VKQuick::WriteBufferDescriptor(device, *f.descriptorSet, 1, vk::DescriptorType::eStorageBuffer, f.commands);
+		VKQuick::WriteBufferDescriptor(device, *f.descriptorSet, 2, vk::DescriptorType::eStorageBuffer, f.drawInfos);
+		VKQuick::WriteBufferDescriptor(device, *f.descriptorSet, 3, vk::DescriptorType::eStorageBuffer, f.drawCount);
+	}
+
+	vk::UniqueShaderModule	ownShader;
+	vk::ShaderModule		shader;
+	if (shaders) {
+		shader = shaders->Get(shaderFile);
+	}
+	else {
+		MappedFile spirv(Assets::SHADERDIR + "VK/" + shaderFile);
+		assert(spirv.IsValid());
+
+		ownShader = device.createShaderModuleUnique({
+			.codeSize	= spirv.GetSize(),
+			.pCode		= (const uint32_t*)spirv.GetData()
+		});
+		shader = *ownShader;
+	}
+	assert(shader);
+
+	vk::PushConstantRange constantRange{
+		.stageFlags = vk::ShaderStageFlagBits::eCompute,
+		.offset		= 0,
+		.size		= sizeof(DrawGenerationConstants)
+	};
+	vk::DescriptorSetLayout setLayouts[] = {
+		bindless.GetDescriptorSetLayout(),
+		bindless.GetGeometryDescriptorSetLayout(),
+		*m_layout
+	};
+	m_pipelineLayout = device.createPipelineLayoutUnique({
+		.setLayoutCount			= (uint32_t)std::size(setLayouts),
+		.pSetLayouts			= setLayouts,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges	= &constantRange
+	});
+
+	m_pipeline = device.createComputePipelineUnique(pipelineCache, {
+		.stage = {
+			.stage	= vk::ShaderStageFlagBits::eCompute,
+			.module = shader,
+			.pName	= "main"
+		},
+		.layout = *m_pipelineLayout
+	}).value;
+}
+
+IndirectDrawGenerator::~IndirectDrawGenerator() {
+	for (FrameResources& f : m_frames) {
+		f.instances.Unmap();
+		m_memoryManager.DiscardBuffer(f.instances, VKQuick::DiscardMode::Immediate);
+		m_memoryManager.DiscardBuffer(f.commands, VKQuick::DiscardMode::Immediate);
+		m_memoryManager.DiscardBuffer(f.drawInfos, VKQuick::DiscardMode::Immediate);
+		m_memoryManager.DiscardBuffer(f.drawCount, VKQuick::DiscardMode::Immediate);
+	}
+}
+
+void IndirectDrawGenerator::SetInstances(std::span<const DrawInstance> instances) {
+	assert(instances.size() <= m_maxInstances);
+
+	m_currentFrame	= (m_currentFrame + 1) % (uint32_t)m_frames.size();
+	m_instanceCount = (uint32_t)std::min<size_t>(instances.size(), m_maxInstances);
+
+	memcpy(m_frames[m_currentFrame].instanceData, instances.data(), m_instanceCount * sizeof(DrawInstance));
+}
+
+void IndirectDrawGenerator::RecordGeneration(vk::CommandBuffer cmdBuffer, const Matrix4& viewProj) {
+	FrameResources& f = m_frames[m_currentFrame];
+
+	cmdBuffer.fillBuffer(f.drawCount.buffer, 0, sizeof(uint32_t), 0);
+
+	vk::MemoryBarrier2 clearBarrier{
+		.srcStageMask	= vk::PipelineStageFlagBits2::eTransfer,
+		.srcAccessMask	= vk::AccessFlagBits2::eTransferWrite,
+		.dstStageMask	= vk::PipelineStageFlagBits2::eComputeShader,
+		.dstAccessMask	= vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite
+	};
+	cmdBuffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &clearBarrier });
+
+	DrawGenerationConstants constants;
+	ExtractFrustumPlanes(viewProj, constants.frustumPlanes);
+	constants.instanceCount = m_instanceCount;
+	constants.maxDraws		= m_maxDraws;
+
+	vk::DescriptorSet sets[] = {
+		m_bindless.GetDescriptorSet(),
+		m_bindless.GetGeometryDescriptorSet(),
+		*f.descriptorSet
+	};
+	cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *m_pipeline);
+	cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *m_pipelineLayout, 0, (uint32_t)std::size(sets), sets, 0, nullptr);
+	cmdBuffer.pushConstants(*m_pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+	cmdBuffer.dispatch((m_instanceCount + GENERATION_GROUP_SIZE - 1) / GENERATION_GROUP_SIZE, 1, 1);
+
+	vk::MemoryBarrier2 drawBarrier{
+		.srcStageMask	= vk::PipelineStageFlagBits2::eComputeShader,
+		.srcAccessMask	= vk::AccessFlagBits2::eShaderStorageWrite,
+		.dstStageMask	= vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader,
+		.dstAccessMask	= vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eShaderStorageRead
+	};
+	cmdBuffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &drawBarrier });
+}
+
+void IndirectDrawGenerator::RecordDraw(vk::CommandBuffer cmdBuffer) {
+	FrameResources& f = m_frames[m_currentFrame];
+	cmdBuffer.drawIndexedIndirectCount(f.commands.buffer, 0, f.drawCount.buffer, 0, m_maxDraws, sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+void IndirectDrawGenerator::ExtractFrustumPlanes(const Matrix4& viewProj, Vector4 planes[6]) {
+	auto row = [&](int r) {
+		return Vector4(viewProj.array[0][r], viewProj.array[1][r], viewProj.array[2][r], viewProj.array[3][r]);
+	};
+	Vector4 x = row(0);
+	Vector4 y = row(1);
+	Vector4 z = row(2);
+	Vector4 w = row(3);
+
+	planes[0] = w + x;
+	planes[1] = w - x;
+	planes[2] = w + y;
+	planes[3] = w - y;
+	planes[4] = w + z; //OpenGL style near plane, which is never tighter than Vulkan's z >= 0
+	planes[5] = w - z;
+}
+
+void IndirectDrawGenerator::GenerateReference(const VKQuick::BindlessManager& bindless, std::span<const DrawInstance> instances, const Matrix4& viewProj,
+	uint32_t maxDraws, std::vector<vk::DrawIndexedIndirectCommand>& commands, std::vector<DrawInfo>& drawInfos) {
+	Vector4 planes[6];
+	ExtractFrustumPlanes(viewProj, planes);
+
+	const MeshEntry*				meshes		= bindless.GetMeshEntries();
+	const MeshLayerEntry*			layers		= bindless.GetMeshLayers();
+	const VKQuick::MeshLODRange*	lodRanges	= bindless.GetMeshLODRanges();
+	const VKQuick::MeshLODEntry*	lods		= bindless.GetMeshLODs();
+	const Vector4*					bounds		= bindless.GetLayerBounds();
+
+	commands.clear();
+	drawInfos.clear();
+
+	for (uint32_t i = 0; i < instances.size(); ++i) {
+		const DrawInstance& instance = instances[i];
+		if (SphereOutsideFrustum(instance.transform, instance.boundingSphere, planes)) {
+			continue;
+		}
+		const MeshEntry& mesh = meshes[instance.meshIndex];
+
+		uint32_t firstLayer = mesh.firstSubMeshIndex;
+		uint32_t layerCount = mesh.subMeshCount;
+
+		const VKQuick::MeshLODRange& lodRange = lodRanges[instance.meshIndex];
+		if (lodRange.lodCount > 0) {
+			uint32_t lod = std::min(instance.lod, lodRange.lodCount - 1);
+			firstLayer = lods[lodRange.firstLOD + lod].firstSubMeshIndex;
+			layerCount = mesh.subMeshCount / lodRange.lodCount;
+		}
+
+		for (uint32_t l = firstLayer; l < firstLayer + layerCount; ++l) {
+			if (SphereOutsideFrustum(instance.transform, bounds[l], planes)) {
+				continue;
+			}
+			//As the shader does, once every slot is taken nothing more is written
+			if (commands.size() >= maxDraws) {
+				return;
+			}
+			const MeshLayerEntry& layer = layers[l];
+			commands.push_back({
+				.indexCount		= layer.elementCount,
+				.instanceCount	= 1,
+				.firstIndex		= mesh.indexBufferOffset / (uint32_t)sizeof(uint32_t) + layer.firstElement,
+				.vertexOffset	= (int32_t)layer.base,
+				.firstInstance	= i
+			});
+			drawInfos.push_back({ i, l });
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "../VKQuick/Buffer.h"
+
+#include <span>
+
+namespace VKQuick {
+	class BindlessManager;
+	class MemoryManager;
+}
+
+namespace NCL::Rendering::Vulkan {
+	class ShaderModuleCache;
+
+	//Must match DrawGeneration.comp
+	struct DrawInstance {
+		Maths::Matrix4	transform;
+		Maths::Vector4	boundingSphere;	//Model space, xyz = centre, w = radius. Negative radii are never culled
+		uint32_t		meshIndex;		//Index of a BindlessManager mesh handle
+		uint32_t		lod;			//Clamped to the mesh's LOD count, ignored if it has none
+		uint32_t		padding[2];
+	};
+
+	//Written alongside each draw command, and indexed by gl_DrawID
+	struct DrawInfo {
+		uint32_t instanceIndex;
+		uint32_t layerIndex;	//Into the MeshLayerEntry table
+	};
+
+	struct DrawGenerationConstants {
+		Maths::Vector4	frustumPlanes[6];
+		uint32_t		instanceCount;
+		uint32_t		maxDraws;
+	};
+
+	/*
+	Turns a buffer of instances into indexed indirect draws, one for each
+	layer of each instance's mesh, using the mesh tables of a BindlessManager.
+	Instances and layers outside the view frustum are culled on the GPU, and
+	everything left is drawn by a single drawIndexedIndirectCount.
+
+	Commands index the MeshEntry's index buffer offset directly, so every
+	mesh drawn at once must share the bound index buffer, as the meshes of
+	a VulkanMeshArena do. firstInstance is the instance index.
+
+	Each frame: SetInstances, then RecordGeneration after the BindlessManager's
+	RecordUpdates, then RecordDraw inside the rendering pass.
+	*/
+	class IndirectDrawGenerator {
+	public:
+		IndirectDrawGenerator(vk::Device device, vk::DescriptorPool pool, VKQuick::MemoryManager& memManager, VKQuick::BindlessManager& bindless,
+			uint32_t framesInFlight, uint32_t maxInstances, uint32_t maxDraws, const std::string& shaderFile = "DrawGeneration.comp.spv",
+			ShaderModuleCache* shaders = nullptr, vk::PipelineCache pipelineCache = {});
+		~IndirectDrawGenerator();
+
+		//Moves on to the next frame's buffers, and fills its instances
+		void SetInstances(std::span<const DrawInstance> instances);
+
+		void RecordGeneration(vk::CommandBuffer cmdBuffer, const Maths::Matrix4& viewProj);
+		void RecordDraw(vk::CommandBuffer cmdBuffer);
+
+		//Instances at binding 0 and DrawInfos at binding 2, for vertex shaders to read
+		vk::DescriptorSet GetDescriptorSet() const {
+			return *m_frames[m_currentFrame].descriptorSet;
+		}
+
+		vk::DescriptorSetLayout GetDescriptorSetLayout() const {
+			return *m_layout;
+		}
+
+		//Planes point inwards, and aren't normalised
+		static void ExtractFrustumPlanes(const Maths::Matrix4& viewProj, Maths::Vector4 planes[6]);
+
+		//Bit-exact CPU version of the compute pass. Draws come out in instance then layer order,
+		//while the GPU's order changes from run to run, so sort its output by DrawInfo to compare them.
+		//Both stop at maxDraws, but which draws the GPU keeps then depends on its order too.
+		static void GenerateReference(const VKQuick::BindlessManager& bindless, std::span<const DrawInstance> instances, const Maths::Matrix4& viewProj,
+			uint32_t maxDraws, std::vector<vk::DrawIndexedIndirectCommand>& commands, std::vector<DrawInfo>& drawInfos);
+
+	protected:
+		struct FrameResources {
+			VKQuick::Buffer			instances;
+			VKQuick::Buffer			commands;
+			VKQuick::Buffer			drawInfos;
+			VKQuick::Buffer			drawCount;
+			DrawInstance*			instanceData = nullptr;
+			vk::UniqueDescriptorSet	descriptorSet;
+		};
+
+		vk::Device					m_device;
+		VKQuick::MemoryManager&		m_memoryManager;
+		VKQuick::BindlessManager&	m_bindless;
+
+		vk::UniqueDescriptorSetLayout	m_layout;
+		vk::UniquePipelineLayout		m_pipelineLayout;
+		vk::UniquePipeline				m_pipeline;
+
+		std::vector<FrameResources>	m_frames;
+
+		uint32_t	m_currentFrame	= 0;
+		uint32_t	m_instanceCount = 0;
+		uint32_t	m_maxInstances;
+		uint32_t	m_maxDraws;
+	};
+}
\ No newline at end of file
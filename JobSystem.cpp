@@ -0,0 +1,131 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "JobSystem.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+//Which system and queue the current thread works for, if any
+static thread_local JobSystem*	t_jobSystem		= nullptr;
+static thread_local uint32_t	t_workerIndex	= 0;
+
+JobSystem::JobSystem(uint32_t threadCount) {
+	if (threadCount == 0) {
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+	for (uint32_t i = 0; i < threadCount; ++i) {
+		m_queues.push_back(std::make_unique<WorkerQueue>());
+	}
+	for (uint32_t i = 0; i < threadCount; ++i) {
+		m_threads.emplace_back([this, i]() { WorkerLoop(i); });
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard lock(m_sleepMutex);
+		m_running = false;
+	}
+	m_wake.notify_all();
+	for (std::thread& t : m_threads) {
+		t.join();
+	}
+}
+
+JobHandle JobSystem::Submit(Job job) {
+	auto remaining = std::make_shared<std::atomic<uint32_t>>(1);
+	Push({ std::move(job), remaining });
+	return JobHandle(remaining);
+}
+
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job) {
+	if (count == 0) {
+		return;
+	}
+	auto remaining = std::make_shared<std::atomic<uint32_t>>(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Push({ [&job, i]() { job(i); }, remaining });
+	}
+	Wait(JobHandle(remaining));
+}
+
+void JobSystem::Wait(const JobHandle& handle) {
+	while (!handle.IsComplete()) {
+		if (!TryRunJob()) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::Push(QueuedJob&& job) {
+	//Workers keep their own jobs local, everyone else spreads them out
+	uint32_t index = (t_jobSystem == this) ? t_workerIndex : m_nextQueue++ % (uint32_t)m_queues.size();
+	{
+		std::lock_guard lock(m_queues[index]->mutex);
+		m_queues[index]->jobs.push_back(std::move(job));
+	}
+	m_queuedJobs++;
+	{
+		std::lock_guard lock(m_sleepMutex);	//So a worker can't miss the wake up between checking and sleeping
+	}
+	m_wake.notify_one();
+}
+
+bool JobSystem::TryRunJob() {
+	QueuedJob job;
+	bool found = false;
+
+	uint32_t queueCount = (uint32_t)m_queues.size();
+	uint32_t home		= (t_jobSystem == this) ? t_workerIndex : 0;
+
+	//Newest job from our own queue, as it's the most likely to still be in cache
+	if (t_jobSystem == this) {
+		WorkerQueue& queue = *m_queues[home];
+		std::lock_guard lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			found = true;
+		}
+	}
+	//Otherwise the oldest job from anyone else's
+	for (uint32_t i = 0; i < queueCount && !found; ++i) {
+		WorkerQueue& queue = *m_queues[(home + i) % queueCount];
+		std::lock_guard lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			found = true;
+		}
+	}
+	if (!found) {
+		return false;
+	}
+	m_queuedJobs--;
+	job.job();
+	job.remaining->fetch_sub(1, std::memory_order_acq_rel);
+	return true;
+}
+
+void JobSystem::WorkerLoop(uint32_t index) {
+	t_jobSystem		= this;
+	t_workerIndex	= index;
+
+	while (true) {
+		if (TryRunJob()) {
+			continue;
+		}
+		std::unique_lock lock(m_sleepMutex);
+		m_wake.wait(lock, [&]() { return !m_running || m_queuedJobs > 0; });
+		if (!m_running) {
+			break;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace NCL::Rendering::Vulkan {
+	//Completes once every job submitted against it has run
+	class JobHandle {
+	public:
+		JobHandle() = default;
+
+		bool IsComplete() const {
+			return !m_remaining || m_remaining->load(std::memory_order_acquire) == 0;
+		}
+
+	protected:
+		friend class JobSystem;
+		JobHandle(std::shared_ptr<std::atomic<uint32_t>> remaining) : m_remaining(remaining) {
+		}
+
+		std::shared_ptr<std::atomic<uint32_t>> m_remaining;
+	};
+
+	/*
+	Each worker thread has its own deque of jobs, taking new work from the
+	back and stealing from the front of the others' when it runs dry. Threads
+	waiting on a JobHandle run jobs too, rather than sleeping, so jobs may
+	safely wait on other jobs.
+	*/
+	class JobSystem {
+	public:
+		using Job = std::function<void()>;
+
+		//0 uses one thread for each hardware thread, less one for the caller
+		JobSystem(uint32_t threadCount = 0);
+		~JobSystem();
+
+		JobHandle Submit(Job job);
+
+		//Calls job(i) for every i in [0, count), and returns once they've all finished
+		void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+
+		void Wait(const JobHandle& handle);
+
+		uint32_t GetThreadCount() const {
+			return (uint32_t)m_threads.size();
+		}
+
+	protected:
+		struct QueuedJob {
+			Job										job;
+			std::shared_ptr<std::atomic<uint32_t>>	remaining;
+		};
+
+		struct WorkerQueue {
+			std::mutex				mutex;
+			std::deque<QueuedJob>	jobs;
+		};
+
+		void Push(QueuedJob&& job);
+		bool TryRunJob();
+		void WorkerLoop(uint32_t index);
+
+		std::vector<std::unique_ptr<WorkerQueue>>	m_queues;
+		std::vector<std::thread>					m_threads;
+
+		std::atomic<bool>		m_running		= true;
+		std::atomic<uint32_t>	m_queuedJobs	= 0;
+		std::atomic<uint32_t>	m_nextQueue		= 0;
+
+		std::mutex				m_sleepMutex;
+		std::condition_variable	m_wake;
+	};
+}
\ No newline at end of file
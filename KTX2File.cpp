@@ -0,0 +1,255 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "KTX2File.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <filesystem>
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+//Keys must be stored in sorted order
+const std::string WRITER_KEY		= "KTXwriter";
+const std::string WRITER_NAME		= "NCL VulkanRendering";
+const std::string SOURCE_HASH_KEY	= "NCLsourceHash";
+
+const size_t LEVEL_ALIGNMENT = 16;
+
+//Qualifier in the top bits of a DFD sample's channel, for samples not encoded with the descriptor's transfer function
+const uint32_t DFD_SAMPLE_LINEAR = 0x10;
+
+struct KTX2Header {
+	uint8_t		identifier[12];
+	uint32_t	vkFormat;
+	uint32_t	typeSize;
+	uint32_t	pixelWidth;
+	uint32_t	pixelHeight;
+	uint32_t	pixelDepth;
+	uint32_t	layerCount;
+	uint32_t	faceCount;
+	uint32_t	levelCount;
+	uint32_t	supercompressionScheme;
+	uint32_t	dfdByteOffset;
+	uint32_t	dfdByteLength;
+	uint32_t	kvdByteOffset;
+	uint32_t	kvdByteLength;
+	uint64_t	sgdByteOffset;
+	uint64_t	sgdByteLength;
+};
+static_assert(sizeof(KTX2Header) == 80);
+
+struct KTX2Level {
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+struct DFDSample {
+	uint32_t channel;
+	uint32_t bitOffset;
+	uint32_t bitLength;
+};
+
+//Data format descriptor for the block formats that TextureCompressor produces, or empty for anything else
+static std::vector<uint32_t> BuildDFD(vk::Format format, uint32_t& blockBytes) {
+	uint32_t				model	= 0;
+	bool					srgb	= false;
+	std::vector<DFDSample>	samples;
+
+	switch (format) {
+		case vk::Format::eBc1RgbaSrgbBlock: srgb = true; [[fallthrough]];
+		case vk::Format::eBc1RgbaUnormBlock:
+			model = 128; blockBytes = 8;
+			samples = { {1, 0, 64} };
+			break;
+		case vk::Format::eBc3SrgbBlock: srgb = true; [[fallthrough]];
+		case vk::Format::eBc3UnormBlock:
+			model = 130; blockBytes = 16;
+			//Alpha is always linear, even in sRGB textures
+			samples = { {srgb ? 15 | DFD_SAMPLE_LINEAR : 15, 0, 64}, {0, 64, 64} };
+			break;
+		case vk::Format::eBc5UnormBlock:
+			model = 132; blockBytes = 16;
+			samples = { {0, 0, 64}, {1, 64, 64} };
+			break;
+		case vk::Format::eBc7SrgbBlock: srgb = true; [[fallthrough]];
+		case vk::Format::eBc7UnormBlock:
+			model = 134; blockBytes = 16;
+			samples = { {0, 0, 128} };
+			break;
+		default:
+			return {};
+	}
+	uint32_t blockSize = 24 + 16 * (uint32_t)samples.size();
+
+	std::vector<uint32_t> dfd = {
+		4 + blockSize,
+		0,								//Khronos basic descriptor block
+		2 | (blockSize << 16),			//Version 2
+		model | (1 << 8) | ((srgb ? 2u : 1u) << 16),	//BT.709 primaries, linear or sRGB transfer
+		3 | (3 << 8),					//4x4 texel blocks
+		blockBytes,
+		0
+	};
+	for (const DFDSample& s : samples) {
+		dfd.push_back(s.bitOffset | ((s.bitLength - 1) << 16) | (s.channel << 24));
+		dfd.push_back(0);
+		dfd.push_back(0);
+		dfd.push_back(0xFFFFFFFF);
+	}
+	return dfd;
+}
+
+static void AddKeyValue(std::vector<char>& kvd, const std::string& key, const void* value, size_t valueSize) {
+	uint32_t length = (uint32_t)(key.size() + 1 + valueSize);
+	kvd.insert(kvd.end(), (const char*)&length, (const char*)&length + 4);
+	kvd.insert(kvd.end(), key.c_str(), key.c_str() + key.size() + 1);
+	kvd.insert(kvd.end(), (const char*)value, (const char*)value + valueSize);
+	kvd.resize((kvd.size() + 3) & ~3ull);
+}
+
+bool KTX2File::Save(const std::string& filename, const CompressedTexture& texture, uint64_t sourceHash) {
+	uint32_t blockBytes = 0;
+	std::vector<uint32_t> dfd = BuildDFD(texture.format, blockBytes);
+	if (dfd.empty() || texture.levels.empty()) {
+		return false;
+	}
+	std::vector<char> kvd;
+	AddKeyValue(kvd, WRITER_KEY		, WRITER_NAME.c_str(), WRITER_NAME.size() + 1);
+	AddKeyValue(kvd, SOURCE_HASH_KEY, &sourceHash, sizeof(sourceHash));
+
+	KTX2Header header = {
+		.vkFormat		= (uint32_t)texture.format,
+		.typeSize		= 1,
+		.pixelWidth		= texture.width,
+		.pixelHeight	= texture.height,
+		.faceCount		= 1,
+		.levelCount		= (uint32_t)texture.levels.size(),
+	};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+
+	header.dfdByteOffset = (uint32_t)(sizeof(KTX2Header) + texture.levels.size() * sizeof(KTX2Level));
+	header.dfdByteLength = (uint32_t)(dfd.size() * sizeof(uint32_t));
+	header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+	header.kvdByteLength = (uint32_t)kvd.size();
+
+	//Level data is stored smallest mip first
+	std::vector<KTX2Level> levels(texture.levels.size());
+	size_t offset = header.kvdByteOffset + header.kvdByteLength;
+	for (size_t i = levels.size(); i-- > 0;) {
+		offset = (offset + LEVEL_ALIGNMENT - 1) & ~(LEVEL_ALIGNMENT - 1);
+		levels[i] = { offset, texture.levels[i].size, texture.levels[i].size };
+		offset += texture.levels[i].size;
+	}
+
+	//Written under a temporary name, so a half written file is never picked up as a valid cache
+	std::string tempName = filename + ".tmp";
+	bool		written = false;
+	{
+		std::ofstream file(tempName, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)levels.data(), levels.size() * sizeof(KTX2Level));
+		file.write((const char*)dfd.data(), dfd.size() * sizeof(uint32_t));
+		file.write(kvd.data(), kvd.size());
+
+		const char padding[LEVEL_ALIGNMENT] = {};
+		size_t end = header.kvdByteOffset + header.kvdByteLength;
+		for (size_t i = levels.size(); i-- > 0;) {
+			file.write(padding, levels[i].byteOffset - end);
+			file.write(texture.data.data() + texture.levels[i].offset, texture.levels[i].size);
+			end = levels[i].byteOffset + levels[i].byteLength;
+		}
+		written = file.good();
+	}
+	std::error_code error;
+	if (written) {
+		std::filesystem::rename(tempName, filename, error);
+	}
+	//Anything left under the temporary name is unusable, so shouldn't pile up next to the source
+	if (!written || error) {
+		std::error_code removeError;
+		std::filesystem::remove(tempName, removeError);
+		return false;
+	}
+	return true;
+}
+
+bool KTX2File::Load(const std::string& filename, CompressedTexture& texture, uint64_t sourceHash) {
+	MappedFile file(filename);
+	if (!file.IsValid() || file.GetSize() < sizeof(KTX2Header)) {
+		return false;
+	}
+	const char* data = file.GetData();
+
+	KTX2Header header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0 ||
+		header.supercompressionScheme != 0 || header.faceCount != 1 || header.layerCount > 1 || header.pixelDepth > 1 || header.levelCount == 0) {
+		return false;
+	}
+	uint32_t blockBytes = 0;
+	if (BuildDFD((vk::Format)header.vkFormat, blockBytes).empty()) {
+		return false;
+	}
+	if (sizeof(KTX2Header) + header.levelCount * sizeof(KTX2Level) > file.GetSize() ||
+		(uint64_t)header.kvdByteOffset + header.kvdByteLength > file.GetSize()) {
+		return false;
+	}
+
+	uint64_t	storedHash	= 0;
+	const char* kvd			= data + header.kvdByteOffset;
+	const char* kvdEnd		= kvd + header.kvdByteLength;
+	while (kvd + 4 <= kvdEnd) {
+		uint32_t length;
+		memcpy(&length, kvd, 4);
+		const char* key = kvd + 4;
+		if (key + length > kvdEnd) {
+			break;
+		}
+		if (length == SOURCE_HASH_KEY.size() + 1 + sizeof(uint64_t) && memcmp(key, SOURCE_HASH_KEY.c_str(), SOURCE_HASH_KEY.size() + 1) == 0) {
+			memcpy(&storedHash, key + SOURCE_HASH_KEY.size() + 1, sizeof(uint64_t));
+		}
+		kvd = key + ((length + 3) & ~3u);
+	}
+	if (storedHash != sourceHash) {
+		return false;
+	}
+
+	std::vector<KTX2Level> levels(header.levelCount);
+	memcpy(levels.data(), data + sizeof(KTX2Header), levels.size() * sizeof(KTX2Level));
+
+	texture.format	= (vk::Format)header.vkFormat;
+	texture.width	= header.pixelWidth;
+	texture.height	= header.pixelHeight;
+	texture.levels.clear();
+	texture.data.clear();
+
+	for (uint32_t i = 0; i < header.levelCount; ++i) {
+		uint32_t width	= std::max(1u, header.pixelWidth >> i);
+		uint32_t height = std::max(1u, header.pixelHeight >> i);
+		size_t	 size	= (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+		if (levels[i].byteLength != size || levels[i].byteOffset + size > file.GetSize()) {
+			return false;
+		}
+		texture.levels.push_back({
+			.offset = texture.data.size(),
+			.size	= size,
+			.width	= width,
+			.height = height
+		});
+		texture.data.insert(texture.data.end(), data + levels[i].byteOffset, data + levels[i].byteOffset + size);
+	}
+	return true;
+}
\ No newline at end of file
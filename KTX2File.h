@@ -0,0 +1,24 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "TextureCompressor.h"
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	Reads and writes single image, block compressed KTX2 files, without any
+	supercompression. The hash of the source image is stored as a key/value
+	entry, so a cached file that is out of date can be detected and rebuilt.
+	*/
+	class KTX2File {
+	public:
+		static bool Save(const std::string& filename, const CompressedTexture& texture, uint64_t sourceHash);
+
+		//Fails if the file is missing, unreadable, or was made from a different source
+		static bool Load(const std::string& filename, CompressedTexture& texture, uint64_t sourceHash);
+	};
+}
\ No newline at end of file
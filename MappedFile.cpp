@@ -0,0 +1,79 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "MappedFile.h"
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+#ifdef WIN32
+MappedFile::MappedFile(const std::string& filename) {
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return;
+	}
+	m_data		= (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	m_size		= m_data ? (size_t)size.QuadPart : 0;
+	m_file		= file;
+	m_mapping	= mapping;
+}
+
+MappedFile::~MappedFile() {
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping) {
+		CloseHandle((HANDLE)m_mapping);
+	}
+	if (m_file) {
+		CloseHandle((HANDLE)m_file);
+	}
+}
+#else
+MappedFile::MappedFile(const std::string& filename) {
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0) {
+		return;
+	}
+	struct stat info;
+	if (fstat(file, &info) == 0 && info.st_size > 0) {
+		void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (data != MAP_FAILED) {
+			m_data = (const char*)data;
+			m_size = (size_t)info.st_size;
+		}
+	}
+	close(file); //The mapping keeps the file alive
+}
+
+MappedFile::~MappedFile() {
+	if (m_data) {
+		munmap((void*)m_data, m_size);
+	}
+}
+#endif
\ No newline at end of file
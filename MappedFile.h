@@ -0,0 +1,41 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	//Read only view of a whole file, mapped into memory by the OS rather than read into a buffer
+	class MappedFile {
+	public:
+		MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool IsValid() const {
+			return m_data != nullptr;
+		}
+
+		const char* GetData() const {
+			return m_data;
+		}
+
+		size_t GetSize() const {
+			return m_size;
+		}
+
+	protected:
+		const char* m_data = nullptr;
+		size_t		m_size = 0;
+
+#ifdef WIN32
+		void*		m_file		= nullptr;
+		void*		m_mapping	= nullptr;
+#endif
+	};
+}
\ No newline at end of file
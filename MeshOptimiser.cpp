@@ -0,0 +1,274 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "MeshOptimiser.h"
+#include <algorithm>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+const uint32_t	MAX_CACHE_SIZE		= 32;
+const float		CACHE_DECAY_POWER	= 1.5f;
+const float		LAST_TRI_SCORE		= 0.75f;
+const float		VALENCE_BOOST_SCALE	= 2.0f;
+const float		VALENCE_BOOST_POWER	= 0.5f;
+
+static float VertexScore(int cachePosition, uint32_t remainingTris, uint32_t cacheSize) {
+	if (remainingTris == 0) {
+		return -1.0f; //Vertex has no triangles left to draw, so we don't care about it
+	}
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			//Used by the last triangle, so fixed score to stop it just being reused in a strip
+			score = LAST_TRI_SCORE;
+		}
+		else {
+			float scaler = 1.0f / (cacheSize - 3);
+			score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+	//Boost vertices with few triangles left, so we don't leave lone triangles behind
+	score += VALENCE_BOOST_SCALE * powf((float)remainingTris, -VALENCE_BOOST_POWER);
+	return score;
+}
+
+void MeshOptimiser::OptimiseVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+	cacheSize = cacheSize > MAX_CACHE_SIZE ? MAX_CACHE_SIZE : (cacheSize < 4 ? 4 : cacheSize);
+
+	size_t triCount = indexCount / 3;
+	if (triCount == 0) {
+		return;
+	}
+	//Build up the list of triangles each vertex is used by
+	std::vector<uint32_t> triOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < triCount * 3; ++i) {
+		triOffsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		triOffsets[v + 1] += triOffsets[v];
+	}
+	std::vector<uint32_t> vertexTris(triCount * 3);
+	std::vector<uint32_t> remainingTris(vertexCount, 0);
+	for (uint32_t t = 0; t < triCount; ++t) {
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = indices[t * 3 + k];
+			vertexTris[triOffsets[v] + remainingTris[v]++] = t;
+		}
+	}
+
+	std::vector<int>	cachePos(vertexCount, -1);
+	std::vector<float>	vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		vertexScores[v] = VertexScore(-1, remainingTris[v], cacheSize);
+	}
+
+	std::vector<float>	triScores(triCount);
+	std::vector<bool>	emitted(triCount, false);
+
+	int64_t bestTri		= -1;
+	float	bestScore	= -1.0f;
+	for (size_t t = 0; t < triCount; ++t) {
+		triScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+		if (triScores[t] > bestScore) {
+			bestScore	= triScores[t];
+			bestTri		= t;
+		}
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(triCount * 3);
+
+	uint32_t cache[MAX_CACHE_SIZE + 3];
+	uint32_t cacheCount = 0;
+	size_t	 scanPos	= 0;
+
+	for (size_t drawn = 0; drawn < triCount; ++drawn) {
+		if (bestTri < 0) {
+			//Nothing in the cache touches an unused triangle, so just take the next one
+			while (emitted[scanPos]) {
+				scanPos++;
+			}
+			bestTri = scanPos;
+		}
+		uint32_t* tri = &indices[bestTri * 3];
+		emitted[bestTri] = true;
+		output.insert(output.end(), tri, tri + 3);
+
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v			= tri[k];
+			uint32_t* list		= &vertexTris[triOffsets[v]];
+			uint32_t& count		= remainingTris[v];
+			for (uint32_t j = 0; j < count; ++j) {
+				if (list[j] == bestTri) {
+					list[j] = list[count - 1];
+					break;
+				}
+			}
+			count--;
+		}
+
+		//The triangle's vertices go to the front of the cache, pushing everything else back
+		uint32_t newCache[MAX_CACHE_SIZE + 3];
+		uint32_t newCount = 0;
+		for (int k = 0; k < 3; ++k) {
+			if (std::find(newCache, newCache + newCount, tri[k]) == newCache + newCount) {
+				newCache[newCount++] = tri[k];
+			}
+		}
+		for (uint32_t i = 0; i < cacheCount; ++i) {
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2]) {
+				newCache[newCount++] = cache[i];
+			}
+		}
+		for (uint32_t i = 0; i < newCount; ++i) {
+			uint32_t v		= newCache[i];
+			cachePos[v]		= i < cacheSize ? (int)i : -1;
+			vertexScores[v] = VertexScore(cachePos[v], remainingTris[v], cacheSize);
+		}
+
+		bestTri		= -1;
+		bestScore	= -1.0f;
+		for (uint32_t i = 0; i < newCount; ++i) {
+			uint32_t v = newCache[i];
+			for (uint32_t j = 0; j < remainingTris[v]; ++j) {
+				uint32_t t	= vertexTris[triOffsets[v] + j];
+				float score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				triScores[t] = score;
+				if (score > bestScore) {
+					bestScore	= score;
+					bestTri		= t;
+				}
+			}
+		}
+		cacheCount = newCount < cacheSize ? newCount : cacheSize;
+		memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+	}
+	memcpy(indices, output.data(), triCount * 3 * sizeof(uint32_t));
+}
+
+void MeshOptimiser::OptimiseOverdraw(uint32_t* indices, size_t indexCount, const Vector3* positions, size_t vertexCount, uint32_t cacheSize) {
+	size_t triCount = indexCount / 3;
+	if (triCount < 2) {
+		return;
+	}
+	//Any triangle that misses on all 3 vertices starts a new cluster, as reordering there costs nothing
+	std::vector<uint32_t> clusterStarts;
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+
+	for (uint32_t t = 0; t < triCount; ++t) {
+		int misses = 0;
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = indices[t * 3 + k];
+			if (time - timestamps[v] > cacheSize) {
+				timestamps[v] = time++;
+				misses++;
+			}
+		}
+		if (t == 0 || misses == 3) {
+			clusterStarts.push_back(t);
+		}
+	}
+	if (clusterStarts.size() < 2) {
+		return;
+	}
+	clusterStarts.push_back((uint32_t)triCount);
+
+	struct Cluster {
+		uint32_t	start;
+		uint32_t	end;
+		Vector3		centroid;
+		Vector3		normal;
+		float		area;
+		float		sortKey;
+	};
+	std::vector<Cluster> clusters;
+
+	Vector3 meshCentroid;
+	float	meshArea = 0.0f;
+
+	for (size_t c = 0; c + 1 < clusterStarts.size(); ++c) {
+		Cluster cluster{ clusterStarts[c], clusterStarts[c + 1], Vector3(), Vector3(), 0.0f, 0.0f };
+
+		for (uint32_t t = cluster.start; t < cluster.end; ++t) {
+			const Vector3& a = positions[indices[t * 3]];
+			const Vector3& b = positions[indices[t * 3 + 1]];
+			const Vector3& d = positions[indices[t * 3 + 2]];
+
+			Vector3 normal	= Vector::Cross(b - a, d - a);
+			float area		= Vector::Length(normal);
+
+			cluster.centroid	= cluster.centroid + (a + b + d) * (area / 3.0f);
+			cluster.normal		= cluster.normal + normal;
+			cluster.area		+= area;
+		}
+		meshCentroid	= meshCentroid + cluster.centroid;
+		meshArea		+= cluster.area;
+
+		if (cluster.area > 0.0f) {
+			cluster.centroid = cluster.centroid * (1.0f / cluster.area);
+		}
+		clusters.push_back(cluster);
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid = meshCentroid * (1.0f / meshArea);
+	}
+	//Clusters facing away from the middle of the mesh are likely to occlude the rest of it
+	for (Cluster& c : clusters) {
+		float normalLength = Vector::Length(c.normal);
+		c.sortKey = normalLength > 0.0f ? Vector::Dot(c.centroid - meshCentroid, c.normal) / normalLength : 0.0f;
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(triCount * 3);
+	for (const Cluster& c : clusters) {
+		output.insert(output.end(), indices + c.start * 3, indices + c.end * 3);
+	}
+	memcpy(indices, output.data(), triCount * 3 * sizeof(uint32_t));
+}
+
+void MeshOptimiser::BuildFetchRemap(const uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& remap) {
+	const uint32_t unused = ~0u;
+	remap.assign(vertexCount, unused);
+
+	uint32_t next = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		if (remap[indices[i]] == unused) {
+			remap[indices[i]] = next++;
+		}
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		if (remap[v] == unused) {
+			remap[v] = next++;
+		}
+	}
+}
+
+float MeshOptimiser::CalculateACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize) {
+	size_t triCount = indexCount / 3;
+	if (triCount == 0) {
+		return 0.0f;
+	}
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time	= cacheSize + 1;
+	size_t misses	= 0;
+
+	for (size_t i = 0; i < triCount * 3; ++i) {
+		uint32_t v = indices[i];
+		if (time - timestamps[v] > cacheSize) {
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+	return (float)misses / (float)triCount;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	CPU-side index reordering for triangle lists. All functions work on a single
+	index range whose values are in [0, vertexCount), so each SubMesh can be
+	processed relative to its own base vertex.
+	*/
+	class MeshOptimiser {
+	public:
+		//Forsyth's linear-speed vertex cache optimisation
+		static void OptimiseVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+		//Splits the (already cache optimised) triangles into clusters at cache flush points,
+		//then sorts them so outward facing clusters are drawn first
+		static void OptimiseOverdraw(uint32_t* indices, size_t indexCount, const Maths::Vector3* positions, size_t vertexCount, uint32_t cacheSize = 16);
+
+		//Fills remap with the new position of each vertex, in order of first use. Unused vertices go last.
+		static void BuildFetchRemap(const uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>& remap);
+
+		//Average number of FIFO cache misses per triangle
+		static float CalculateACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,266 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+//Symmetric 4x4 matrix of summed plane equations, plus the total area they came from
+struct Quadric {
+	float a2 = 0.0f, b2 = 0.0f, c2 = 0.0f, d2 = 0.0f;
+	float ab = 0.0f, ac = 0.0f, ad = 0.0f;
+	float bc = 0.0f, bd = 0.0f, cd = 0.0f;
+	float weight = 0.0f;
+
+	void AddPlane(const Vector3& n, float d, float w) {
+		a2 += n.x * n.x * w;	b2 += n.y * n.y * w;	c2 += n.z * n.z * w;	d2 += d * d * w;
+		ab += n.x * n.y * w;	ac += n.x * n.z * w;	ad += n.x * d * w;
+		bc += n.y * n.z * w;	bd += n.y * d * w;		cd += n.z * d * w;
+		weight += w;
+	}
+
+	void Add(const Quadric& q) {
+		a2 += q.a2; b2 += q.b2; c2 += q.c2; d2 += q.d2;
+		ab += q.ab; ac += q.ac; ad += q.ad;
+		bc += q.bc; bd += q.bd; cd += q.cd;
+		weight += q.weight;
+	}
+
+	//Area weighted mean of the squared distances from p to each plane
+	float Error(const Vector3& p) const {
+		float e = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z
+			+ 2.0f * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+			+ 2.0f * (ad * p.x + bd * p.y + cd * p.z) + d2;
+		return weight > 0.0f ? std::max(e, 0.0f) / weight : 0.0f;
+	}
+};
+
+struct Collapse {
+	uint32_t	from;
+	uint32_t	to;
+	float		cost;
+};
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b) {
+	return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+size_t MeshSimplifier::Simplify(uint32_t* dst, const uint32_t* indices, size_t indexCount, const Vector3* positions, size_t vertexCount,
+	size_t targetIndexCount, float maxError, float& resultError) {
+	resultError = 0.0f;
+
+	std::vector<uint32_t> tris(indices, indices + (indexCount / 3) * 3);
+
+	//Weld together vertices with identical positions, so UV seams don't split the surface apart
+	std::vector<uint32_t> order(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; ++v) {
+		order[v] = v;
+	}
+	auto lessPos = [&](uint32_t a, uint32_t b) {
+		const Vector3& pa = positions[a];
+		const Vector3& pb = positions[b];
+		if (pa.x != pb.x) return pa.x < pb.x;
+		if (pa.y != pb.y) return pa.y < pb.y;
+		if (pa.z != pb.z) return pa.z < pb.z;
+		return a < b;
+	};
+	std::sort(order.begin(), order.end(), lessPos);
+
+	std::vector<uint32_t> weld(vertexCount);
+	std::vector<uint32_t> originalCount(vertexCount, 0);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		uint32_t v = order[i];
+		bool samePos = i > 0 && positions[order[i - 1]].x == positions[v].x && positions[order[i - 1]].y == positions[v].y && positions[order[i - 1]].z == positions[v].z;
+		weld[v] = samePos ? weld[order[i - 1]] : v;
+		originalCount[weld[v]]++;
+	}
+
+	//Border and non-manifold edges are used by anything other than 2 triangles
+	std::unordered_map<uint64_t, uint32_t> edgeUse;
+	for (size_t i = 0; i < tris.size(); i += 3) {
+		for (int k = 0; k < 3; ++k) {
+			edgeUse[EdgeKey(weld[tris[i + k]], weld[tris[i + (k + 1) % 3]])]++;
+		}
+	}
+	std::vector<bool> locked(vertexCount, false);
+	for (const auto& [edge, count] : edgeUse) {
+		if (count != 2) {
+			locked[(uint32_t)(edge >> 32)]			= true;
+			locked[(uint32_t)(edge & 0xFFFFFFFF)]	= true;
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < tris.size(); i += 3) {
+		const Vector3& p0 = positions[tris[i]];
+		const Vector3& p1 = positions[tris[i + 1]];
+		const Vector3& p2 = positions[tris[i + 2]];
+
+		Vector3 normal	= Vector::Cross(p1 - p0, p2 - p0);
+		float	area	= Vector::Length(normal);
+		if (area == 0.0f) {
+			continue;
+		}
+		normal = normal * (1.0f / area);
+		float d = -Vector::Dot(normal, p0);
+		for (int k = 0; k < 3; ++k) {
+			quadrics[weld[tris[i + k]]].AddPlane(normal, d, area);
+		}
+	}
+
+	//Only vertices with a single set of attributes can be moved or collapsed onto,
+	//as otherwise we couldn't tell which of the originals each corner should now use
+	auto canMove = [&](uint32_t w) {
+		return !locked[w] && originalCount[w] == 1;
+	};
+	auto canTarget = [&](uint32_t w) {
+		return originalCount[w] == 1;
+	};
+
+	const float maxCost		= maxError * maxError;
+	float		maxUsedCost = 0.0f;
+
+	size_t triCount		= tris.size() / 3;
+	size_t targetTris	= targetIndexCount / 3;
+
+	std::vector<uint32_t>	triOffsets(vertexCount + 1);
+	std::vector<uint32_t>	vertexTris;
+	std::vector<uint32_t>	collapseTo(vertexCount);
+	std::vector<bool>		touched(vertexCount);
+	std::vector<Collapse>	collapses;
+
+	while (triCount > targetTris) {
+		//Triangles using each welded vertex
+		std::fill(triOffsets.begin(), triOffsets.end(), 0);
+		for (uint32_t i : tris) {
+			triOffsets[weld[i] + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; ++v) {
+			triOffsets[v + 1] += triOffsets[v];
+		}
+		vertexTris.resize(tris.size());
+		std::vector<uint32_t> fill(triOffsets.begin(), triOffsets.end() - 1);
+		for (uint32_t i = 0; i < tris.size(); ++i) {
+			vertexTris[fill[weld[tris[i]]]++] = i / 3;
+		}
+
+		//Cheapest direction to collapse each edge
+		collapses.clear();
+		for (size_t i = 0; i < tris.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				uint32_t a = weld[tris[i + k]];
+				uint32_t b = weld[tris[i + (k + 1) % 3]];
+				if (a > b && edgeUse.count(EdgeKey(a, b)) && edgeUse[EdgeKey(a, b)] == 2) {
+					continue; //Interior edges are seen twice, only keep one of them
+				}
+				Quadric q = quadrics[a];
+				q.Add(quadrics[b]);
+
+				Collapse c{ 0, 0, FLT_MAX };
+				if (canMove(a) && canTarget(b)) {
+					c = { a, b, q.Error(positions[b]) };
+				}
+				if (canMove(b) && canTarget(a)) {
+					float cost = q.Error(positions[a]);
+					if (cost < c.cost) {
+						c = { b, a, cost };
+					}
+				}
+				if (c.cost <= maxCost) {
+					collapses.push_back(c);
+				}
+			}
+		}
+		if (collapses.empty()) {
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {return a.cost < b.cost; });
+
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			collapseTo[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		size_t removedTris	= 0;
+		size_t applied		= 0;
+		for (const Collapse& c : collapses) {
+			if (triCount - removedTris <= targetTris) {
+				break;
+			}
+			if (touched[c.from] || touched[c.to]) {
+				continue;
+			}
+			//Don't allow any of the triangles that survive the collapse to flip over
+			bool flips		= false;
+			size_t removes	= 0;
+			for (uint32_t j = triOffsets[c.from]; j < triOffsets[c.from + 1] && !flips; ++j) {
+				const uint32_t* tri = &tris[vertexTris[j] * 3];
+				uint32_t w[3] = { weld[tri[0]], weld[tri[1]], weld[tri[2]] };
+				if (w[0] == c.to || w[1] == c.to || w[2] == c.to) {
+					removes++;
+					continue;
+				}
+				Vector3 before[3];
+				Vector3 after[3];
+				for (int k = 0; k < 3; ++k) {
+					before[k]	= positions[w[k]];
+					after[k]	= w[k] == c.from ? positions[c.to] : before[k];
+				}
+				Vector3 n0 = Vector::Cross(before[1] - before[0], before[2] - before[0]);
+				Vector3 n1 = Vector::Cross(after[1] - after[0], after[2] - after[0]);
+				flips = Vector::Dot(n0, n1) <= 0.0f;
+			}
+			if (flips) {
+				continue;
+			}
+			collapseTo[c.from] = c.to;
+			quadrics[c.to].Add(quadrics[c.from]);
+			maxUsedCost = std::max(maxUsedCost, c.cost);
+
+			//Everything around the collapse has changed shape, so leave it until the next pass
+			for (uint32_t j = triOffsets[c.from]; j < triOffsets[c.from + 1]; ++j) {
+				const uint32_t* tri = &tris[vertexTris[j] * 3];
+				for (int k = 0; k < 3; ++k) {
+					touched[weld[tri[k]]] = true;
+				}
+			}
+			removedTris += removes;
+			applied++;
+		}
+		if (applied == 0) {
+			break;
+		}
+
+		//Move the collapsed vertices over to their targets, and throw away any triangles that have become degenerate
+		size_t out = 0;
+		for (size_t i = 0; i < tris.size(); i += 3) {
+			uint32_t t[3];
+			for (int k = 0; k < 3; ++k) {
+				uint32_t w = collapseTo[weld[tris[i + k]]];
+				t[k] = (w != weld[tris[i + k]]) ? w : tris[i + k]; //Targets only have one original vertex, which is the welded index
+			}
+			if (weld[t[0]] == weld[t[1]] || weld[t[1]] == weld[t[2]] || weld[t[0]] == weld[t[2]]) {
+				continue;
+			}
+			tris[out++] = t[0];
+			tris[out++] = t[1];
+			tris[out++] = t[2];
+		}
+		tris.resize(out);
+		triCount = out / 3;
+	}
+
+	resultError = sqrtf(maxUsedCost);
+	memcpy(dst, tris.data(), tris.size() * sizeof(uint32_t));
+	return tris.size();
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	Quadric error edge collapse for triangle lists. Vertices are only ever
+	collapsed onto other existing vertices, so the simplified indices can
+	share the vertex data of the original mesh. Vertices sharing a position
+	are treated as one, and vertices on open borders or attribute seams are
+	never moved, so the outline and UV layout of the mesh is preserved.
+	*/
+	class MeshSimplifier {
+	public:
+		//Writes up to indexCount indices to dst, returning how many were written.
+		//resultError is the largest distance moved from the original surface, in the units of positions.
+		static size_t Simplify(uint32_t* dst, const uint32_t* indices, size_t indexCount, const Maths::Vector3* positions, size_t vertexCount,
+			size_t targetIndexCount, float maxError, float& resultError);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,161 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+//Cutoff value that can never pass the cone test
+const float NO_CONE_CULLING = 2.0f;
+
+void MeshletBuilder::BuildMeshlets(MeshletData& data, const uint32_t* indices, size_t indexCount, uint32_t baseVertex, const Vector3* positions, uint32_t maxVertices, uint32_t maxTriangles) {
+	assert(maxVertices > 2 && maxVertices < 256 && maxTriangles > 0);
+
+	MeshletRange range{ (uint32_t)data.meshlets.size(), 0 };
+
+	uint32_t maxIndex = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		maxIndex = indices[i] > maxIndex ? indices[i] : maxIndex;
+	}
+	const uint8_t notPresent = 0xFF;
+	std::vector<uint8_t> localIndex(maxIndex + 1, notPresent);
+
+	MeshletEntry meshlet = {};
+	meshlet.vertexOffset	= (uint32_t)data.vertices.size();
+	meshlet.triangleOffset	= (uint32_t)data.triangles.size();
+
+	auto finishMeshlet = [&]() {
+		ComputeBounds(data, meshlet, positions);
+		data.meshlets.push_back(meshlet);
+		range.meshletCount++;
+
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+			localIndex[data.vertices[meshlet.vertexOffset + i] - baseVertex] = notPresent;
+		}
+		meshlet = {};
+		meshlet.vertexOffset	= (uint32_t)data.vertices.size();
+		meshlet.triangleOffset	= (uint32_t)data.triangles.size();
+	};
+
+	for (size_t t = 0; t + 2 < indexCount; t += 3) {
+		const uint32_t* tri = &indices[t];
+
+		uint32_t newVertices = 0;
+		for (int k = 0; k < 3; ++k) {
+			bool repeated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+			if (localIndex[tri[k]] == notPresent && !repeated) {
+				newVertices++;
+			}
+		}
+		if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount + 1 > maxTriangles) {
+			finishMeshlet();
+		}
+
+		uint32_t packed = 0;
+		for (int k = 0; k < 3; ++k) {
+			if (localIndex[tri[k]] == notPresent) {
+				localIndex[tri[k]] = (uint8_t)meshlet.vertexCount++;
+				data.vertices.push_back(tri[k] + baseVertex);
+			}
+			packed |= (uint32_t)localIndex[tri[k]] << (k * 8);
+		}
+		data.triangles.push_back(packed);
+		meshlet.triangleCount++;
+	}
+	if (meshlet.triangleCount > 0) {
+		finishMeshlet();
+	}
+	data.subMeshRanges.push_back(range);
+}
+
+void MeshletBuilder::ComputeBounds(MeshletData& data, MeshletEntry& meshlet, const Vector3* positions) {
+	const uint32_t* vertices = &data.vertices[meshlet.vertexOffset];
+
+	//Ritter's bounding sphere - start from the two most distant points we can quickly find
+	auto furthestFrom = [&](const Vector3& p) {
+		Vector3 furthest	= p;
+		float	distance	= -1.0f;
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+			float d = Vector::LengthSquared(positions[vertices[i]] - p);
+			if (d > distance) {
+				distance = d;
+				furthest = positions[vertices[i]];
+			}
+		}
+		return furthest;
+	};
+	Vector3 a = furthestFrom(positions[vertices[0]]);
+	Vector3 b = furthestFrom(a);
+
+	Vector3 centre	= (a + b) * 0.5f;
+	float	radius	= Vector::Length(b - a) * 0.5f;
+
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+		const Vector3& p = positions[vertices[i]];
+		float d = Vector::Length(p - centre);
+		if (d > radius) {
+			float newRadius = (radius + d) * 0.5f;
+			centre = centre + (p - centre) * ((newRadius - radius) / d);
+			radius = newRadius;
+		}
+	}
+	meshlet.boundingSphere = Vector4(centre, radius);
+
+	//Normal cone, from the average of the triangle normals
+	std::vector<Vector3> normals;
+	std::vector<Vector3> corners;
+	Vector3 axis;
+	for (uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+		uint32_t packed = data.triangles[meshlet.triangleOffset + t];
+		const Vector3& p0 = positions[vertices[packed & 0xFF]];
+		const Vector3& p1 = positions[vertices[(packed >> 8) & 0xFF]];
+		const Vector3& p2 = positions[vertices[(packed >> 16) & 0xFF]];
+
+		Vector3 normal = Vector::Cross(p1 - p0, p2 - p0);
+		float	length = Vector::Length(normal);
+		if (length == 0.0f) {
+			continue; //Degenerate triangles can't be backfacing
+		}
+		normal = normal * (1.0f / length);
+		normals.push_back(normal);
+		corners.push_back(p0);
+		axis = axis + normal;
+	}
+
+	meshlet.coneApex = Vector4(centre, 0.0f);
+	meshlet.coneAxis = Vector4(0, 0, 0, NO_CONE_CULLING);
+
+	float axisLength = Vector::Length(axis);
+	if (normals.empty() || axisLength == 0.0f) {
+		return;
+	}
+	axis = axis * (1.0f / axisLength);
+
+	float minDot = 1.0f;
+	for (const Vector3& n : normals) {
+		minDot = std::min(minDot, Vector::Dot(axis, n));
+	}
+	if (minDot <= 0.1f) {
+		//Normals are spread over too wide an angle for the cone to ever reject the meshlet
+		meshlet.coneAxis = Vector4(axis, NO_CONE_CULLING);
+		return;
+	}
+	//Move the apex back along the axis until it is behind every triangle's plane
+	float maxT = 0.0f;
+	for (size_t i = 0; i < normals.size(); ++i) {
+		float dc = Vector::Dot(centre - corners[i], normals[i]);
+		float dn = Vector::Dot(axis, normals[i]);
+		maxT = std::max(maxT, dc / dn);
+	}
+	meshlet.coneApex = Vector4(centre - axis * maxT, 0.0f);
+	meshlet.coneAxis = Vector4(axis, sqrtf(1.0f - minDot * minDot));
+}
\ No newline at end of file
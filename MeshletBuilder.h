@@ -0,0 +1,52 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	Matches the std430 layout of the meshlet table read by shaders.
+	A meshlet can be skipped if it is outside the frustum, or if
+	dot(normalize(coneApex - cameraPos), coneAxis) >= coneCutoff,
+	in which case every triangle in it is backfacing.
+	*/
+	struct MeshletEntry {
+		Maths::Vector4	boundingSphere;	//xyz = centre, w = radius
+		Maths::Vector4	coneApex;		//xyz = apex
+		Maths::Vector4	coneAxis;		//xyz = axis, w = cutoff
+		uint32_t		vertexOffset;	//Into the meshlet vertex table
+		uint32_t		triangleOffset;	//Into the meshlet triangle table
+		uint32_t		vertexCount;
+		uint32_t		triangleCount;
+	};
+
+	//The meshlets generated from a single SubMesh
+	struct MeshletRange {
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+	};
+
+	struct MeshletData {
+		std::vector<MeshletEntry>	meshlets;
+		std::vector<uint32_t>		vertices;		//Mesh vertex indices, with the SubMesh base already added
+		std::vector<uint32_t>		triangles;		//3 meshlet-local 8 bit indices packed per triangle
+		std::vector<MeshletRange>	subMeshRanges;
+	};
+
+	class MeshletBuilder {
+	public:
+		static const uint32_t MAX_VERTICES	= 64;
+		static const uint32_t MAX_TRIANGLES = 124;
+
+		//Appends the meshlets for a single triangle list range, and its entry in subMeshRanges
+		static void BuildMeshlets(MeshletData& data, const uint32_t* indices, size_t indexCount, uint32_t baseVertex, const Maths::Vector3* positions,
+			uint32_t maxVertices = MAX_VERTICES, uint32_t maxTriangles = MAX_TRIANGLES);
+
+	protected:
+		static void ComputeBounds(MeshletData& data, MeshletEntry& meshlet, const Maths::Vector3* positions);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,343 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "VulkanMesh.h"
+
+#include <algorithm>
+#include <cfloat>
+
+//SSE2 is always there on x64, anything else falls back to writing one pixel at a time
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+const uint32_t TILE_WIDTH	= 64;
+const uint32_t TILE_HEIGHT	= 32;
+
+//Anything closer than this to the camera's plane can't be projected safely
+const float MIN_W = 1e-3f;
+
+//Boxes handed to each job by RemoveOccluded
+const uint32_t TEST_BATCH_SIZE = 256;
+
+static Vector4 ToClipSpace(const Matrix4& m, const Vector3& p) {
+	const auto& a = m.array;
+	return Vector4(
+		a[0][0] * p.x + a[1][0] * p.y + a[2][0] * p.z + a[3][0],
+		a[0][1] * p.x + a[1][1] * p.y + a[2][1] * p.z + a[3][1],
+		a[0][2] * p.x + a[1][2] * p.y + a[2][2] * p.z + a[3][2],
+		a[0][3] * p.x + a[1][3] * p.y + a[2][3] * p.z + a[3][3]
+	);
+}
+
+static uint32_t Log2(uint32_t value) {
+	uint32_t result = 0;
+	while (value > 1) {
+		value >>= 1;
+		result++;
+	}
+	return result;
+}
+
+OcclusionCuller::OcclusionCuller(JobSystem* jobs, uint32_t width, uint32_t height)
+	: m_jobs(jobs), m_width(width), m_height(height) {
+	assert(width % TILE_WIDTH == 0 && height % TILE_HEIGHT == 0);
+	assert((width & (width - 1)) == 0 && (height & (height - 1)) == 0);
+
+	m_tilesX		= width / TILE_WIDTH;
+	m_tilesY		= height / TILE_HEIGHT;
+	m_tileLevels	= Log2(std::min(TILE_WIDTH, TILE_HEIGHT));
+	m_tileBins.resize(m_tilesX * m_tilesY);
+
+	m_levels.resize(Log2(std::min(width, height)) + 1);
+	for (uint32_t i = 0; i < m_levels.size(); ++i) {
+		m_levels[i].resize((size_t)(width >> i) * (height >> i));
+	}
+}
+
+void OcclusionCuller::BeginFrame(const Matrix4& viewProj) {
+	m_viewProj		= viewProj;
+	m_rasterised	= false;
+	m_occluders.clear();
+}
+
+void OcclusionCuller::AddOccluder(const VulkanMesh& mesh, const Matrix4& transform, uint32_t lod) {
+	if (mesh.GetPrimitiveType() != GeometryPrimitive::Triangles || mesh.GetIndexData().empty()) {
+		return;
+	}
+	m_occluders.push_back({
+		.positions	= mesh.GetPositionData().data(),
+		.indices	= mesh.GetIndexData().data(),
+		.ranges		= mesh.GetLODRanges(lod),
+		.transform	= m_viewProj * transform
+	});
+}
+
+void OcclusionCuller::SetupTriangles(const Occluder& occluder, std::vector<Triangle>& triangles) const {
+	triangles.clear();
+	for (const SubMesh& range : occluder.ranges) {
+		for (int i = 0; i + 2 < range.count; i += 3) {
+			float	x[3];
+			float	y[3];
+			float	depth	= FLT_MAX;
+			bool	clipped = false;
+			for (int v = 0; v < 3; ++v) {
+				Vector4 clip = ToClipSpace(occluder.transform, occluder.positions[range.base + occluder.indices[range.start + i + v]]);
+				//Leaving out triangles crossing the near plane only ever hides less
+				if (clip.w < MIN_W) {
+					clipped = true;
+					break;
+				}
+				float invW = 1.0f / clip.w;
+				x[v]	= (clip.x * invW * 0.5f + 0.5f) * m_width;
+				y[v]	= (clip.y * invW * 0.5f + 0.5f) * m_height;
+				depth	= std::min(depth, invW);
+			}
+			if (clipped) {
+				continue;
+			}
+			float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+			if (!(area != 0.0f)) {
+				continue;
+			}
+			//Pixels are covered if their centre is, so only centres within the bounds matter
+			float minX = std::ceil(std::min(std::min(x[0], x[1]), x[2]) - 0.5f);
+			float minY = std::ceil(std::min(std::min(y[0], y[1]), y[2]) - 0.5f);
+			float maxX = std::floor(std::max(std::max(x[0], x[1]), x[2]) - 0.5f);
+			float maxY = std::floor(std::max(std::max(y[0], y[1]), y[2]) - 0.5f);
+			if (maxX < 0.0f || maxY < 0.0f || minX > m_width - 1.0f || minY > m_height - 1.0f || minX > maxX || minY > maxY) {
+				continue;
+			}
+			//Either winding is an occluder, so flip the edges of clockwise triangles
+			float sign = area > 0.0f ? 1.0f : -1.0f;
+
+			Triangle t;
+			for (int e = 0; e < 3; ++e) {
+				int next = (e + 1) % 3;
+				t.edgeA[e] = (y[e] - y[next]) * sign;
+				t.edgeB[e] = (x[next] - x[e]) * sign;
+				t.edgeC[e] = -(t.edgeA[e] * x[e] + t.edgeB[e] * y[e]);
+			}
+			t.depth = depth;
+			t.minX	= (uint32_t)std::max(minX, 0.0f);
+			t.minY	= (uint32_t)std::max(minY, 0.0f);
+			t.maxX	= (uint32_t)std::min(maxX, m_width - 1.0f);
+			t.maxY	= (uint32_t)std::min(maxY, m_height - 1.0f);
+			triangles.push_back(t);
+		}
+	}
+}
+
+void OcclusionCuller::Rasterise() {
+	m_occluderTriangles.resize(m_occluders.size());
+	auto setup = [&](uint32_t i) {
+		SetupTriangles(m_occluders[i], m_occluderTriangles[i]);
+	};
+	if (m_jobs) {
+		m_jobs->ParallelFor((uint32_t)m_occluders.size(), setup);
+	}
+	else {
+		for (uint32_t i = 0; i < m_occluders.size(); ++i) {
+			setup(i);
+		}
+	}
+
+	m_triangles.clear();
+	for (std::vector<uint32_t>& bin : m_tileBins) {
+		bin.clear();
+	}
+	for (const std::vector<Triangle>& triangles : m_occluderTriangles) {
+		for (const Triangle& t : triangles) {
+			uint32_t index = (uint32_t)m_triangles.size();
+			m_triangles.push_back(t);
+			for (uint32_t ty = t.minY / TILE_HEIGHT; ty <= t.maxY / TILE_HEIGHT; ++ty) {
+				for (uint32_t tx = t.minX / TILE_WIDTH; tx <= t.maxX / TILE_WIDTH; ++tx) {
+					m_tileBins[ty * m_tilesX + tx].push_back(index);
+				}
+			}
+		}
+	}
+
+	auto rasteriseTile = [&](uint32_t tile) {
+		RasteriseTile(tile);
+	};
+	if (m_jobs) {
+		m_jobs->ParallelFor((uint32_t)m_tileBins.size(), rasteriseTile);
+	}
+	else {
+		for (uint32_t i = 0; i < m_tileBins.size(); ++i) {
+			rasteriseTile(i);
+		}
+	}
+	//The coarsest levels span several tiles, so are reduced once every tile is done
+	for (uint32_t level = m_tileLevels + 1; level < m_levels.size(); ++level) {
+		ReduceLevel(level, 0, 0, m_width >> level, m_height >> level);
+	}
+	m_rasterised = true;
+}
+
+//Writes depth to each of the four pixels from x whose centre is inside the triangle, if it's nearer
+static void WritePixels(float* dst, const float (&edgeA)[3], const float (&edgeB)[3], const float (&edgeC)[3], float depth, uint32_t x, float centreY) {
+#ifdef OCCLUSION_CULLER_SSE
+	__m128 centreX	= _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+	__m128 inside	= _mm_castsi128_ps(_mm_set1_epi32(-1));
+	for (int e = 0; e < 3; ++e) {
+		__m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edgeA[e]), centreX), _mm_set1_ps(edgeB[e] * centreY + edgeC[e]));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, _mm_setzero_ps()));
+	}
+	__m128 old		= _mm_loadu_ps(dst);
+	__m128 nearest	= _mm_max_ps(old, _mm_set1_ps(depth));
+	_mm_storeu_ps(dst, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+#else
+	for (int i = 0; i < 4; ++i) {
+		float centreX = x + i + 0.5f;
+		bool inside = true;
+		for (int e = 0; e < 3; ++e) {
+			inside = inside && edgeA[e] * centreX + (edgeB[e] * centreY + edgeC[e]) >= 0.0f;
+		}
+		if (inside) {
+			dst[i] = std::max(dst[i], depth);
+		}
+	}
+#endif
+}
+
+void OcclusionCuller::RasteriseTile(uint32_t tile) {
+	uint32_t tileX = (tile % m_tilesX) * TILE_WIDTH;
+	uint32_t tileY = (tile / m_tilesX) * TILE_HEIGHT;
+
+	std::vector<float>& depth = m_levels[0];
+	for (uint32_t y = tileY; y < tileY + TILE_HEIGHT; ++y) {
+		std::fill_n(&depth[(size_t)y * m_width + tileX], TILE_WIDTH, 0.0f);
+	}
+
+	for (uint32_t index : m_tileBins[tile]) {
+		const Triangle& t = m_triangles[index];
+		//Starting on a multiple of 4 keeps every group of pixels inside the tile
+		uint32_t minX = std::max(t.minX, tileX) & ~3u;
+		uint32_t maxX = std::min(t.maxX, tileX + TILE_WIDTH - 1);
+		uint32_t minY = std::max(t.minY, tileY);
+		uint32_t maxY = std::min(t.maxY, tileY + TILE_HEIGHT - 1);
+
+		for (uint32_t y = minY; y <= maxY; ++y) {
+			float* row = &depth[(size_t)y * m_width];
+			for (uint32_t x = minX; x <= maxX; x += 4) {
+				WritePixels(row + x, t.edgeA, t.edgeB, t.edgeC, t.depth, x, y + 0.5f);
+			}
+		}
+	}
+
+	for (uint32_t level = 1; level <= m_tileLevels && level < m_levels.size(); ++level) {
+		ReduceLevel(level, tileX >> level, tileY >> level, (tileX + TILE_WIDTH) >> level, (tileY + TILE_HEIGHT) >> level);
+	}
+}
+
+//Each texel keeps the furthest of the four below it. Bounds are in the level's texels, max exclusive.
+void OcclusionCuller::ReduceLevel(uint32_t level, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY) {
+	const std::vector<float>&	src = m_levels[level - 1];
+	std::vector<float>&			dst = m_levels[level];
+	uint32_t srcWidth = m_width >> (level - 1);
+	uint32_t dstWidth = m_width >> level;
+
+	for (uint32_t y = minY; y < maxY; ++y) {
+		const float* row0 = &src[(size_t)(y * 2) * srcWidth];
+		const float* row1 = row0 + srcWidth;
+		for (uint32_t x = minX; x < maxX; ++x) {
+			dst[(size_t)y * dstWidth + x] = std::min(std::min(row0[x * 2], row0[x * 2 + 1]), std::min(row1[x * 2], row1[x * 2 + 1]));
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox& box) const {
+	if (!m_rasterised || m_triangles.empty()) {
+		return true;
+	}
+	float minX		= FLT_MAX;
+	float minY		= FLT_MAX;
+	float maxX		= -FLT_MAX;
+	float maxY		= -FLT_MAX;
+	float nearest	= 0.0f;
+	for (int i = 0; i < 8; ++i) {
+		Vector3 corner(
+			(i & 1) ? box.max.x : box.min.x,
+			(i & 2) ? box.max.y : box.min.y,
+			(i & 4) ? box.max.z : box.min.z
+		);
+		Vector4 clip = ToClipSpace(m_viewProj, corner);
+		//Boxes reaching the camera can't be behind anything
+		if (clip.w < MIN_W) {
+			return true;
+		}
+		float invW	= 1.0f / clip.w;
+		float x		= (clip.x * invW * 0.5f + 0.5f) * m_width;
+		float y		= (clip.y * invW * 0.5f + 0.5f) * m_height;
+		minX	= std::min(minX, x);
+		minY	= std::min(minY, y);
+		maxX	= std::max(maxX, x);
+		maxY	= std::max(maxY, y);
+		nearest = std::max(nearest, invW);
+	}
+	//Anything off screen is left for frustum culling to decide
+	if (maxX < 0.0f || maxY < 0.0f || minX >= m_width || minY >= m_height) {
+		return true;
+	}
+	uint32_t x0 = (uint32_t)std::max(minX, 0.0f);
+	uint32_t y0 = (uint32_t)std::max(minY, 0.0f);
+	uint32_t x1 = (uint32_t)std::min(maxX, m_width - 1.0f);
+	uint32_t y1 = (uint32_t)std::min(maxY, m_height - 1.0f);
+
+	//The first level where the box covers no more than 2 x 2 texels
+	uint32_t level = 0;
+	while (level + 1 < m_levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+		level++;
+	}
+	const std::vector<float>& texels = m_levels[level];
+	uint32_t levelWidth = m_width >> level;
+	for (uint32_t y = y0 >> level; y <= y1 >> level; ++y) {
+		for (uint32_t x = x0 >> level; x <= x1 >> level; ++x) {
+			if (texels[(size_t)y * levelWidth + x] <= nearest) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void OcclusionCuller::RemoveOccluded(std::vector<uint32_t>& indices, const std::function<BoundingBox(uint32_t)>& getBounds) const {
+	std::vector<uint8_t> visible(indices.size());
+	auto testBatch = [&](uint32_t batch) {
+		size_t end = std::min(indices.size(), (size_t)(batch + 1) * TEST_BATCH_SIZE);
+		for (size_t i = (size_t)batch * TEST_BATCH_SIZE; i < end; ++i) {
+			visible[i] = IsVisible(getBounds(indices[i]));
+		}
+	};
+	uint32_t batchCount = (uint32_t)((indices.size() + TEST_BATCH_SIZE - 1) / TEST_BATCH_SIZE);
+	if (m_jobs) {
+		m_jobs->ParallelFor(batchCount, testBatch);
+	}
+	else {
+		for (uint32_t i = 0; i < batchCount; ++i) {
+			testBatch(i);
+		}
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (visible[i]) {
+			indices[kept++] = indices[i];
+		}
+	}
+	indices.resize(kept);
+}
\ No newline at end of file
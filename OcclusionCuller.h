@@ -0,0 +1,103 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "../NCLCoreClasses/Mesh.h"
+#include "CullingBVH.h"
+
+namespace NCL::Rendering::Vulkan {
+	class JobSystem;
+	class VulkanMesh;
+
+	/*
+	Rasterises a few occluder meshes into a small depth buffer on the CPU, and
+	tests boxes against it, so that objects hidden behind walls can be skipped
+	before their draws are recorded.
+
+	The depth buffer is split into tiles, each rasterised by its own job, four
+	pixels at a time with SSE. Depths are stored as 1 / w, so nearer is larger,
+	and every triangle is written at the depth of its furthest vertex, so an
+	occluder never hides more than it really would. Each level of the
+	hierarchical Z pyramid holds the furthest depth of the texels below it.
+
+	Each frame: BeginFrame, AddOccluder for each occluder, Rasterise, then
+	IsVisible or RemoveOccluded for the boxes to test.
+	*/
+	class OcclusionCuller {
+	public:
+		//Width and height must be multiples of the 64 x 32 tile size, and powers of two
+		OcclusionCuller(JobSystem* jobs = nullptr, uint32_t width = 256, uint32_t height = 128);
+
+		void BeginFrame(const Maths::Matrix4& viewProj);
+
+		//The mesh must keep its CPU side data until Rasterise, so cooked meshes can't be occluders.
+		//Occluders are best kept simple, so by default the coarsest LOD is used.
+		void AddOccluder(const VulkanMesh& mesh, const Maths::Matrix4& transform, uint32_t lod = ~0u);
+
+		void Rasterise();
+
+		//False only if the box is entirely behind the occluders
+		bool IsVisible(const BoundingBox& box) const;
+
+		//Removes any indices whose bounds aren't visible, keeping the rest in order. Tested in parallel, so getBounds must be thread safe.
+		void RemoveOccluded(std::vector<uint32_t>& indices, const std::function<BoundingBox(uint32_t)>& getBounds) const;
+
+		uint32_t GetWidth() const {
+			return m_width;
+		}
+
+		uint32_t GetHeight() const {
+			return m_height;
+		}
+
+		//Level 0 is the full depth buffer, each following level is half the size of the last
+		const std::vector<float>& GetDepthLevel(uint32_t level) const {
+			return m_levels[level];
+		}
+
+	protected:
+		struct Occluder {
+			const Maths::Vector3*		positions;
+			const unsigned int*			indices;
+			std::vector<SubMesh>		ranges;
+			Maths::Matrix4				transform;	//To clip space
+		};
+
+		//Edges are in the form a * x + b * y + c, positive inside the triangle
+		struct Triangle {
+			float		edgeA[3];
+			float		edgeB[3];
+			float		edgeC[3];
+			float		depth;
+			uint32_t	minX;
+			uint32_t	minY;
+			uint32_t	maxX;	//Inclusive
+			uint32_t	maxY;
+		};
+
+		void	SetupTriangles(const Occluder& occluder, std::vector<Triangle>& triangles) const;
+		void	RasteriseTile(uint32_t tile);
+		void	ReduceLevel(uint32_t level, uint32_t minX, uint32_t minY, uint32_t maxX, uint32_t maxY);
+
+		JobSystem*	m_jobs;
+		uint32_t	m_width;
+		uint32_t	m_height;
+		uint32_t	m_tilesX;
+		uint32_t	m_tilesY;
+		uint32_t	m_tileLevels;	//Levels small enough to be reduced within a tile
+
+		Maths::Matrix4	m_viewProj;
+
+		std::vector<Occluder>				m_occluders;
+		std::vector<std::vector<Triangle>>	m_occluderTriangles;
+		std::vector<Triangle>				m_triangles;
+		std::vector<std::vector<uint32_t>>	m_tileBins;	//Indices into m_triangles
+
+		std::vector<std::vector<float>>	m_levels;
+		bool							m_rasterised = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "ParallelRecorder.h"
+#include "JobSystem.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+ParallelRecorder::ParallelRecorder(vk::Device device, uint32_t queueFamily, uint32_t framesInFlight, JobSystem* jobs, uint32_t chunkCount)
+	: m_device(device), m_jobs(jobs)
+{
+	m_chunkCount = chunkCount ? chunkCount : (jobs ? jobs->GetThreadCount() : 0) + 1;
+
+	m_pools.resize(framesInFlight);
+	for (std::vector<ChunkPool>& framePools : m_pools) {
+		framePools.resize(m_chunkCount);
+		for (ChunkPool& chunk : framePools) {
+			//Buffers are only ever reset along with the whole pool
+			chunk.pool = device.createCommandPoolUnique(
+				{
+					.flags				= vk::CommandPoolCreateFlagBits::eTransient,
+					.queueFamilyIndex	= queueFamily
+				}
+			);
+		}
+	}
+}
+
+void ParallelRecorder::BeginFrame(uint32_t frameIndex) {
+	m_frameIndex = frameIndex;
+	for (ChunkPool& chunk : m_pools[frameIndex]) {
+		m_device.resetCommandPool(*chunk.pool);
+		chunk.used = 0;
+	}
+}
+
+vk::CommandBuffer ParallelRecorder::GetBuffer(ChunkPool& chunk) {
+	if (chunk.used == chunk.buffers.size()) {
+		chunk.buffers.push_back(std::move(m_device.allocateCommandBuffersUnique(
+			{
+				.commandPool		= *chunk.pool,
+				.level				= vk::CommandBufferLevel::eSecondary,
+				.commandBufferCount = 1
+			}
+		)[0]));
+	}
+	return *chunk.buffers[chunk.used++];
+}
+
+void ParallelRecorder::Record(vk::CommandBuffer primary, const vk::CommandBufferInheritanceRenderingInfo& rendering, const RecordFunction& func) {
+	std::vector<ChunkPool>& framePools = m_pools[m_frameIndex];
+
+	vk::CommandBufferInheritanceInfo inheritance{ .pNext = &rendering };
+
+	std::vector<vk::CommandBuffer> buffers(m_chunkCount);
+	auto recordChunk = [&](uint32_t chunk) {
+		vk::CommandBuffer buffer = GetBuffer(framePools[chunk]);
+		buffer.begin({
+			.flags				= vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+			.pInheritanceInfo	= &inheritance
+		});
+		func(buffer, chunk);
+		buffer.end();
+		buffers[chunk] = buffer;
+	};
+
+	if (m_jobs) {
+		m_jobs->ParallelFor(m_chunkCount, recordChunk);
+	}
+	else {
+		for (uint32_t chunk = 0; chunk < m_chunkCount; ++chunk) {
+			recordChunk(chunk);
+		}
+	}
+	primary.executeCommands(buffers);
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	class JobSystem;
+
+	/*
+	Records a frame's commands in chunks on the job system, each chunk into a
+	secondary command buffer of its own, then executes them all in chunk
+	order from the frame's primary command buffer.
+
+	A command pool can only be used by one thread at a time, so each chunk
+	has its own pool for each frame in flight, and BeginFrame resets the
+	frame's pools once the GPU is done with them.
+
+	Secondary command buffers inherit nothing from the primary but its
+	dynamic rendering attachments, so each chunk must set its own viewport,
+	scissor, pipeline and descriptor sets. The primary's beginRendering must
+	use vk::RenderingFlagBits::eContentsSecondaryCommandBuffers, and nothing
+	but Record's executeCommands may go between it and endRendering.
+	*/
+	class ParallelRecorder {
+	public:
+		//Called from a job for each chunk, with the chunk's index
+		using RecordFunction = std::function<void(vk::CommandBuffer, uint32_t)>;
+
+		//0 chunks gives one per job system thread, plus one for the thread calling Record
+		ParallelRecorder(vk::Device device, uint32_t queueFamily, uint32_t framesInFlight, JobSystem* jobs = nullptr, uint32_t chunkCount = 0);
+
+		//Call once the frame's previous use has completed, such as with the FrameContext's cycleID
+		void BeginFrame(uint32_t frameIndex);
+
+		//Can be called more than once a frame, such as once per render pass
+		void Record(vk::CommandBuffer primary, const vk::CommandBufferInheritanceRenderingInfo& rendering, const RecordFunction& func);
+
+		uint32_t GetChunkCount() const {
+			return m_chunkCount;
+		}
+
+	protected:
+		//The pool must outlive the buffers allocated from it, so comes first
+		struct ChunkPool {
+			vk::UniqueCommandPool					pool;
+			std::vector<vk::UniqueCommandBuffer>	buffers;
+			uint32_t								used = 0;	//Buffers handed out since the pool was reset
+		};
+
+		vk::CommandBuffer GetBuffer(ChunkPool& chunk);
+
+		vk::Device	m_device;
+		JobSystem*	m_jobs;
+		uint32_t	m_chunkCount;
+		uint32_t	m_frameIndex = 0;
+
+		std::vector<std::vector<ChunkPool>>	m_pools;	//By frame in flight, then chunk
+	};
+}
\ No newline at end of file
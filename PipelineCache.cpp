@@ -0,0 +1,93 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "PipelineCache.h"
+#include "HashUtils.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <filesystem>
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+//VkPipelineCacheHeaderVersionOne, which every pipeline cache's data starts with
+struct PipelineCacheHeader {
+	uint32_t	headerSize;
+	uint32_t	headerVersion;
+	uint32_t	vendorID;
+	uint32_t	deviceID;
+	uint8_t		pipelineCacheUUID[VK_UUID_SIZE];
+};
+static_assert(sizeof(PipelineCacheHeader) == 32);
+
+PipelineCache::PipelineCache(vk::Device device, vk::PhysicalDevice gpu, const std::string& filename)
+	: m_device(device), m_filename(filename)
+{
+	m_properties = gpu.getProperties();
+
+	MappedFile file(filename);
+	m_loaded = file.IsValid() && IsCompatible(file.GetData(), file.GetSize());
+
+	m_cache = device.createPipelineCacheUnique({
+		.initialDataSize	= m_loaded ? file.GetSize() : 0,
+		.pInitialData		= m_loaded ? file.GetData() : nullptr
+	});
+	if (m_loaded) {
+		m_savedHash = HashBytes(file.GetData(), file.GetSize());
+	}
+}
+
+PipelineCache::~PipelineCache() {
+	Save();
+}
+
+bool PipelineCache::IsCompatible(const char* data, size_t size) const {
+	if (size < sizeof(PipelineCacheHeader)) {
+		return false;
+	}
+	PipelineCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	return header.headerSize	>= sizeof(PipelineCacheHeader)
+		&& header.headerSize	<= size
+		&& header.headerVersion == (uint32_t)vk::PipelineCacheHeaderVersion::eOne
+		&& header.vendorID		== m_properties.vendorID
+		&& header.deviceID		== m_properties.deviceID
+		&& memcmp(header.pipelineCacheUUID, &m_properties.pipelineCacheUUID[0], VK_UUID_SIZE) == 0;
+}
+
+bool PipelineCache::Save() {
+	std::vector<uint8_t> data = m_device.getPipelineCacheData(*m_cache);
+	if (data.empty()) {
+		return false;
+	}
+	uint64_t hash = HashBytes(data.data(), data.size());
+	if (hash == m_savedHash) {
+		return true;
+	}
+
+	std::string tempName = m_filename + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		file.write((const char*)data.data(), data.size());
+		if (!file.good()) {
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempName, m_filename, error);
+	if (error) {
+		return false;
+	}
+	m_savedHash = hash;
+	return true;
+}
\ No newline at end of file
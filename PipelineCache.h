@@ -0,0 +1,53 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	A vk::PipelineCache that is kept in a file between runs, so that pipelines
+	compiled by one run are ready straight away in the next. Pass Get() to
+	anything that creates pipelines.
+
+	The data starts with Vulkan's own pipeline cache header, holding the
+	vendor, device and pipeline cache UUID of whatever wrote it. A file from
+	another GPU or driver version doesn't match, so is ignored, and the cache
+	starts empty rather than handing the driver data it can't use.
+	*/
+	class PipelineCache {
+	public:
+		//Starts empty if the file is missing, or was written by another device or driver
+		PipelineCache(vk::Device device, vk::PhysicalDevice gpu, const std::string& filename);
+		//Saves, so must come before the device is destroyed
+		~PipelineCache();
+
+		//Written under a temporary name and renamed, so a crash never leaves half a file.
+		//Does nothing if no pipelines have been added since the cache was loaded or last saved.
+		bool Save();
+
+		vk::PipelineCache Get() const {
+			return *m_cache;
+		}
+
+		//Whether the file was usable, or this is a cold start
+		bool WasLoaded() const {
+			return m_loaded;
+		}
+
+	protected:
+		bool IsCompatible(const char* data, size_t size) const;
+
+		vk::Device				m_device;
+		vk::UniquePipelineCache	m_cache;
+		std::string				m_filename;
+
+		vk::PhysicalDeviceProperties	m_properties;
+
+		uint64_t	m_savedHash = 0;	//Of the data as it was loaded or last saved
+		bool		m_loaded	= false;
+	};
+}
\ No newline at end of file
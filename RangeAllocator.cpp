@@ -0,0 +1,86 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "RangeAllocator.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+RangeAllocator::RangeAllocator(size_t capacity) : m_capacity(capacity), m_freeSpace(capacity) {
+	if (capacity > 0) {
+		m_freeRanges[0] = capacity;
+	}
+}
+
+bool RangeAllocator::Allocate(size_t size, size_t& offset, size_t alignment) {
+	if (size == 0) {
+		offset = 0;
+		return true;
+	}
+	for (auto i = m_freeRanges.begin(); i != m_freeRanges.end(); ++i) {
+		size_t start	= i->first;
+		size_t end		= i->first + i->second;
+		size_t aligned	= (start + alignment - 1) / alignment * alignment;
+
+		if (aligned + size > end) {
+			continue;
+		}
+		m_freeRanges.erase(i);
+		//Keep whatever is left either side of the allocation
+		if (aligned > start) {
+			m_freeRanges[start] = aligned - start;
+		}
+		if (aligned + size < end) {
+			m_freeRanges[aligned + size] = end - (aligned + size);
+		}
+		m_freeSpace -= size;
+		offset = aligned;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::Free(size_t offset, size_t size) {
+	if (size == 0) {
+		return;
+	}
+	assert(offset + size <= m_capacity);
+	m_freeSpace += size;
+
+	auto next = m_freeRanges.lower_bound(offset);
+	assert(next == m_freeRanges.end() || next->first >= offset + size);
+
+	if (next != m_freeRanges.end() && next->first == offset + size) {
+		size += next->second;
+		next = m_freeRanges.erase(next);
+	}
+	if (next != m_freeRanges.begin()) {
+		auto previous = std::prev(next);
+		assert(previous->first + previous->second <= offset);
+		if (previous->first + previous->second == offset) {
+			previous->second += size;
+			return;
+		}
+	}
+	m_freeRanges[offset] = size;
+}
+
+void RangeAllocator::Grow(size_t newCapacity) {
+	assert(newCapacity >= m_capacity);
+	size_t oldCapacity = m_capacity;
+	m_capacity = newCapacity;
+	Free(oldCapacity, newCapacity - oldCapacity);
+}
+
+size_t RangeAllocator::GetLargestFreeRange() const {
+	size_t largest = 0;
+	for (const auto& [start, size] : m_freeRanges) {
+		largest = size > largest ? size : largest;
+	}
+	return largest;
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	First-fit free list over [0, capacity). Freed ranges are merged with their
+	neighbours, so the space can be reused by allocations of any size.
+	*/
+	class RangeAllocator {
+	public:
+		RangeAllocator(size_t capacity = 0);
+
+		bool Allocate(size_t size, size_t& offset, size_t alignment = 1);
+		void Free(size_t offset, size_t size);
+
+		//Adds [capacity, newCapacity) as free space
+		void Grow(size_t newCapacity);
+
+		size_t GetCapacity() const {
+			return m_capacity;
+		}
+
+		size_t GetFreeSpace() const {
+			return m_freeSpace;
+		}
+
+		size_t GetLargestFreeRange() const;
+
+	protected:
+		size_t m_capacity;
+		size_t m_freeSpace;
+
+		std::map<size_t, size_t> m_freeRanges; //Start -> size
+	};
+}
\ No newline at end of file
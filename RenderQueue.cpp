@@ -0,0 +1,181 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "RenderQueue.h"
+#include "FrameAllocator.h"
+#include "VulkanMeshArena.h"
+
+#include <algorithm>
+#include <cstring>
+#include <span>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+//From the least significant bits up, adding up to 64
+const uint32_t DEPTH_BITS		= 14;
+const uint32_t LOD_BITS			= 4;
+const uint32_t MESH_BITS		= 20;
+const uint32_t MATERIAL_BITS	= 16;
+const uint32_t PIPELINE_BITS	= 10;
+
+const uint32_t LOD_SHIFT		= DEPTH_BITS;
+const uint32_t MESH_SHIFT		= LOD_SHIFT + LOD_BITS;
+const uint32_t MATERIAL_SHIFT	= MESH_SHIFT + MESH_BITS;
+const uint32_t PIPELINE_SHIFT	= MATERIAL_SHIFT + MATERIAL_BITS;
+
+//Keys that match under this mask only differ by depth, so can be drawn together
+const uint64_t BATCH_MASK = ~((1ull << DEPTH_BITS) - 1);
+
+//The bits of a positive float sort the same as its value, and taking the top ones
+//keeps most of the precision close to the camera, where it's most useful
+static uint64_t QuantiseDepth(float depth) {
+	depth = std::max(depth, 0.0f);
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> (31 - DEPTH_BITS);
+}
+
+void RenderQueue::Clear() {
+	m_items.clear();
+	m_transforms.clear();
+	m_entries.clear();
+	m_batches.clear();
+	//Objects may be destroyed between frames, and something else given their address or handle
+	m_pipelineIDs.clear();
+	m_materialIDs.clear();
+	m_meshIDs.clear();
+}
+
+void RenderQueue::Add(vk::Pipeline pipeline, vk::PipelineLayout layout, vk::DescriptorSet material,
+	const VulkanMesh& mesh, uint32_t lod, const Matrix4& transform, float depth) {
+	//LODs past the last draw the last, so they're the same draw
+	lod = std::min(lod, mesh.GetLODCount() - 1);
+
+	uint64_t pipelineID	= GetID(m_pipelineIDs, pipeline);
+	uint64_t materialID	= GetID(m_materialIDs, material);
+	uint64_t meshID		= GetID(m_meshIDs, &mesh);
+
+	assert(pipelineID	< (1ull << PIPELINE_BITS));
+	assert(materialID	< (1ull << MATERIAL_BITS));
+	assert(meshID		< (1ull << MESH_BITS));
+	assert(lod			< (1u << LOD_BITS));
+
+	uint64_t key = pipelineID << PIPELINE_SHIFT | materialID << MATERIAL_SHIFT | meshID << MESH_SHIFT | (uint64_t)lod << LOD_SHIFT | QuantiseDepth(depth);
+
+	m_entries.push_back({ key, (uint32_t)m_items.size() });
+	m_items.push_back({ pipeline, layout, material, &mesh, lod });
+	m_transforms.push_back(transform);
+}
+
+void RenderQueue::Sort() {
+	size_t count = m_entries.size();
+	if (count < 2) {
+		return;
+	}
+	//Least significant byte first, each pass keeping the order of the last for equal bytes
+	uint32_t histograms[8][256] = {};
+	for (const SortEntry& e : m_entries) {
+		for (int pass = 0; pass < 8; ++pass) {
+			histograms[pass][(e.key >> (pass * 8)) & 0xFF]++;
+		}
+	}
+	m_sortScratch.resize(count);
+
+	for (int pass = 0; pass < 8; ++pass) {
+		uint32_t*	offsets = histograms[pass];
+		int			shift	= pass * 8;
+		//IDs are small, so most of the upper bytes are the same for every key, and their passes would change nothing
+		if (offsets[(m_entries[0].key >> shift) & 0xFF] == count) {
+			continue;
+		}
+		uint32_t total = 0;
+		for (uint32_t& offset : std::span(offsets, 256)) {
+			uint32_t n	= offset;
+			offset		= total;
+			total		+= n;
+		}
+		for (const SortEntry& e : m_entries) {
+			m_sortScratch[offsets[(e.key >> shift) & 0xFF]++] = e;
+		}
+		m_entries.swap(m_sortScratch);
+	}
+}
+
+void RenderQueue::Record(vk::CommandBuffer cmdBuffer, FrameAllocator& allocator, uint32_t materialSet, uint32_t instanceSet) {
+	Prepare(allocator);
+	RecordBatches(cmdBuffer, materialSet, instanceSet, 0, GetBatchCount());
+}
+
+void RenderQueue::Prepare(FrameAllocator& allocator) {
+	m_batches.clear();
+	size_t count = m_entries.size();
+	if (count == 0) {
+		return;
+	}
+
+	//Each batch's instances are consecutive, so firstInstance finds them
+	FrameAllocator::Allocation instances = allocator.Allocate(count * sizeof(Matrix4));
+	Matrix4* transforms = (Matrix4*)instances.data;
+	for (size_t i = 0; i < count; ++i) {
+		transforms[i] = m_transforms[m_entries[i].item];
+	}
+	m_instanceSet		= allocator.GetStorageSet();
+	m_instanceOffset	= instances.offset;
+
+	for (size_t first = 0; first < count;) {
+		size_t last = first + 1;
+		while (last < count && (m_entries[last].key & BATCH_MASK) == (m_entries[first].key & BATCH_MASK)) {
+			last++;
+		}
+		m_batches.push_back({ (uint32_t)first, (uint32_t)(last - first) });
+		first = last;
+	}
+}
+
+void RenderQueue::RecordBatches(vk::CommandBuffer cmdBuffer, uint32_t materialSet, uint32_t instanceSet, uint32_t first, uint32_t count) const {
+	vk::Pipeline		boundPipeline;
+	vk::PipelineLayout	boundLayout;
+	vk::DescriptorSet	boundMaterial;
+	const void*			boundBuffers = nullptr;	//The mesh or arena whose buffers are bound
+
+	for (uint32_t b = first; b < first + count; ++b) {
+		const Batch&	batch	= m_batches[b];
+		const Item&		item	= m_items[m_entries[batch.first].item];
+
+		if (item.pipeline != boundPipeline) {
+			cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, item.pipeline);
+			boundPipeline = item.pipeline;
+		}
+		//A new layout may not be compatible with the sets bound through the last
+		if (item.layout != boundLayout) {
+			cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, item.layout, instanceSet, 1, &m_instanceSet, 1, &m_instanceOffset);
+			boundLayout		= item.layout;
+			boundMaterial	= nullptr;
+		}
+		if (item.material && item.material != boundMaterial) {
+			cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, item.layout, materialSet, 1, &item.material, 0, nullptr);
+			boundMaterial = item.material;
+		}
+
+		const VulkanMeshArena*	arena	= item.mesh->GetArena();
+		const void*				buffers = arena ? (const void*)arena : (const void*)item.mesh;
+		if (buffers != boundBuffers) {
+			if (arena) {
+				arena->Bind(cmdBuffer);
+			}
+			else {
+				item.mesh->GetMesh()->BindToCommandBuffer(cmdBuffer);
+			}
+			boundBuffers = buffers;
+		}
+
+		item.mesh->DrawLOD(cmdBuffer, item.lod, batch.count, batch.first);
+	}
+}
\ No newline at end of file
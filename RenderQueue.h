@@ -0,0 +1,111 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	class FrameAllocator;
+	class VulkanMesh;
+	class VulkanMeshArena;
+
+	/*
+	Gathers a frame's draws, then records them with as little state changing
+	as it can. Each draw gets a 64 bit sort key made up of, from the most
+	significant bits down, its pipeline, material set, mesh and LOD, and
+	depth, and the keys are radix sorted. Pipelines, material sets and
+	vertex buffers are then only bound when they differ from the last draw,
+	and runs of draws sharing all but their depth become a single instanced
+	draw, with their nearest instances first.
+
+	Transforms aren't push constants, as with RenderSingleObject, but are
+	written in sorted order to a FrameAllocator storage allocation, bound at
+	instanceSet. Vertex shaders read theirs as transforms[gl_InstanceIndex]
+	from the storage buffer at binding 0 of that set.
+
+	Batches can be recorded in parallel, such as with a ParallelRecorder:
+	Prepare once, then RecordBatches for each thread's share of the batches.
+
+	As draws are reordered, this suits opaque objects, but not transparent
+	ones that must be drawn back to front.
+	*/
+	class RenderQueue {
+	public:
+		void Clear();
+
+		//depth is anything that increases away from the camera, such as the distance to it.
+		//A null material binds nothing, for pipelines that don't have a material set.
+		void Add(vk::Pipeline pipeline, vk::PipelineLayout layout, vk::DescriptorSet material,
+			const VulkanMesh& mesh, uint32_t lod, const Maths::Matrix4& transform, float depth);
+
+		void Sort();
+
+		//Prepare, then RecordBatches for every batch.
+		//Sets that every pipeline shares, such as the camera, must already be bound.
+		//materialSet and instanceSet are the set indices of the material and transforms.
+		void Record(vk::CommandBuffer cmdBuffer, FrameAllocator& allocator, uint32_t materialSet, uint32_t instanceSet);
+
+		//Writes the sorted transforms, and splits the draws into batches, each of which is a single instanced draw
+		void Prepare(FrameAllocator& allocator);
+
+		//Records batches [first, first + count) after Prepare. Can be called from several threads at once, each into its own command buffer.
+		void RecordBatches(vk::CommandBuffer cmdBuffer, uint32_t materialSet, uint32_t instanceSet, uint32_t first, uint32_t count) const;
+
+		uint32_t GetItemCount() const {
+			return (uint32_t)m_items.size();
+		}
+
+		//Instanced draws made by the last Prepare. Meshes with several ranges make a draw call per range for each.
+		uint32_t GetBatchCount() const {
+			return (uint32_t)m_batches.size();
+		}
+
+		//For binding shared sets ahead of RecordBatches, such as in a secondary command buffer
+		vk::PipelineLayout GetBatchLayout(uint32_t batch) const {
+			return m_items[m_entries[m_batches[batch].first].item].layout;
+		}
+
+	protected:
+		struct Item {
+			vk::Pipeline		pipeline;
+			vk::PipelineLayout	layout;
+			vk::DescriptorSet	material;
+			const VulkanMesh*	mesh;
+			uint32_t			lod;
+		};
+
+		struct SortEntry {
+			uint64_t key;
+			uint32_t item;
+		};
+
+		//A run of m_entries, and the instances it draws
+		struct Batch {
+			uint32_t first;
+			uint32_t count;
+		};
+
+		//Small IDs for each pipeline, material and mesh, given in the order they're first seen
+		template<typename T>
+		static uint32_t GetID(std::unordered_map<T, uint32_t>& ids, T object) {
+			auto [i, added] = ids.try_emplace(object, (uint32_t)ids.size());
+			return i->second;
+		}
+
+		std::vector<Item>			m_items;
+		std::vector<Maths::Matrix4>	m_transforms;	//Indexed as m_items
+		std::vector<SortEntry>		m_entries;
+		std::vector<SortEntry>		m_sortScratch;
+
+		std::unordered_map<vk::Pipeline, uint32_t>		m_pipelineIDs;
+		std::unordered_map<vk::DescriptorSet, uint32_t>	m_materialIDs;
+		std::unordered_map<const VulkanMesh*, uint32_t>	m_meshIDs;
+
+		std::vector<Batch>	m_batches;
+		vk::DescriptorSet	m_instanceSet;
+		uint32_t			m_instanceOffset = 0;
+	};
+}
\ No newline at end of file
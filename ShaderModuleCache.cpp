@@ -0,0 +1,44 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "ShaderModuleCache.h"
+#include "HashUtils.h"
+#include "MappedFile.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+ShaderModuleCache::ShaderModuleCache(vk::Device device) : m_device(device) {
+}
+
+vk::ShaderModule ShaderModuleCache::Get(const std::string& filename) {
+	MappedFile spirv(Assets::SHADERDIR + "VK/" + filename);
+	if (!spirv.IsValid()) {
+		return {};
+	}
+	return Get(spirv.GetData(), spirv.GetSize());
+}
+
+vk::ShaderModule ShaderModuleCache::Get(const void* spirv, size_t size) {
+	uint64_t hash = HashBytes(spirv, size);
+
+	std::lock_guard lock(m_mutex);
+	vk::UniqueShaderModule& module = m_modules[hash];
+	if (!module) {
+		module = m_device.createShaderModuleUnique({
+			.codeSize	= size,
+			.pCode		= (const uint32_t*)spirv
+		});
+	}
+	return *module;
+}
+
+size_t ShaderModuleCache::GetModuleCount() const {
+	std::lock_guard lock(m_mutex);
+	return m_modules.size();
+}
\ No newline at end of file
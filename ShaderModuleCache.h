@@ -0,0 +1,34 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include <mutex>
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	Shader modules keyed by a hash of their SPIR-V, so that pipelines sharing
+	a shader share one module for it, however many times it is asked for.
+	Modules are kept until the cache is destroyed, so pipelines can be made
+	from them at any time. Safe to use from several threads at once.
+	*/
+	class ShaderModuleCache {
+	public:
+		ShaderModuleCache(vk::Device device);
+
+		//From the shader directory, such as "DrawGeneration.comp.spv". Null if the file can't be read.
+		vk::ShaderModule Get(const std::string& filename);
+		vk::ShaderModule Get(const void* spirv, size_t size);
+
+		size_t GetModuleCount() const;
+
+	protected:
+		vk::Device m_device;
+
+		mutable std::mutex m_mutex;
+		std::unordered_map<uint64_t, vk::UniqueShaderModule> m_modules;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,276 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "../BindlessManager.h"
+#include "../VulkanMeshArena.h"
+#include "../VulkanUploadQueue.h"
+#include "../../VKQuick/TextureBuilder.h"
+#include "TestDevice.h"
+#include "TestUtils.h"
+
+#include "../Shaders/VK/GLSLInterop.h"
+
+#define BINDLESS_SET 1
+#include "../Shaders/VK/VKQuick/bindless.glslh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <numeric>
+#include <random>
+#include <thread>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+const uint32_t THREAD_COUNT		= 8;
+const uint32_t CHURN_STEPS		= 4000;
+const uint32_t RESOURCE_COUNT	= 32;	//Of each kind, shared by every thread
+
+enum ResourceKind {
+	MeshKind,
+	TextureKind,
+	BufferKind,
+	MaterialKind,
+	KIND_COUNT
+};
+
+struct TestMaterial {
+	Vector4		colour;
+	uint32_t	textures[4];
+};
+
+//Everything the threads add, made up front, so the threads only touch the BindlessManager
+struct TestResources {
+	std::vector<UniqueVulkanMesh>		meshes;
+	std::vector<VKQuick::UniqueTexture>	textures;
+	std::vector<VKQuick::Buffer>		buffers;
+	std::vector<TestMaterial>			materials;
+	vk::UniqueSampler					sampler;
+};
+
+using ThreadHandles = std::array<std::vector<VKQuick::BindlessHandle>, KIND_COUNT>;
+
+static bool SameHandle(VKQuick::BindlessHandle a, VKQuick::BindlessHandle b) {
+	return a.index == b.index && a.generation == b.generation;
+}
+
+static VKQuick::BindlessHandle Add(VKQuick::BindlessManager& bindless, TestResources& resources, ResourceKind kind, uint32_t resource) {
+	switch (kind) {
+		case MeshKind:		return bindless.AddArenaMesh(*resources.meshes[resource], {});
+		case TextureKind:	return bindless.AddTexture(*resources.textures[resource], *resources.sampler);
+		case BufferKind:	return bindless.AddBuffer(resources.buffers[resource]);
+		default:			return bindless.AddMaterial(resources.materials[resource]);
+	}
+}
+
+static void Remove(VKQuick::BindlessManager& bindless, ResourceKind kind, VKQuick::BindlessHandle handle) {
+	switch (kind) {
+		case MeshKind:		bindless.RemoveMesh(handle);					break;
+		case TextureKind:	bindless.RemoveTexture(handle);					break;
+		case BufferKind:	bindless.RemoveBuffer(handle);					break;
+		default:			bindless.RemoveMaterial<TestMaterial>(handle);	break;
+	}
+}
+
+static void CreateResources(TestDevice& testDevice, VulkanMeshArena& arena, VulkanUploadQueue& uploads, TestResources& resources) {
+	vk::Device device = testDevice.GetDevice();
+
+	for (uint32_t i = 0; i < RESOURCE_COUNT; ++i) {
+		//A triangle each, at a different place in the arena
+		VulkanMesh* mesh = new VulkanMesh();
+		mesh->SetVertexPositions({ Vector3(0, 0, (float)i), Vector3(1, 0, (float)i), Vector3(0, 1, (float)i) });
+		mesh->SetVertexIndices({ 0, 1, 2 });
+		mesh->AddSubMesh(0, 3, 0);
+		mesh->SetDebugName("Stress Test Mesh " + std::to_string(i));
+		resources.meshes.emplace_back(mesh);
+		arena.AddMesh(*mesh, uploads);
+
+		resources.textures.push_back(VKQuick::TextureBuilder(device, testDevice.GetMemoryManager())
+			.WithFormat(vk::Format::eR8G8B8A8Unorm)
+			.WithDimension(4, 4)
+			.WithUsages(vk::ImageUsageFlagBits::eSampled)
+			.Build("Stress Test Texture " + std::to_string(i))
+		);
+
+		resources.buffers.push_back(testDevice.GetMemoryManager().CreateBuffer(
+			{
+				.size	= 256,
+				.usage	= vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress
+			},
+			vk::MemoryPropertyFlagBits::eDeviceLocal,
+			"Stress Test Buffer " + std::to_string(i)
+		));
+
+		resources.materials.push_back({ .colour = Vector4((float)i, 0, 0, 1), .textures = { i, i + 1, i + 2, i + 3 } });
+	}
+	resources.sampler = device.createSamplerUnique(vk::SamplerCreateInfo{});
+
+	uploads.Flush();
+	uploads.WaitAll();
+}
+
+//Runs work on THREAD_COUNT threads, while this thread keeps flushing the manager's
+//changes and moving through frames, as the thread recording the frame would
+static bool RunThreads(TestDevice& testDevice, VKQuick::BindlessManager& bindless, const std::function<bool(uint32_t)>& work) {
+	std::atomic<uint32_t>		finished = 0;
+	std::vector<uint8_t>		results(THREAD_COUNT);
+	std::vector<std::thread>	threads;
+	for (uint32_t t = 0; t < THREAD_COUNT; ++t) {
+		threads.emplace_back([&, t]() {
+			results[t] = work(t);
+			finished++;
+		});
+	}
+	while (finished < THREAD_COUNT) {
+		bindless.Flush();
+		testDevice.Submit([&](vk::CommandBuffer cmdBuffer) {
+			bindless.RecordUpdates(cmdBuffer);
+		});
+		bindless.NextFrame();
+	}
+	for (std::thread& t : threads) {
+		t.join();
+	}
+	//And once more, to pick up whatever the threads did after the last flush
+	bindless.Flush();
+	testDevice.Submit([&](vk::CommandBuffer cmdBuffer) {
+		bindless.RecordUpdates(cmdBuffer);
+	});
+	bindless.NextFrame();
+
+	for (uint8_t result : results) {
+		TEST_CHECK(result);
+	}
+	return true;
+}
+
+//Every thread adds and removes things at random, often the same things as the other threads
+static bool TestChurn(TestDevice& testDevice, VKQuick::BindlessManager& bindless, TestResources& resources) {
+	return RunThreads(testDevice, bindless, [&](uint32_t thread) {
+		std::mt19937 rng(thread);
+
+		struct Held {
+			ResourceKind			kind;
+			VKQuick::BindlessHandle	handle;
+		};
+		std::vector<Held> held;
+		for (uint32_t step = 0; step < CHURN_STEPS; ++step) {
+			if (!held.empty() && rng() % 3 == 0) {
+				size_t i = rng() % held.size();
+				Remove(bindless, held[i].kind, held[i].handle);
+				held[i] = held.back();
+				held.pop_back();
+				continue;
+			}
+			ResourceKind kind = (ResourceKind)(rng() % KIND_COUNT);
+			VKQuick::BindlessHandle handle = Add(bindless, resources, kind, rng() % RESOURCE_COUNT);
+			TEST_CHECK(handle.IsValid());
+			held.push_back({ kind, handle });
+		}
+		for (const Held& h : held) {
+			Remove(bindless, h.kind, h.handle);
+		}
+		return true;
+	});
+}
+
+//Every thread adds everything at once, so each must get the same handles back, and
+//the index of each is only released once every thread has removed it
+static bool TestSharedAdds(TestDevice& testDevice, VKQuick::BindlessManager& bindless, TestResources& resources) {
+	std::vector<ThreadHandles> threadHandles(THREAD_COUNT);
+
+	TEST_CHECK(RunThreads(testDevice, bindless, [&](uint32_t thread) {
+		std::mt19937 rng(thread);
+		for (int kind = 0; kind < KIND_COUNT; ++kind) {
+			std::vector<uint32_t> order(RESOURCE_COUNT);
+			std::iota(order.begin(), order.end(), 0);
+			std::shuffle(order.begin(), order.end(), rng);
+
+			threadHandles[thread][kind].resize(RESOURCE_COUNT);
+			for (uint32_t resource : order) {
+				threadHandles[thread][kind][resource] = Add(bindless, resources, (ResourceKind)kind, resource);
+			}
+		}
+		return true;
+	}));
+
+	const ThreadHandles& handles = threadHandles[0];
+	for (int kind = 0; kind < KIND_COUNT; ++kind) {
+		std::vector<uint32_t> indices;
+		for (uint32_t resource = 0; resource < RESOURCE_COUNT; ++resource) {
+			for (uint32_t thread = 1; thread < THREAD_COUNT; ++thread) {
+				TEST_CHECK(SameHandle(threadHandles[thread][kind][resource], handles[kind][resource]));
+			}
+			indices.push_back(handles[kind][resource].index);
+		}
+		std::sort(indices.begin(), indices.end());
+		TEST_CHECK(std::adjacent_find(indices.begin(), indices.end()) == indices.end());
+	}
+
+	//Nothing is being added now, so the tables are safe to read
+	for (uint32_t resource = 0; resource < RESOURCE_COUNT; ++resource) {
+		const MeshEntry& entry = bindless.GetMeshEntries()[handles[MeshKind][resource].index];
+		TEST_CHECK(entry.indexBufferOffset == resources.meshes[resource]->GetArenaAllocation().firstIndex * sizeof(uint32_t));
+		TEST_CHECK(entry.subMeshCount == 1);
+	}
+
+	TEST_CHECK(RunThreads(testDevice, bindless, [&](uint32_t thread) {
+		for (int kind = 0; kind < KIND_COUNT; ++kind) {
+			for (VKQuick::BindlessHandle handle : threadHandles[thread][kind]) {
+				Remove(bindless, (ResourceKind)kind, handle);
+			}
+		}
+		return true;
+	}));
+
+	//Had any reference been lost or left over, adding them again would give back the old handles
+	for (int kind = 0; kind < KIND_COUNT; ++kind) {
+		for (uint32_t resource = 0; resource < RESOURCE_COUNT; ++resource) {
+			VKQuick::BindlessHandle handle = Add(bindless, resources, (ResourceKind)kind, resource);
+			TEST_CHECK(!SameHandle(handle, handles[kind][resource]));
+			Remove(bindless, (ResourceKind)kind, handle);
+		}
+	}
+	return true;
+}
+
+int main() {
+	TestDevice device;
+	if (!device.IsValid()) {
+		return TEST_SKIPPED;
+	}
+	VKQuick::MemoryManager& memManager = device.GetMemoryManager();
+
+	bool passed = true;
+	{
+		VulkanUploadQueue	uploads(device.GetDevice(), device.GetQueue(), device.GetQueueFamily(), memManager);
+		VulkanMeshArena		arena(device.GetDevice(), memManager, VertexFormat::Full, 1024, 1024, 1 << VertexAttribute::Positions,
+			vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+
+		TestResources resources;
+		CreateResources(device, arena, uploads, resources);
+
+		{
+			//Small tables, so that they have to grow while the threads are adding to them
+			VKQuick::BindlessManager bindless(device.GetDevice(), device.GetDescriptorPool(), memManager, 256, 2, device.GetPhysicalDevice());
+
+			passed &= TestChurn(device, bindless, resources);
+			passed &= TestSharedAdds(device, bindless, resources);
+			device.GetDevice().waitIdle();
+		}
+		for (UniqueVulkanMesh& mesh : resources.meshes) {
+			arena.RemoveMesh(*mesh);
+		}
+		for (VKQuick::Buffer& buffer : resources.buffers) {
+			memManager.DiscardBuffer(buffer, VKQuick::DiscardMode::Immediate);
+		}
+	}
+	return passed ? 0 : 1;
+}
\ No newline at end of file
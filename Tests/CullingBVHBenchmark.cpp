@@ -0,0 +1,148 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "../CullingBVH.h"
+#include "../IndirectDrawGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+/*
+Times CullingBVH against testing every box in turn, at 10k, 100k and 1M
+objects. This isn't run as part of the tests, as the timings only mean
+something in an optimised build on a quiet machine.
+*/
+
+const uint32_t	CULL_REPEATS	= 20;
+const float		MOVED_FRACTION	= 0.01f;
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double MillisecondsSince(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+//Vulkan style, looking down -z from the origin
+static Matrix4 BuildProjection(float fov, float aspect, float nearPlane, float farPlane) {
+	float f = 1.0f / tanf(fov * 0.5f);
+
+	Matrix4 m;
+	m.array[0][0] = f / aspect;
+	m.array[1][1] = -f;
+	m.array[2][2] = farPlane / (nearPlane - farPlane);
+	m.array[2][3] = -1.0f;
+	m.array[3][2] = nearPlane * farPlane / (nearPlane - farPlane);
+	m.array[3][3] = 0.0f;
+	return m;
+}
+
+//Spread through a cube that grows with the count, so the same share of them is visible each time
+static BoundingBox RandomBox(std::mt19937& rng, float worldSize) {
+	std::uniform_real_distribution<float> position(-worldSize, worldSize);
+	std::uniform_real_distribution<float> size(0.5f, 4.0f);
+
+	Vector3 centre(position(rng), position(rng), position(rng));
+	Vector3 halfSize(size(rng), size(rng), size(rng));
+	return { centre - halfSize, centre + halfSize };
+}
+
+//The same test CullingBVH makes, one box at a time
+static void BruteForceCull(const std::vector<BoundingBox>& boxes, const Vector4 planes[6], std::vector<uint32_t>& visible) {
+	for (uint32_t i = 0; i < boxes.size(); ++i) {
+		const BoundingBox& box = boxes[i];
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p) {
+			Vector3 corner(
+				planes[p].x >= 0.0f ? box.max.x : box.min.x,
+				planes[p].y >= 0.0f ? box.max.y : box.min.y,
+				planes[p].z >= 0.0f ? box.max.z : box.min.z
+			);
+			//Summed in the same order, so both round alike
+			outside = (planes[p].x * corner.x + planes[p].y * corner.y) + (planes[p].z * corner.z + planes[p].w) < 0.0f;
+		}
+		if (!outside) {
+			visible.push_back(i);
+		}
+	}
+}
+
+static bool RunBenchmark(uint32_t objectCount) {
+	std::mt19937 rng(objectCount);
+	float worldSize = 10.0f * cbrtf((float)objectCount);
+
+	std::vector<BoundingBox> boxes(objectCount);
+	for (BoundingBox& box : boxes) {
+		box = RandomBox(rng, worldSize);
+	}
+
+	Vector4 planes[6];
+	IndirectDrawGenerator::ExtractFrustumPlanes(BuildProjection(1.0f, 16.0f / 9.0f, 0.1f, worldSize), planes);
+
+	CullingBVH bvh;
+	Clock::time_point start = Clock::now();
+	bvh.Build(boxes);
+	double buildTime = MillisecondsSince(start);
+
+	std::vector<uint32_t> bvhVisible;
+	start = Clock::now();
+	for (uint32_t i = 0; i < CULL_REPEATS; ++i) {
+		bvhVisible.clear();
+		bvh.Cull(planes, bvhVisible);
+	}
+	double bvhTime = MillisecondsSince(start) / CULL_REPEATS;
+
+	std::vector<uint32_t> bruteVisible;
+	start = Clock::now();
+	for (uint32_t i = 0; i < CULL_REPEATS; ++i) {
+		bruteVisible.clear();
+		BruteForceCull(boxes, planes, bruteVisible);
+	}
+	double bruteTime = MillisecondsSince(start) / CULL_REPEATS;
+
+	//Nudge some of them, as objects moving each frame would
+	std::uniform_int_distribution<uint32_t>	pick(0, objectCount - 1);
+	std::uniform_real_distribution<float>	nudge(-1.0f, 1.0f);
+	std::vector<uint32_t> moved((size_t)(objectCount * MOVED_FRACTION));
+	for (uint32_t& index : moved) {
+		index = pick(rng);
+		Vector3 offset(nudge(rng), nudge(rng), nudge(rng));
+		boxes[index] = { boxes[index].min + offset, boxes[index].max + offset };
+	}
+	start = Clock::now();
+	for (uint32_t index : moved) {
+		bvh.UpdateBox(index, boxes[index]);
+	}
+	bvh.Refit();
+	double refitTime = MillisecondsSince(start);
+
+	std::cout << objectCount << " objects, " << bvh.GetNodeCount() << " nodes, " << bvhVisible.size() << " visible\n";
+	std::cout << "\tBuild:       " << buildTime << "ms\n";
+	std::cout << "\tBVH cull:    " << bvhTime << "ms\n";
+	std::cout << "\tBrute force: " << bruteTime << "ms (" << bruteTime / bvhTime << "x)\n";
+	std::cout << "\tRefit " << moved.size() << " moved: " << refitTime << "ms\n";
+
+	//Both make the same test against each box, so must agree on exactly which are visible
+	std::sort(bvhVisible.begin(), bvhVisible.end());
+	if (bvhVisible != bruteVisible) {
+		std::cout << "\tBVH and brute force visible lists differ!\n";
+		return false;
+	}
+	return true;
+}
+
+int main() {
+	bool passed = RunBenchmark(10'000);
+	passed &= RunBenchmark(100'000);
+	passed &= RunBenchmark(1'000'000);
+	return passed ? 0 : 1;
+}
\ No newline at end of file
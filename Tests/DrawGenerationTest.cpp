@@ -0,0 +1,228 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "../IndirectDrawGenerator.h"
+#include "../BindlessManager.h"
+#include "../MappedFile.h"
+#include "../MeshletBuilder.h"
+#include "../VulkanMeshArena.h"
+#include "../VulkanUploadQueue.h"
+#include "TestDevice.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <random>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+const uint32_t INSTANCE_COUNT	= 4096;
+const uint32_t MAX_DRAWS		= INSTANCE_COUNT * 2;
+
+//Exposes the current frame's outputs, so that they can be copied back
+class TestDrawGenerator : public IndirectDrawGenerator {
+public:
+	using IndirectDrawGenerator::IndirectDrawGenerator;
+
+	const FrameResources& GetCurrentFrame() const {
+		return m_frames[m_currentFrame];
+	}
+};
+
+//A box split into two layers, its bottom and its top, so that each has its own bounds
+static UniqueVulkanMesh BuildBox(const Vector3& halfSize) {
+	VulkanMesh* mesh = new VulkanMesh();
+	std::vector<Vector3> positions;
+	for (int i = 0; i < 8; ++i) {
+		positions.push_back(Vector3(i & 1 ? halfSize.x : -halfSize.x, i & 2 ? halfSize.y : -halfSize.y, i & 4 ? halfSize.z : -halfSize.z));
+	}
+	mesh->SetVertexPositions(positions);
+	mesh->SetVertexIndices({
+		0, 1, 5,	0, 5, 4,	0, 4, 6,	0, 6, 2,	0, 2, 3,	0, 3, 1,	//Faces touching the bottom corner
+		7, 6, 4,	7, 4, 5,	7, 5, 1,	7, 1, 3,	7, 3, 2,	7, 2, 6		//Faces touching the top corner
+	});
+	mesh->AddSubMesh(0, 18, 0);
+	mesh->AddSubMesh(18, 18, 0);
+	mesh->SetDebugName("Test Box");
+	return UniqueVulkanMesh(mesh);
+}
+
+//Vulkan style, looking down -z
+static Matrix4 BuildProjection(float fov, float aspect, float nearPlane, float farPlane) {
+	float f = 1.0f / tanf(fov * 0.5f);
+
+	Matrix4 m;
+	m.array[0][0] = f / aspect;
+	m.array[1][1] = -f;
+	m.array[2][2] = farPlane / (nearPlane - farPlane);
+	m.array[2][3] = -1.0f;
+	m.array[3][2] = nearPlane * farPlane / (nearPlane - farPlane);
+	m.array[3][3] = 0.0f;
+	return m;
+}
+
+static std::vector<DrawInstance> BuildInstances(const std::vector<VKQuick::BindlessHandle>& meshes, const std::vector<Vector4>& meshBounds) {
+	std::mt19937 rng(5678);
+	std::uniform_real_distribution<float> across(-60.0f, 60.0f);
+	std::uniform_real_distribution<float> depth(-150.0f, 20.0f);
+	std::uniform_real_distribution<float> scale(0.25f, 3.0f);
+
+	std::vector<DrawInstance> instances(INSTANCE_COUNT);
+	for (DrawInstance& instance : instances) {
+		uint32_t mesh = rng() % meshes.size();
+
+		//Non-uniform scales, so the radius has to be scaled by the largest of them
+		instance.transform = Matrix4();
+		instance.transform.array[0][0] = scale(rng);
+		instance.transform.array[1][1] = scale(rng);
+		instance.transform.array[2][2] = scale(rng);
+		instance.transform.array[3][0] = across(rng);
+		instance.transform.array[3][1] = across(rng);
+		instance.transform.array[3][2] = depth(rng);
+
+		//Some are never culled, to check both sides agree on that too
+		instance.boundingSphere = rng() % 20 == 0 ? Vector4(0, 0, 0, -1) : meshBounds[mesh];
+		instance.meshIndex		= meshes[mesh].index;
+		instance.lod			= rng() % 3;
+	}
+	return instances;
+}
+
+static bool TestGPUMatchesReference(TestDevice& testDevice) {
+	vk::Device device = testDevice.GetDevice();
+	VKQuick::MemoryManager& memManager = testDevice.GetMemoryManager();
+
+	VulkanUploadQueue		uploads(device, testDevice.GetQueue(), testDevice.GetQueueFamily(), memManager);
+	VulkanMeshArena			arena(device, memManager, VertexFormat::Full, 1024, 1024, 1 << VertexAttribute::Positions,
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+	VKQuick::BindlessManager bindless(device, testDevice.GetDescriptorPool(), memManager, 64 * 1024, 1, testDevice.GetPhysicalDevice());
+
+	std::vector<UniqueVulkanMesh>			meshes;
+	std::vector<VKQuick::BindlessHandle>	handles;
+	std::vector<Vector4>					meshBounds;
+	for (int i = 0; i < 8; ++i) {
+		Vector3 halfSize(1.0f + i * 0.5f, 2.0f - i * 0.2f, 0.5f + i * 0.3f);
+		meshes.push_back(BuildBox(halfSize));
+		VulkanMesh& mesh = *meshes.back();
+		TEST_CHECK(arena.AddMesh(mesh, uploads));
+
+		VKQuick::BindlessHandle handle = bindless.AddArenaMesh(mesh, {});
+
+		//Meshlets give each layer its own bounds, which are culled as well
+		MeshletData meshlets;
+		mesh.BuildMeshlets(meshlets);
+		bindless.AddMeshlets(handle, meshlets);
+
+		//Half of them have a LOD for each layer, so instances pick one of them
+		if (i % 2 == 1) {
+			bindless.AddMeshLODs(handle, { 0.0f, 0.1f });
+		}
+		handles.push_back(handle);
+		meshBounds.push_back(Vector4(0, 0, 0, Vector::Length(halfSize)));
+	}
+	uploads.Flush();
+	uploads.WaitAll();
+	bindless.Flush();
+
+	std::vector<DrawInstance> instances = BuildInstances(handles, meshBounds);
+
+	Matrix4 viewProj = BuildProjection(1.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+
+	TestDrawGenerator generator(device, testDevice.GetDescriptorPool(), memManager, bindless, 1, INSTANCE_COUNT, MAX_DRAWS);
+	generator.SetInstances(instances);
+
+	VKQuick::Buffer commandsBack	= testDevice.CreateReadbackBuffer(sizeof(vk::DrawIndexedIndirectCommand) * MAX_DRAWS);
+	VKQuick::Buffer drawInfosBack	= testDevice.CreateReadbackBuffer(sizeof(DrawInfo) * MAX_DRAWS);
+	VKQuick::Buffer drawCountBack	= testDevice.CreateReadbackBuffer(sizeof(uint32_t));
+
+	testDevice.Submit([&](vk::CommandBuffer cmdBuffer) {
+		bindless.RecordUpdates(cmdBuffer);
+		generator.RecordGeneration(cmdBuffer, viewProj);
+
+		vk::MemoryBarrier2 readBarrier{
+			.srcStageMask	= vk::PipelineStageFlagBits2::eComputeShader,
+			.srcAccessMask	= vk::AccessFlagBits2::eShaderStorageWrite,
+			.dstStageMask	= vk::PipelineStageFlagBits2::eCopy,
+			.dstAccessMask	= vk::AccessFlagBits2::eTransferRead
+		};
+		cmdBuffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &readBarrier });
+
+		const auto& frame = generator.GetCurrentFrame();
+		cmdBuffer.copyBuffer(frame.commands.buffer,		commandsBack.buffer,	vk::BufferCopy{ .size = commandsBack.size });
+		cmdBuffer.copyBuffer(frame.drawInfos.buffer,	drawInfosBack.buffer,	vk::BufferCopy{ .size = drawInfosBack.size });
+		cmdBuffer.copyBuffer(frame.drawCount.buffer,	drawCountBack.buffer,	vk::BufferCopy{ .size = drawCountBack.size });
+
+		vk::MemoryBarrier2 hostBarrier{
+			.srcStageMask	= vk::PipelineStageFlagBits2::eCopy,
+			.srcAccessMask	= vk::AccessFlagBits2::eTransferWrite,
+			.dstStageMask	= vk::PipelineStageFlagBits2::eHost,
+			.dstAccessMask	= vk::AccessFlagBits2::eHostRead
+		};
+		cmdBuffer.pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &hostBarrier });
+	});
+
+	std::vector<vk::DrawIndexedIndirectCommand>	expectedCommands;
+	std::vector<DrawInfo>						expectedInfos;
+	IndirectDrawGenerator::GenerateReference(bindless, instances, viewProj, MAX_DRAWS, expectedCommands, expectedInfos);
+
+	uint32_t drawCount = *drawCountBack.Map<uint32_t>();
+	drawCountBack.Unmap();
+
+	//GPU draws come out in whatever order the invocations finish, so are sorted to match the reference
+	std::vector<std::pair<DrawInfo, vk::DrawIndexedIndirectCommand>> gpuDraws(std::min(drawCount, MAX_DRAWS));
+	const vk::DrawIndexedIndirectCommand*	gpuCommands = commandsBack.Map<vk::DrawIndexedIndirectCommand>();
+	const DrawInfo*							gpuInfos	= drawInfosBack.Map<DrawInfo>();
+	for (size_t i = 0; i < gpuDraws.size(); ++i) {
+		gpuDraws[i] = { gpuInfos[i], gpuCommands[i] };
+	}
+	commandsBack.Unmap();
+	drawInfosBack.Unmap();
+
+	std::sort(gpuDraws.begin(), gpuDraws.end(), [](const auto& a, const auto& b) {
+		return std::tie(a.first.instanceIndex, a.first.layerIndex) < std::tie(b.first.instanceIndex, b.first.layerIndex);
+	});
+
+	std::cout << "Draws generated: GPU " << drawCount << ", reference " << expectedCommands.size() << " of " << INSTANCE_COUNT << " instances\n";
+
+	for (VKQuick::Buffer* b : { &commandsBack, &drawInfosBack, &drawCountBack }) {
+		memManager.DiscardBuffer(*b, VKQuick::DiscardMode::Immediate);
+	}
+
+	//Some of the scene must be culled and some kept, or the comparison isn't testing much
+	TEST_CHECK(!expectedCommands.empty());
+	TEST_CHECK(expectedCommands.size() < INSTANCE_COUNT);
+
+	TEST_CHECK(drawCount == expectedCommands.size());
+	for (size_t i = 0; i < gpuDraws.size(); ++i) {
+		const DrawInfo&						info	= gpuDraws[i].first;
+		const vk::DrawIndexedIndirectCommand& command = gpuDraws[i].second;
+
+		TEST_CHECK(info.instanceIndex	== expectedInfos[i].instanceIndex);
+		TEST_CHECK(info.layerIndex		== expectedInfos[i].layerIndex);
+		TEST_CHECK(command.indexCount		== expectedCommands[i].indexCount);
+		TEST_CHECK(command.instanceCount	== expectedCommands[i].instanceCount);
+		TEST_CHECK(command.firstIndex		== expectedCommands[i].firstIndex);
+		TEST_CHECK(command.vertexOffset		== expectedCommands[i].vertexOffset);
+		TEST_CHECK(command.firstInstance	== expectedCommands[i].firstInstance);
+	}
+	return true;
+}
+
+int main() {
+	TestDevice device;
+	if (!device.IsValid()) {
+		return TEST_SKIPPED;
+	}
+	if (!MappedFile(Assets::SHADERDIR + "VK/DrawGeneration.comp.spv").IsValid()) {
+		std::cout << "DrawGeneration.comp.spv hasn't been compiled\n";
+		return TEST_SKIPPED;
+	}
+	bool passed = TestGPUMatchesReference(device);
+	return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,109 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "../MeshOptimiser.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <random>
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+const uint32_t GRID_SIZE = 64;	//In quads
+
+//A flat grid of quads, with its triangles shuffled into a fixed but poor order, as authoring tools often leave them
+static void BuildShuffledGrid(std::vector<uint32_t>& indices, std::vector<Vector3>& positions) {
+	for (uint32_t y = 0; y <= GRID_SIZE; ++y) {
+		for (uint32_t x = 0; x <= GRID_SIZE; ++x) {
+			positions.push_back(Vector3((float)x, 0.0f, (float)y));
+		}
+	}
+	std::vector<std::array<uint32_t, 3>> tris;
+	for (uint32_t y = 0; y < GRID_SIZE; ++y) {
+		for (uint32_t x = 0; x < GRID_SIZE; ++x) {
+			uint32_t a = y * (GRID_SIZE + 1) + x;
+			uint32_t b = a + GRID_SIZE + 1;
+			tris.push_back({ a, b, a + 1 });
+			tris.push_back({ a + 1, b, b + 1 });
+		}
+	}
+	std::mt19937 rng(1234);
+	std::shuffle(tris.begin(), tris.end(), rng);
+	for (const std::array<uint32_t, 3>& t : tris) {
+		indices.insert(indices.end(), t.begin(), t.end());
+	}
+}
+
+//Each triangle rotated to start at its smallest index, then sorted, so reorderings compare equal
+static std::vector<std::array<uint32_t, 3>> CanonicalTriangles(const std::vector<uint32_t>& indices) {
+	std::vector<std::array<uint32_t, 3>> tris;
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		std::array<uint32_t, 3> t = { indices[i], indices[i + 1], indices[i + 2] };
+		std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+		tris.push_back(t);
+	}
+	std::sort(tris.begin(), tris.end());
+	return tris;
+}
+
+static bool TestACMRCounting() {
+	std::vector<uint32_t> single	= { 0, 1, 2 };
+	std::vector<uint32_t> pair		= { 0, 1, 2, 2, 1, 3 };
+
+	TEST_CHECK(MeshOptimiser::CalculateACMR(single.data(), single.size(), 3) == 3.0f);
+	TEST_CHECK(MeshOptimiser::CalculateACMR(pair.data(), pair.size(), 4) == 2.0f);
+	return true;
+}
+
+static bool TestVertexCacheImprovesACMR() {
+	std::vector<uint32_t>	indices;
+	std::vector<Vector3>	positions;
+	BuildShuffledGrid(indices, positions);
+	std::vector<std::array<uint32_t, 3>> originalTris = CanonicalTriangles(indices);
+
+	float before = MeshOptimiser::CalculateACMR(indices.data(), indices.size(), positions.size());
+	MeshOptimiser::OptimiseVertexCache(indices.data(), indices.size(), positions.size());
+	float after = MeshOptimiser::CalculateACMR(indices.data(), indices.size(), positions.size());
+
+	std::cout << "Grid ACMR: shuffled " << before << ", cache optimised " << after << "\n";
+
+	//Triangles may be reordered and rotated, but never changed
+	TEST_CHECK(CanonicalTriangles(indices) == originalTris);
+	//A regular grid can't go below 0.5, and a 16 entry cache should get well within reach of it
+	TEST_CHECK(after < 0.8f);
+	TEST_CHECK(after < before * 0.5f);
+
+	//Sorting clusters for overdraw only breaks the order at cache flushes, so should barely change it
+	MeshOptimiser::OptimiseOverdraw(indices.data(), indices.size(), positions.data(), positions.size());
+	float overdrawn = MeshOptimiser::CalculateACMR(indices.data(), indices.size(), positions.size());
+
+	TEST_CHECK(CanonicalTriangles(indices) == originalTris);
+	TEST_CHECK(overdrawn < after * 1.1f);
+	return true;
+}
+
+static bool TestFetchRemap() {
+	std::vector<uint32_t> indices = { 3, 1, 4, 1, 4, 0 };
+	std::vector<uint32_t> remap;
+	MeshOptimiser::BuildFetchRemap(indices.data(), indices.size(), 6, remap);
+
+	//In order of first use, then the unused ones
+	std::vector<uint32_t> expected = { 3, 1, 4, 0, 2, 5 };
+	TEST_CHECK(remap == expected);
+	return true;
+}
+
+int main() {
+	bool passed = TestACMRCounting();
+	passed &= TestVertexCacheImprovesACMR();
+	passed &= TestFetchRemap();
+	return passed ? 0 : 1;
+}
\ No newline at end of file
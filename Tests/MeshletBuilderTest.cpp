@@ -0,0 +1,104 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "../MeshletBuilder.h"
+#include "TestUtils.h"
+
+using namespace NCL;
+using namespace Maths;
+using namespace Rendering;
+using namespace Vulkan;
+
+//A V shaped valley along z, with both faces looking in and up, so the cluster is concave
+static const std::vector<Vector3> VALLEY_POSITIONS = {
+	Vector3(-1, 1, -1), Vector3(-1, 1, 1),	//Top of the left face
+	Vector3( 0, 0,  1), Vector3( 0, 0, -1),	//Bottom of the valley
+	Vector3( 1, 1,  1), Vector3( 1, 1, -1)	//Top of the right face
+};
+static const std::vector<uint32_t> VALLEY_INDICES = {
+	0, 1, 2,	0, 2, 3,	//Left face, normal (1, 1, 0)
+	3, 2, 4,	3, 4, 5		//Right face, normal (-1, 1, 0)
+};
+
+//The test described alongside MeshletEntry
+static bool IsConeCulled(const MeshletEntry& meshlet, const Vector3& cameraPos) {
+	Vector3 apex(meshlet.coneApex.x, meshlet.coneApex.y, meshlet.coneApex.z);
+	Vector3 axis(meshlet.coneAxis.x, meshlet.coneAxis.y, meshlet.coneAxis.z);
+	return Vector::Dot(Vector::Normalise(apex - cameraPos), axis) >= meshlet.coneAxis.w;
+}
+
+static bool IsAnyTriangleFrontFacing(const Vector3& cameraPos) {
+	for (size_t i = 0; i < VALLEY_INDICES.size(); i += 3) {
+		const Vector3& p0 = VALLEY_POSITIONS[VALLEY_INDICES[i]];
+		const Vector3& p1 = VALLEY_POSITIONS[VALLEY_INDICES[i + 1]];
+		const Vector3& p2 = VALLEY_POSITIONS[VALLEY_INDICES[i + 2]];
+		if (Vector::Dot(cameraPos - p0, Vector::Cross(p1 - p0, p2 - p0)) > 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool TestConcaveClusterCone() {
+	MeshletData data;
+	MeshletBuilder::BuildMeshlets(data, VALLEY_INDICES.data(), VALLEY_INDICES.size(), 0, VALLEY_POSITIONS.data());
+	TEST_CHECK(data.meshlets.size() == 1);
+	const MeshletEntry& meshlet = data.meshlets[0];
+
+	//The faces are 90 degrees apart, which is narrow enough to have a cone at all
+	TEST_CHECK(meshlet.coneAxis.w <= 1.0f);
+
+	//Just outside the left face, and looking at its front, but within the cone around the bounding sphere centre
+	TEST_CHECK(IsAnyTriangleFrontFacing(Vector3(0.1f, 0.2f, 0.0f)));
+	TEST_CHECK(!IsConeCulled(meshlet, Vector3(0.1f, 0.2f, 0.0f)));
+
+	//Nowhere that can see the front of a triangle may cull the cluster
+	for (float x = -3.0f; x <= 3.0f; x += 0.113f) {
+		for (float y = -3.0f; y <= 3.0f; y += 0.113f) {
+			Vector3 cameraPos(x, y, 0.37f);
+			if (IsAnyTriangleFrontFacing(cameraPos)) {
+				TEST_CHECK(!IsConeCulled(meshlet, cameraPos));
+			}
+		}
+	}
+
+	//But from well below the valley, the cone should reject it
+	TEST_CHECK(!IsAnyTriangleFrontFacing(Vector3(0.0f, -5.0f, 0.0f)));
+	TEST_CHECK(IsConeCulled(meshlet, Vector3(0.0f, -5.0f, 0.0f)));
+	return true;
+}
+
+static bool TestMeshletLimits() {
+	//A strip of 300 triangles, which can't fit in one meshlet
+	std::vector<Vector3>	positions;
+	std::vector<uint32_t>	indices;
+	for (uint32_t i = 0; i < 302; ++i) {
+		positions.push_back(Vector3((float)(i / 2), (float)(i % 2), 0.0f));
+	}
+	for (uint32_t i = 0; i < 300; ++i) {
+		indices.insert(indices.end(), { i, i + 1 + (i % 2), i + 2 - (i % 2) });
+	}
+	MeshletData data;
+	MeshletBuilder::BuildMeshlets(data, indices.data(), indices.size(), 0, positions.data());
+	TEST_CHECK(data.subMeshRanges.size() == 1);
+	TEST_CHECK(data.subMeshRanges[0].meshletCount == data.meshlets.size());
+
+	uint32_t triangles = 0;
+	for (const MeshletEntry& m : data.meshlets) {
+		TEST_CHECK(m.vertexCount <= MeshletBuilder::MAX_VERTICES);
+		TEST_CHECK(m.triangleCount <= MeshletBuilder::MAX_TRIANGLES);
+		triangles += m.triangleCount;
+	}
+	TEST_CHECK(triangles == 300);
+	return true;
+}
+
+int main() {
+	bool passed = TestConcaveClusterCone();
+	passed &= TestMeshletLimits();
+	return passed ? 0 : 1;
+}
\ No newline at end of file
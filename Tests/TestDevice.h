@@ -0,0 +1,200 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "../../VKQuick/Instance.h"
+#include "../../VKQuick/VMAMemoryManager.h"
+
+/*
+A Vulkan 1.3 device without a window, for tests that need the GPU. If there
+is no device with the features the bindless tables need, IsValid is false,
+and the test should return TEST_SKIPPED.
+*/
+class TestDevice {
+public:
+	TestDevice() {
+		try {
+			Create();
+		}
+		//Thrown if there's no Vulkan loader, or creating the instance or device fails
+		catch (const std::exception& e) {
+			std::cout << "No Vulkan device to test with: " << e.what() << "\n";
+			m_device.reset();
+		}
+	}
+
+	~TestDevice() {
+		if (m_device) {
+			m_device->waitIdle();
+		}
+	}
+
+	bool IsValid() const {
+		return (bool)m_device;
+	}
+
+	vk::Device GetDevice() const {
+		return *m_device;
+	}
+
+	vk::PhysicalDevice GetPhysicalDevice() const {
+		return m_gpu;
+	}
+
+	vk::Queue GetQueue() const {
+		return m_queue;
+	}
+
+	uint32_t GetQueueFamily() const {
+		return m_queueFamily;
+	}
+
+	vk::DescriptorPool GetDescriptorPool() const {
+		return *m_descriptorPool;
+	}
+
+	VKQuick::MemoryManager& GetMemoryManager() {
+		return *m_memoryManager;
+	}
+
+	//Records into a one off command buffer, and waits for it to complete
+	void Submit(const std::function<void(vk::CommandBuffer)>& record) {
+		vk::UniqueCommandBuffer cmdBuffer = std::move(m_device->allocateCommandBuffersUnique({
+			.commandPool		= *m_commandPool,
+			.level				= vk::CommandBufferLevel::ePrimary,
+			.commandBufferCount = 1
+		})[0]);
+
+		cmdBuffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+		record(*cmdBuffer);
+		cmdBuffer->end();
+
+		vk::CommandBufferSubmitInfo cmdInfo{ .commandBuffer = *cmdBuffer };
+		m_queue.submit2(vk::SubmitInfo2{ .commandBufferInfoCount = 1, .pCommandBufferInfos = &cmdInfo });
+		m_queue.waitIdle();
+	}
+
+	//A host visible buffer to copy results into
+	VKQuick::Buffer CreateReadbackBuffer(size_t size) {
+		return m_memoryManager->CreateBuffer(
+			{
+				.size	= size,
+				.usage	= vk::BufferUsageFlagBits::eTransferDst
+			},
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			"Test Readback Buffer"
+		);
+	}
+
+protected:
+	void Create() {
+		m_loader = std::make_unique<vk::DynamicLoader>();
+		VULKAN_HPP_DEFAULT_DISPATCHER.init(m_loader->getProcAddress<PFN_vkGetInstanceProcAddr>("vkGetInstanceProcAddr"));
+
+		vk::ApplicationInfo appInfo{
+			.pApplicationName	= "VulkanRendering Tests",
+			.apiVersion			= VK_API_VERSION_1_3
+		};
+		m_instance = vk::createInstanceUnique({ .pApplicationInfo = &appInfo });
+		VULKAN_HPP_DEFAULT_DISPATCHER.init(*m_instance);
+
+		for (vk::PhysicalDevice gpu : m_instance->enumeratePhysicalDevices()) {
+			if (gpu.getProperties().apiVersion < VK_API_VERSION_1_3 || !HasFeatures(gpu)) {
+				continue;
+			}
+			std::vector<vk::QueueFamilyProperties> families = gpu.getQueueFamilyProperties();
+			for (uint32_t i = 0; i < families.size(); ++i) {
+				if (families[i].queueFlags & vk::QueueFlagBits::eGraphics) {
+					m_gpu			= gpu;
+					m_queueFamily	= i;
+					break;
+				}
+			}
+			if (m_gpu) {
+				break;
+			}
+		}
+		if (!m_gpu) {
+			std::cout << "No Vulkan 1.3 device with bindless support to test with\n";
+			return;
+		}
+
+		vk::PhysicalDeviceVulkan13Features features13{
+			.synchronization2	= true
+		};
+		vk::PhysicalDeviceVulkan12Features features12{
+			.pNext											= &features13,
+			.drawIndirectCount								= true,
+			.descriptorIndexing								= true,
+			.shaderSampledImageArrayNonUniformIndexing		= true,
+			.descriptorBindingSampledImageUpdateAfterBind	= true,
+			.descriptorBindingStorageBufferUpdateAfterBind	= true,
+			.descriptorBindingPartiallyBound				= true,
+			.descriptorBindingVariableDescriptorCount		= true,
+			.runtimeDescriptorArray							= true,
+			.timelineSemaphore								= true,
+			.bufferDeviceAddress							= true
+		};
+		float priority = 1.0f;
+		vk::DeviceQueueCreateInfo queueInfo{
+			.queueFamilyIndex	= m_queueFamily,
+			.queueCount			= 1,
+			.pQueuePriorities	= &priority
+		};
+		m_device = m_gpu.createDeviceUnique({
+			.pNext					= &features12,
+			.queueCreateInfoCount	= 1,
+			.pQueueCreateInfos		= &queueInfo
+		});
+		VULKAN_HPP_DEFAULT_DISPATCHER.init(*m_device);
+
+		m_queue = m_device->getQueue(m_queueFamily, 0);
+
+		m_commandPool = m_device->createCommandPoolUnique({ .queueFamilyIndex = m_queueFamily });
+
+		vk::DescriptorPoolSize poolSizes[] = {
+			{ .type = vk::DescriptorType::eStorageBuffer,			.descriptorCount = 256 },
+			{ .type = vk::DescriptorType::eCombinedImageSampler,	.descriptorCount = 4096 }
+		};
+		m_descriptorPool = m_device->createDescriptorPoolUnique({
+			.flags			= vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+			.maxSets		= 32,
+			.poolSizeCount	= (uint32_t)std::size(poolSizes),
+			.pPoolSizes		= poolSizes
+		});
+
+		m_vkInit.majorVersion = 1;
+		m_vkInit.minorVersion = 3;
+		m_memoryManager = std::make_unique<VKQuick::VMAMemoryManager>(*m_device, m_gpu, *m_instance, m_vkInit);
+	}
+
+	static bool HasFeatures(vk::PhysicalDevice gpu) {
+		auto features = gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features, vk::PhysicalDeviceVulkan13Features>();
+		const vk::PhysicalDeviceVulkan12Features& f12 = features.get<vk::PhysicalDeviceVulkan12Features>();
+		const vk::PhysicalDeviceVulkan13Features& f13 = features.get<vk::PhysicalDeviceVulkan13Features>();
+
+		return f12.drawIndirectCount && f12.descriptorIndexing && f12.shaderSampledImageArrayNonUniformIndexing
+			&& f12.descriptorBindingSampledImageUpdateAfterBind && f12.descriptorBindingStorageBufferUpdateAfterBind
+			&& f12.descriptorBindingPartiallyBound && f12.descriptorBindingVariableDescriptorCount && f12.runtimeDescriptorArray
+			&& f12.timelineSemaphore && f12.bufferDeviceAddress && f13.synchronization2;
+	}
+
+	std::unique_ptr<vk::DynamicLoader>	m_loader;
+
+	VKQuick::VKQuickInitialisation	m_vkInit;
+
+	vk::UniqueInstance		m_instance;
+	vk::PhysicalDevice		m_gpu;
+	vk::UniqueDevice		m_device;
+	vk::Queue				m_queue;
+	uint32_t				m_queueFamily = 0;
+
+	vk::UniqueCommandPool		m_commandPool;
+	vk::UniqueDescriptorPool	m_descriptorPool;
+
+	std::unique_ptr<VKQuick::VMAMemoryManager>	m_memoryManager;
+};
\ No newline at end of file
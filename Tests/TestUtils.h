@@ -0,0 +1,19 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+//Reports the failed condition and returns false from the enclosing test function
+#define TEST_CHECK(condition) \
+	if (!(condition)) { \
+		std::cout << __FILE__ << "(" << __LINE__ << "): check failed: " << #condition << "\n"; \
+		return false; \
+	}
+
+//Returned from main by tests that can't run on this machine, such as without a Vulkan device.
+//CTest reports them as skipped rather than failed.
+const int TEST_SKIPPED = 77;
\ No newline at end of file
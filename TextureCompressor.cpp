@@ -0,0 +1,635 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "TextureCompressor.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cfloat>
+
+//SSE2 is always there on x64, anything else falls back to searching the palettes one texel at a time
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_COMPRESSOR_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+//Mips are made from linear floating point texels, so rounding errors don't build up down the chain
+struct FloatImage {
+	uint32_t			width;
+	uint32_t			height;
+	std::vector<float>	texels;
+};
+
+struct FilterTap {
+	uint32_t	index;
+	float		weight;
+};
+
+const float KAISER_WIDTH	= 3.0f;	//In destination texels
+const float KAISER_ALPHA	= 4.0f;
+const float FILTER_PI		= 3.14159265358979f;
+
+static float SRGBToLinear(float c) {
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSRGB(float c) {
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static uint8_t ToByte(float c) {
+	return (uint8_t)(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static float BesselI0(float x) {
+	float sum	= 1.0f;
+	float term	= 1.0f;
+	for (int k = 1; k < 20; ++k) {
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static float KaiserSinc(float x) {
+	if (fabsf(x) >= KAISER_WIDTH) {
+		return 0.0f;
+	}
+	float sinc	= x == 0.0f ? 1.0f : sinf(FILTER_PI * x) / (FILTER_PI * x);
+	float t		= x / KAISER_WIDTH;
+	return sinc * BesselI0(KAISER_ALPHA * sqrtf(1.0f - t * t)) / BesselI0(KAISER_ALPHA);
+}
+
+//Which source texels make up each destination texel, when shrinking a row of srcSize down to dstSize
+static std::vector<std::vector<FilterTap>> BuildFilter(uint32_t srcSize, uint32_t dstSize, MipFilter filter) {
+	std::vector<std::vector<FilterTap>> taps(dstSize);
+	float scale = (float)srcSize / dstSize;
+
+	for (uint32_t i = 0; i < dstSize; ++i) {
+		if (filter == MipFilter::Box || srcSize == dstSize) {
+			uint32_t first	= (uint32_t)(i * scale);
+			uint32_t last	= std::max(first + 1, std::min(srcSize, (uint32_t)((i + 1) * scale)));
+			for (uint32_t s = first; s < last; ++s) {
+				taps[i].push_back({ s, 1.0f / (last - first) });
+			}
+			continue;
+		}
+		float centre	= (i + 0.5f) * scale - 0.5f;
+		int first		= (int)floorf(centre - KAISER_WIDTH * scale);
+		int last		= (int)ceilf(centre + KAISER_WIDTH * scale);
+		float total		= 0.0f;
+		for (int s = first; s <= last; ++s) {
+			float weight = KaiserSinc((s - centre) / scale);
+			if (weight == 0.0f) {
+				continue;
+			}
+			taps[i].push_back({ (uint32_t)std::clamp(s, 0, (int)srcSize - 1), weight });
+			total += weight;
+		}
+		for (FilterTap& t : taps[i]) {
+			t.weight /= total;
+		}
+	}
+	return taps;
+}
+
+//Separable, so filter the rows first and then the columns of the result
+static FloatImage Downsample(const FloatImage& src, MipFilter filter) {
+	FloatImage dst{ std::max(1u, src.width / 2), std::max(1u, src.height / 2) };
+
+	auto xTaps = BuildFilter(src.width	, dst.width	, filter);
+	auto yTaps = BuildFilter(src.height	, dst.height, filter);
+
+	std::vector<float> rows((size_t)dst.width * src.height * 4, 0.0f);
+	for (uint32_t y = 0; y < src.height; ++y) {
+		for (uint32_t x = 0; x < dst.width; ++x) {
+			float* out = &rows[((size_t)y * dst.width + x) * 4];
+			for (const FilterTap& t : xTaps[x]) {
+				const float* in = &src.texels[((size_t)y * src.width + t.index) * 4];
+				for (int c = 0; c < 4; ++c) {
+					out[c] += in[c] * t.weight;
+				}
+			}
+		}
+	}
+	dst.texels.resize((size_t)dst.width * dst.height * 4, 0.0f);
+	for (uint32_t y = 0; y < dst.height; ++y) {
+		for (uint32_t x = 0; x < dst.width; ++x) {
+			float* out = &dst.texels[((size_t)y * dst.width + x) * 4];
+			for (const FilterTap& t : yTaps[y]) {
+				const float* in = &rows[((size_t)t.index * dst.width + x) * 4];
+				for (int c = 0; c < 4; ++c) {
+					out[c] += in[c] * t.weight;
+				}
+			}
+		}
+	}
+	return dst;
+}
+
+//Texels of a block as floats in the range 0 - 255, always 4 channels apart
+static void ToFloatBlock(const uint8_t* texels, float* block) {
+	for (int i = 0; i < 64; ++i) {
+		block[i] = texels[i];
+	}
+}
+
+//Principal axis of the texels, found by power iteration, and trimmed to the texels' extents along it
+static void FitLine(const float* texels, int channels, float* start, float* end) {
+	float mean[4]	= {};
+	float lo[4]		= { 255.0f, 255.0f, 255.0f, 255.0f };
+	float hi[4]		= {};
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < channels; ++c) {
+			mean[c] += texels[i * 4 + c] / 16.0f;
+			lo[c] = std::min(lo[c], texels[i * 4 + c]);
+			hi[c] = std::max(hi[c], texels[i * 4 + c]);
+		}
+	}
+	float cov[4][4] = {};
+	for (int i = 0; i < 16; ++i) {
+		for (int a = 0; a < channels; ++a) {
+			for (int b = 0; b < channels; ++b) {
+				cov[a][b] += (texels[i * 4 + a] - mean[a]) * (texels[i * 4 + b] - mean[b]);
+			}
+		}
+	}
+	float axis[4] = {};
+	for (int c = 0; c < channels; ++c) {
+		axis[c] = hi[c] - lo[c];
+	}
+	for (int iteration = 0; iteration < 8; ++iteration) {
+		float next[4]	= {};
+		float largest	= 0.0f;
+		for (int a = 0; a < channels; ++a) {
+			for (int b = 0; b < channels; ++b) {
+				next[a] += cov[a][b] * axis[b];
+			}
+			largest = std::max(largest, fabsf(next[a]));
+		}
+		if (largest == 0.0f) {
+			break;
+		}
+		for (int c = 0; c < channels; ++c) {
+			axis[c] = next[c] / largest;
+		}
+	}
+	float length = 0.0f;
+	for (int c = 0; c < channels; ++c) {
+		length += axis[c] * axis[c];
+	}
+	length = sqrtf(length);
+
+	float tMin = 0.0f;
+	float tMax = 0.0f;
+	if (length > 0.0f) {
+		for (int c = 0; c < channels; ++c) {
+			axis[c] /= length;
+		}
+		tMin = FLT_MAX;
+		tMax = -FLT_MAX;
+		for (int i = 0; i < 16; ++i) {
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c) {
+				t += (texels[i * 4 + c] - mean[c]) * axis[c];
+			}
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+	}
+	for (int c = 0; c < channels; ++c) {
+		start[c]	= std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+		end[c]		= std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+	}
+}
+
+//Least squares endpoints for texels made by blending start to end by each texel's weight
+static bool SolveEndpoints(const float* texels, int channels, const float* weights, float* start, float* end) {
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = {};
+	float bx[4] = {};
+	for (int i = 0; i < 16; ++i) {
+		float a = 1.0f - weights[i];
+		float b = weights[i];
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < channels; ++c) {
+			ax[c] += a * texels[i * 4 + c];
+			bx[c] += b * texels[i * 4 + c];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f) {
+		return false; //Every texel picked the same palette entry
+	}
+	for (int c = 0; c < channels; ++c) {
+		start[c]	= std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+		end[c]		= std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+//For each of a block's 16 texels, the palette entry with the smallest squared distance over the
+//first channels, and that distance. Ties go to the earliest entry, whichever path is taken.
+static void FindNearestEntries(const float* texels, int channels, const float (*palette)[4], int paletteSize, float* errors, uint32_t* nearest) {
+#ifdef TEXTURE_COMPRESSOR_SSE
+	//4 texels at a time, transposed so that each register holds one channel of all four
+	for (int i = 0; i < 16; i += 4) {
+		__m128 t0 = _mm_loadu_ps(&texels[i * 4]);
+		__m128 t1 = _mm_loadu_ps(&texels[i * 4 + 4]);
+		__m128 t2 = _mm_loadu_ps(&texels[i * 4 + 8]);
+		__m128 t3 = _mm_loadu_ps(&texels[i * 4 + 12]);
+		_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+		const __m128 channel[4] = { t0, t1, t2, t3 };
+
+		__m128	bestError	= _mm_set1_ps(FLT_MAX);
+		__m128i	best		= _mm_setzero_si128();
+		for (int p = 0; p < paletteSize; ++p) {
+			__m128 d = _mm_setzero_ps();
+			for (int c = 0; c < channels; ++c) {
+				__m128 diff = _mm_sub_ps(channel[c], _mm_set1_ps(palette[p][c]));
+				d = _mm_add_ps(d, _mm_mul_ps(diff, diff));
+			}
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, bestError));
+			bestError	= _mm_min_ps(d, bestError);
+			best		= _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, best));
+		}
+		_mm_storeu_ps(&errors[i], bestError);
+		_mm_storeu_si128((__m128i*)&nearest[i], best);
+	}
+#else
+	for (int i = 0; i < 16; ++i) {
+		errors[i]	= FLT_MAX;
+		nearest[i]	= 0;
+		for (int p = 0; p < paletteSize; ++p) {
+			float d = 0.0f;
+			for (int c = 0; c < channels; ++c) {
+				d += (texels[i * 4 + c] - palette[p][c]) * (texels[i * 4 + c] - palette[p][c]);
+			}
+			if (d < errors[i]) {
+				errors[i]	= d;
+				nearest[i]	= p;
+			}
+		}
+	}
+#endif
+}
+
+//As FindNearestEntries, for a single channel 8 entry palette, by absolute difference
+static void FindNearestValues(const float* values, const float* palette, uint32_t* nearest) {
+#ifdef TEXTURE_COMPRESSOR_SSE
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	for (int i = 0; i < 16; i += 4) {
+		__m128	v			= _mm_loadu_ps(&values[i]);
+		__m128	bestError	= _mm_set1_ps(FLT_MAX);
+		__m128i	best		= _mm_setzero_si128();
+		for (int p = 0; p < 8; ++p) {
+			__m128	e		= _mm_and_ps(_mm_sub_ps(_mm_set1_ps(palette[p]), v), absMask);
+			__m128i	closer	= _mm_castps_si128(_mm_cmplt_ps(e, bestError));
+			bestError	= _mm_min_ps(e, bestError);
+			best		= _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, best));
+		}
+		_mm_storeu_si128((__m128i*)&nearest[i], best);
+	}
+#else
+	for (int i = 0; i < 16; ++i) {
+		float bestError = FLT_MAX;
+		nearest[i] = 0;
+		for (int p = 0; p < 8; ++p) {
+			float e = fabsf(palette[p] - values[i]);
+			if (e < bestError) {
+				bestError	= e;
+				nearest[i]	= p;
+			}
+		}
+	}
+#endif
+}
+
+static uint16_t To565(const float* c) {
+	uint32_t r = (uint32_t)(c[0] * 31.0f / 255.0f + 0.5f);
+	uint32_t g = (uint32_t)(c[1] * 63.0f / 255.0f + 0.5f);
+	uint32_t b = (uint32_t)(c[2] * 31.0f / 255.0f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void From565(uint16_t v, float* c) {
+	uint32_t r = (v >> 11) & 31;
+	uint32_t g = (v >> 5) & 63;
+	uint32_t b = v & 31;
+	c[0] = (float)((r << 3) | (r >> 2));
+	c[1] = (float)((g << 2) | (g >> 4));
+	c[2] = (float)((b << 3) | (b >> 2));
+}
+
+//How far each BC1 palette entry is from the first endpoint to the second
+const float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+//Picks the closest palette entry for each texel, returning the total error. The endpoints
+//are put in descending order, which is what selects the 4 colour mode for BC1.
+static float FindColourIndices(const float* texels, uint16_t& c0, uint16_t& c1, uint32_t& indices) {
+	if (c0 < c1) {
+		std::swap(c0, c1);
+	}
+	indices = 0;
+	float palette[4][4] = {};
+	From565(c0, palette[0]);
+	From565(c1, palette[1]);
+	for (int c = 0; c < 3; ++c) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+	int paletteSize = c0 == c1 ? 1 : 4;
+
+	float		errors[16];
+	uint32_t	nearest[16];
+	FindNearestEntries(texels, 3, palette, paletteSize, errors, nearest);
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; ++i) {
+		indices |= nearest[i] << (i * 2);
+		error += errors[i];
+	}
+	return error;
+}
+
+static void EncodeColour(const float* texels, uint8_t* dst) {
+	float start[4];
+	float end[4];
+	FitLine(texels, 3, start, end);
+
+	uint16_t c0 = To565(end);
+	uint16_t c1 = To565(start);
+	uint32_t indices;
+	float error = FindColourIndices(texels, c0, c1, indices);
+
+	//One round of refinement, using the indices of the first fit
+	float weights[16];
+	for (int i = 0; i < 16; ++i) {
+		weights[i] = BC1_WEIGHTS[(indices >> (i * 2)) & 3];
+	}
+	if (SolveEndpoints(texels, 3, weights, start, end)) {
+		uint16_t newC0 = To565(start);
+		uint16_t newC1 = To565(end);
+		uint32_t newIndices;
+		float newError = FindColourIndices(texels, newC0, newC1, newIndices);
+		if (newError < error) {
+			c0		= newC0;
+			c1		= newC1;
+			indices = newIndices;
+		}
+	}
+	memcpy(dst		, &c0, 2);
+	memcpy(dst + 2	, &c1, 2);
+	memcpy(dst + 4	, &indices, 4);
+}
+
+//BC4 block for one channel, using the 8 value palette between the channel's extents
+static void EncodeChannel(const uint8_t* texels, int channel, uint8_t* dst) {
+	uint8_t lo = 255;
+	uint8_t hi = 0;
+	for (int i = 0; i < 16; ++i) {
+		lo = std::min(lo, texels[i * 4 + channel]);
+		hi = std::max(hi, texels[i * 4 + channel]);
+	}
+	dst[0] = hi;
+	dst[1] = lo;
+
+	uint64_t bits = 0;
+	if (hi > lo) {
+		float palette[8] = { (float)hi, (float)lo };
+		for (int p = 2; p < 8; ++p) {
+			palette[p] = ((8 - p) * hi + (p - 1) * lo) / 7.0f;
+		}
+		float values[16];
+		for (int i = 0; i < 16; ++i) {
+			values[i] = texels[i * 4 + channel];
+		}
+		uint32_t nearest[16];
+		FindNearestValues(values, palette, nearest);
+		for (int i = 0; i < 16; ++i) {
+			bits |= (uint64_t)nearest[i] << (i * 3);
+		}
+	}
+	memcpy(dst + 2, &bits, 6);
+}
+
+const uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+//Mode 6 endpoints are 7 bits per channel, plus a low bit shared by all channels of the endpoint
+static void QuantiseBC7(const float* c, uint8_t* out) {
+	float bestError = FLT_MAX;
+	for (uint32_t p = 0; p < 2; ++p) {
+		uint8_t	q[4];
+		float	error = 0.0f;
+		for (int ch = 0; ch < 4; ++ch) {
+			int v = std::clamp((int)((c[ch] - p) * 0.5f + 0.5f), 0, 127);
+			q[ch] = (uint8_t)((v << 1) | p);
+			error += (q[ch] - c[ch]) * (q[ch] - c[ch]);
+		}
+		if (error < bestError) {
+			bestError = error;
+			memcpy(out, q, 4);
+		}
+	}
+}
+
+static float FindBC7Indices(const float* texels, const uint8_t endpoints[2][4], uint8_t* indices) {
+	float palette[16][4];
+	for (int p = 0; p < 16; ++p) {
+		for (int c = 0; c < 4; ++c) {
+			palette[p][c] = (float)(((64 - BC7_WEIGHTS[p]) * endpoints[0][c] + BC7_WEIGHTS[p] * endpoints[1][c] + 32) >> 6);
+		}
+	}
+	float		errors[16];
+	uint32_t	nearest[16];
+	FindNearestEntries(texels, 4, palette, 16, errors, nearest);
+
+	float error = 0.0f;
+	for (int i = 0; i < 16; ++i) {
+		indices[i] = (uint8_t)nearest[i];
+		error += errors[i];
+	}
+	return error;
+}
+
+struct BitWriter {
+	uint8_t*	dst;
+	uint32_t	pos = 0;
+
+	void Write(uint32_t value, uint32_t bits) {
+		for (uint32_t b = 0; b < bits; ++b, ++pos) {
+			if ((value >> b) & 1) {
+				dst[pos >> 3] |= (uint8_t)(1 << (pos & 7));
+			}
+		}
+	}
+};
+
+void TextureCompressor::EncodeBC1(const uint8_t* texels, uint8_t* dst) {
+	float block[64];
+	ToFloatBlock(texels, block);
+	EncodeColour(block, dst);
+}
+
+void TextureCompressor::EncodeBC3(const uint8_t* texels, uint8_t* dst) {
+	float block[64];
+	ToFloatBlock(texels, block);
+	EncodeChannel(texels, 3, dst);
+	EncodeColour(block, dst + 8);
+}
+
+void TextureCompressor::EncodeBC5(const uint8_t* texels, uint8_t* dst) {
+	EncodeChannel(texels, 0, dst);
+	EncodeChannel(texels, 1, dst + 8);
+}
+
+//Always mode 6 - a single RGBA line with 16 steps along it
+void TextureCompressor::EncodeBC7(const uint8_t* texels, uint8_t* dst) {
+	float block[64];
+	ToFloatBlock(texels, block);
+
+	float start[4];
+	float end[4];
+	FitLine(block, 4, start, end);
+
+	uint8_t endpoints[2][4];
+	uint8_t indices[16];
+	QuantiseBC7(start	, endpoints[0]);
+	QuantiseBC7(end		, endpoints[1]);
+	float error = FindBC7Indices(block, endpoints, indices);
+
+	float weights[16];
+	for (int i = 0; i < 16; ++i) {
+		weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+	}
+	if (SolveEndpoints(block, 4, weights, start, end)) {
+		uint8_t newEndpoints[2][4];
+		uint8_t newIndices[16];
+		QuantiseBC7(start	, newEndpoints[0]);
+		QuantiseBC7(end		, newEndpoints[1]);
+		float newError = FindBC7Indices(block, newEndpoints, newIndices);
+		if (newError < error) {
+			memcpy(endpoints, newEndpoints, sizeof(endpoints));
+			memcpy(indices, newIndices, sizeof(indices));
+		}
+	}
+	//The first texel's index has its top bit left out, so it must be in the lower half of the palette
+	if (indices[0] & 8) {
+		std::swap(endpoints[0], endpoints[1]);
+		for (uint8_t& i : indices) {
+			i = 15 - i;
+		}
+	}
+	memset(dst, 0, 16);
+	BitWriter writer{ dst };
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; ++c) {
+		writer.Write(endpoints[0][c] >> 1, 7);
+		writer.Write(endpoints[1][c] >> 1, 7);
+	}
+	writer.Write(endpoints[0][0] & 1, 1);
+	writer.Write(endpoints[1][0] & 1, 1);
+	for (int i = 0; i < 16; ++i) {
+		writer.Write(indices[i], i == 0 ? 3 : 4);
+	}
+}
+
+vk::Format TextureCompressor::GetFormat(BlockFormat format, bool srgb) {
+	switch (format) {
+		case BlockFormat::BC1: return srgb ? vk::Format::eBc1RgbaSrgbBlock	: vk::Format::eBc1RgbaUnormBlock;
+		case BlockFormat::BC3: return srgb ? vk::Format::eBc3SrgbBlock		: vk::Format::eBc3UnormBlock;
+		case BlockFormat::BC5: return vk::Format::eBc5UnormBlock;
+		case BlockFormat::BC7: return srgb ? vk::Format::eBc7SrgbBlock		: vk::Format::eBc7UnormBlock;
+	}
+	return vk::Format::eUndefined;
+}
+
+uint32_t TextureCompressor::GetBlockBytes(BlockFormat format) {
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+void TextureCompressor::Compress(CompressedTexture& dst, const uint8_t* rgba, uint32_t width, uint32_t height,
+	BlockFormat format, bool srgb, MipFilter filter, JobSystem* jobs) {
+	srgb = srgb && format != BlockFormat::BC5;
+
+	dst.format	= GetFormat(format, srgb);
+	dst.width	= width;
+	dst.height	= height;
+	dst.levels.clear();
+	dst.data.clear();
+
+	auto encode = format == BlockFormat::BC1 ? EncodeBC1 :
+				  format == BlockFormat::BC3 ? EncodeBC3 :
+				  format == BlockFormat::BC5 ? EncodeBC5 : EncodeBC7;
+	uint32_t blockBytes = GetBlockBytes(format);
+
+	float toLinear[256];
+	for (int i = 0; i < 256; ++i) {
+		toLinear[i] = srgb ? SRGBToLinear(i / 255.0f) : i / 255.0f;
+	}
+	FloatImage level{ width, height };
+	level.texels.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < level.texels.size(); ++i) {
+		level.texels[i] = (i & 3) == 3 ? rgba[i] / 255.0f : toLinear[rgba[i]];
+	}
+
+	std::vector<uint8_t> texels;
+	while (true) {
+		//Back to 8 bits, in the texture's own colour space
+		texels.resize((size_t)level.width * level.height * 4);
+		for (size_t i = 0; i < texels.size(); ++i) {
+			float v = level.texels[i];
+			texels[i] = ToByte(((i & 3) != 3 && srgb) ? LinearToSRGB(v) : v);
+		}
+		uint32_t blocksX = (level.width	+ 3) / 4;
+		uint32_t blocksY = (level.height + 3) / 4;
+
+		TextureLevel info = {
+			.offset = dst.data.size(),
+			.size	= (size_t)blocksX * blocksY * blockBytes,
+			.width	= level.width,
+			.height = level.height
+		};
+		dst.data.resize(info.offset + info.size);
+		uint8_t* out = (uint8_t*)dst.data.data() + info.offset;
+
+		//Blocks hanging off the edge of the level repeat its last row and column
+		auto encodeRow = [&](uint32_t by) {
+			uint8_t block[64];
+			for (uint32_t bx = 0; bx < blocksX; ++bx) {
+				for (uint32_t y = 0; y < 4; ++y) {
+					for (uint32_t x = 0; x < 4; ++x) {
+						uint32_t sx = std::min(bx * 4 + x, level.width	- 1);
+						uint32_t sy = std::min(by * 4 + y, level.height - 1);
+						memcpy(&block[(y * 4 + x) * 4], &texels[((size_t)sy * level.width + sx) * 4], 4);
+					}
+				}
+				encode(block, out + ((size_t)by * blocksX + bx) * blockBytes);
+			}
+		};
+		if (jobs) {
+			jobs->ParallelFor(blocksY, encodeRow);
+		}
+		else {
+			for (uint32_t by = 0; by < blocksY; ++by) {
+				encodeRow(by);
+			}
+		}
+		dst.levels.push_back(info);
+
+		if (level.width == 1 && level.height == 1) {
+			break;
+		}
+		level = Downsample(level, filter);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+
+namespace NCL::Rendering::Vulkan {
+	class JobSystem;
+
+	enum class BlockFormat {
+		BC1,	//RGB at 4 bits per texel
+		BC3,	//RGBA at 8 bits per texel, with smooth alpha
+		BC5,	//RG at 8 bits per texel, for tangent space normal maps
+		BC7,	//RGBA at 8 bits per texel, at a much higher quality than BC1 / BC3
+	};
+
+	enum class MipFilter {
+		Box,
+		Kaiser,	//Windowed sinc, keeps detail in the smaller mips that a box filter blurs away
+	};
+
+	struct TextureLevel {
+		size_t		offset;
+		size_t		size;
+		uint32_t	width;
+		uint32_t	height;
+	};
+
+	//Every mip level of a texture, in one allocation, largest level first
+	struct CompressedTexture {
+		vk::Format					format	= vk::Format::eUndefined;
+		uint32_t					width	= 0;
+		uint32_t					height	= 0;
+		std::vector<TextureLevel>	levels;
+		std::vector<char>			data;
+	};
+
+	class TextureCompressor {
+	public:
+		//Builds a full mip chain from 8 bit RGBA texels, and block compresses every level of it.
+		//Filtering is done in linear space when srgb is set. Blocks are encoded in parallel if jobs is set.
+		static void Compress(CompressedTexture& dst, const uint8_t* rgba, uint32_t width, uint32_t height,
+			BlockFormat format, bool srgb, MipFilter filter = MipFilter::Kaiser, JobSystem* jobs = nullptr);
+
+		static vk::Format	GetFormat(BlockFormat format, bool srgb);
+		static uint32_t		GetBlockBytes(BlockFormat format);
+
+		//Each takes a 4x4 block of RGBA texels, in rows
+		static void EncodeBC1(const uint8_t* texels, uint8_t* dst);
+		static void EncodeBC3(const uint8_t* texels, uint8_t* dst);
+		static void EncodeBC5(const uint8_t* texels, uint8_t* dst);
+		static void EncodeBC7(const uint8_t* texels, uint8_t* dst);
+	};
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "TextureStreamer.h"
+
+#include "../VKQuick/MemoryManager.h"
+#include "../VKQuick/TextureBuilder.h"
+
+#include <algorithm>
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+//Mips this size and smaller are always resident
+const uint32_t MIN_RESIDENT_SIZE = 64;
+
+TextureStreamer::TextureStreamer(vk::Device device, VKQuick::MemoryManager& memManager, VulkanUploadQueue& uploadQueue, VKQuick::BindlessManager& bindless,
+	uint32_t framesInFlight, size_t memoryBudget, size_t uploadBudget)
+	: m_device(device), m_memoryManager(memManager), m_uploadQueue(uploadQueue), m_bindless(bindless),
+	m_framesInFlight(framesInFlight), m_memoryBudget(memoryBudget), m_uploadBudget(uploadBudget) {
+}
+
+uint32_t TextureStreamer::AddTexture(CompressedTexture&& texture, vk::Sampler sampler, const std::string& debugName) {
+	assert(!texture.levels.empty());
+
+	auto t = std::make_unique<StreamedTexture>();
+	t->data			= std::move(texture);
+	t->sampler		= sampler;
+	t->debugName	= debugName;
+
+	const std::vector<TextureLevel>& levels = t->data.levels;
+	t->lowestLevel = (uint32_t)levels.size() - 1;
+	while (t->lowestLevel > 0 && std::max(levels[t->lowestLevel - 1].width, levels[t->lowestLevel - 1].height) <= MIN_RESIDENT_SIZE) {
+		t->lowestLevel--;
+	}
+	//A new index isn't used by any frame yet, and the upload is submitted ahead of the first frame that could use it
+	UploadHandle upload;
+	t->residentLevel	= t->lowestLevel;
+	t->texture			= BuildImage(*t, t->residentLevel, upload);
+	t->bindless			= m_bindless.AddTexture(*t->texture, sampler);
+	m_residentBytes		+= GetLevelBytes(*t, t->residentLevel);
+	m_settledBytes		+= GetLevelBytes(*t, t->residentLevel);
+
+	uint32_t index = t->bindless.index;
+	m_bindlessTextures[index] = t.get();
+	m_textures.push_back(std::move(t));
+	return index;
+}
+
+void TextureStreamer::RequestLevel(uint32_t bindlessIndex, uint32_t level) {
+	auto i = m_bindlessTextures.find(bindlessIndex);
+	assert(i != m_bindlessTextures.end());
+	StreamedTexture& t = *i->second;
+
+	//Several requests in one frame get the most detailed of them
+	level = std::min(level, t.lowestLevel);
+	t.wantedLevel = t.lastRequest == m_frame ? std::min(t.wantedLevel, level) : level;
+	t.lastRequest = m_frame;
+}
+
+uint32_t TextureStreamer::GetResidentLevel(uint32_t bindlessIndex) const {
+	auto i = m_bindlessTextures.find(bindlessIndex);
+	assert(i != m_bindlessTextures.end());
+	return i->second->residentLevel;
+}
+
+void TextureStreamer::Update() {
+	std::erase_if(m_retired, [&](const RetiredTexture& r) {
+		if (r.frame + m_framesInFlight > m_frame) {
+			return false;
+		}
+		m_residentBytes -= r.bytes;
+		return true;
+	});
+
+	SwapCompleted();
+
+	std::vector<StreamedTexture*> byPriority;
+	for (auto& t : m_textures) {
+		byPriority.push_back(t.get());
+	}
+	std::stable_sort(byPriority.begin(), byPriority.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+		return a->lastRequest < b->lastRequest;
+	});
+
+	size_t uploaded = 0;
+
+	//New textures or a lower budget can leave us over it
+	if (m_settledBytes > m_memoryBudget) {
+		FreeMemory(byPriority, m_memoryBudget, UINT64_MAX, uploaded);
+	}
+
+	//One more mip at a time, for the most recently wanted textures first
+	for (auto i = byPriority.rbegin(); i != byPriority.rend() && uploaded < m_uploadBudget; ++i) {
+		StreamedTexture& t = **i;
+		if (t.pendingTexture || t.wantedLevel >= t.residentLevel) {
+			continue;
+		}
+		//The new image needs room alongside the old one, until the old one is retired
+		uint32_t	level	= t.residentLevel - 1;
+		size_t		needed	= GetLevelBytes(t, level);
+		if (needed > m_memoryBudget) {
+			continue;
+		}
+		if (m_settledBytes + needed > m_memoryBudget) {
+			FreeMemory(byPriority, m_memoryBudget - needed, t.lastRequest, uploaded);
+		}
+		//Memory freed above only comes back once the images it replaced are retired, a few frames from now
+		if (m_residentBytes + needed <= m_memoryBudget) {
+			uploaded += SetResidentLevel(t, level);
+		}
+	}
+	//Bindless descriptor writes are batched, so need writing before this frame's commands are recorded
+	m_bindless.Flush();
+	m_frame++;
+}
+
+void TextureStreamer::FreeMemory(const std::vector<StreamedTexture*>& byPriority, size_t targetBytes, uint64_t newerThan, size_t& uploaded) {
+	for (StreamedTexture* t : byPriority) {
+		Shrink(*t, t->wantedLevel, targetBytes, uploaded);
+	}
+	for (StreamedTexture* t : byPriority) {
+		if (t->lastRequest >= newerThan) {
+			break;
+		}
+		Shrink(*t, t->lowestLevel, targetBytes, uploaded);
+	}
+}
+
+void TextureStreamer::Shrink(StreamedTexture& t, uint32_t limitLevel, size_t targetBytes, size_t& uploaded) {
+	if (t.pendingTexture) {
+		return;
+	}
+	uint32_t	level = t.residentLevel;
+	size_t		bytes = m_settledBytes;
+	while (bytes > targetBytes && level < limitLevel) {
+		bytes -= GetLevelBytes(t, level) - GetLevelBytes(t, level + 1);
+		level++;
+	}
+	if (level != t.residentLevel) {
+		uploaded += SetResidentLevel(t, level);
+	}
+}
+
+size_t TextureStreamer::GetLevelBytes(const StreamedTexture& t, uint32_t level) {
+	return t.data.data.size() - t.data.levels[level].offset;
+}
+
+VKQuick::UniqueTexture TextureStreamer::BuildImage(const StreamedTexture& t, uint32_t level, UploadHandle& upload) {
+	const TextureLevel& top = t.data.levels[level];
+
+	VKQuick::UniqueTexture texture = VKQuick::TextureBuilder(m_device, m_memoryManager)
+		.WithFormat(t.data.format)
+		.WithDimension(top.width, top.height)
+		.WithMips(true)
+		.WithUsages(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst)
+		.Build(t.debugName);
+
+	upload = m_uploadQueue.UploadToImage(texture->GetImage(), t.data, level);
+	return texture;
+}
+
+//The new image is counted from now, and the old one until it is retired in Update
+size_t TextureStreamer::SetResidentLevel(StreamedTexture& t, uint32_t level) {
+	if (t.pendingTexture) {
+		return 0;
+	}
+	t.pendingTexture	= BuildImage(t, level, t.pendingUpload);
+	t.pendingLevel		= level;
+	m_pending.push_back(&t);
+
+	m_residentBytes += GetLevelBytes(t, level);
+	m_settledBytes	= m_settledBytes + GetLevelBytes(t, level) - GetLevelBytes(t, t.residentLevel);
+
+	return GetLevelBytes(t, level);
+}
+
+void TextureStreamer::SwapCompleted() {
+	for (StreamedTexture* t : m_pending) {
+		if (!t->pendingUpload.IsComplete()) {
+			continue;
+		}
+		m_bindless.UpdateTexture(t->bindless, *t->pendingTexture, t->sampler);
+
+		m_retired.push_back({ std::move(t->texture), m_frame, GetLevelBytes(*t, t->residentLevel) });
+		t->texture			= std::move(t->pendingTexture);
+		t->residentLevel	= t->pendingLevel;
+	}
+	std::erase_if(m_pending, [](const StreamedTexture* t) { return !t->pendingTexture; });
+}
\ No newline at end of file
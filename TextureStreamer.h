@@ -0,0 +1,120 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "TextureCompressor.h"
+#include "../VKQuick/Texture.h"
+#include "BindlessManager.h"
+#include "VulkanUploadQueue.h"
+
+namespace VKQuick {
+	class MemoryManager;
+}
+
+namespace NCL::Rendering::Vulkan {
+	/*
+	Keeps the CPU copy of every mip of a set of textures, but only as many of
+	them on the GPU as the memory budget allows. Textures start with just
+	their smallest mips resident, and gain a mip level at a time, limited by
+	how much can be uploaded each frame. When something more recently asked
+	for needs the memory, textures lose mip levels instead.
+
+	Each change of residency is a new image, which is written over the
+	texture's existing bindless index once its upload has completed, so
+	shaders never see the index change, nor an image still being filled.
+	Until then they keep sampling the old one. Old images are kept until
+	framesInFlight frames have passed, as frames still executing use their
+	own copy of the bindless descriptors. Update must be called once the
+	frame has begun.
+
+	The old and new images both count against the memory budget until the
+	old one is destroyed, so a texture only gains a mip level once there is
+	room for both.
+	*/
+	class TextureStreamer {
+	public:
+		TextureStreamer(vk::Device device, VKQuick::MemoryManager& memManager, VulkanUploadQueue& uploadQueue, VKQuick::BindlessManager& bindless,
+			uint32_t framesInFlight, size_t memoryBudget, size_t uploadBudget = 8 * 1024 * 1024);
+
+		//Returns the bindless index of the texture, which never changes
+		uint32_t AddTexture(CompressedTexture&& texture, vk::Sampler sampler, const std::string& debugName = "Streamed Texture");
+
+		//The most detailed mip level wanted this frame, such as from the texture's size on screen.
+		//Textures that are never asked for want their full resolution.
+		void RequestLevel(uint32_t bindlessIndex, uint32_t level);
+
+		void Update();
+
+		void SetMemoryBudget(size_t bytes) {
+			m_memoryBudget = bytes;
+		}
+
+		//Every image the streamer has allocated, including those still uploading or waiting to be destroyed
+		size_t GetResidentBytes() const {
+			return m_residentBytes;
+		}
+
+		//Most detailed mip level currently on the GPU
+		uint32_t GetResidentLevel(uint32_t bindlessIndex) const;
+
+	protected:
+		struct StreamedTexture {
+			CompressedTexture		data;
+			VKQuick::UniqueTexture	texture;
+			vk::Sampler				sampler;
+			std::string				debugName;
+			VKQuick::BindlessHandle	bindless;
+			uint32_t				residentLevel	= 0;
+			uint32_t				lowestLevel		= 0;	//Never has fewer mips than this
+			uint32_t				wantedLevel		= 0;
+			uint64_t				lastRequest		= 0;
+
+			VKQuick::UniqueTexture	pendingTexture;	//Still uploading, so not yet in the bindless set
+			UploadHandle			pendingUpload;
+			uint32_t				pendingLevel	= 0;
+		};
+
+		struct RetiredTexture {
+			VKQuick::UniqueTexture	texture;
+			uint64_t				frame;
+			size_t					bytes;
+		};
+
+		//Bytes of the texture's mip chain from level down to 1x1
+		static size_t GetLevelBytes(const StreamedTexture& t, uint32_t level);
+
+		VKQuick::UniqueTexture BuildImage(const StreamedTexture& t, uint32_t level, UploadHandle& upload);
+		//Starts uploading the new image, which replaces the current one in SwapCompleted. Does nothing
+		//if the texture already has an upload pending, as it can only be replaced once at a time.
+		size_t SetResidentLevel(StreamedTexture& t, uint32_t level);
+		//Points the bindless index of every texture whose upload has finished at its new image
+		void SwapCompleted();
+
+		//Drops mips of t, but not past limitLevel, until no more than targetBytes are resident
+		void Shrink(StreamedTexture& t, uint32_t limitLevel, size_t targetBytes, size_t& uploaded);
+
+		//Mips that aren't wanted go first, then mips of textures wanted less recently than newerThan
+		void FreeMemory(const std::vector<StreamedTexture*>& byPriority, size_t targetBytes, uint64_t newerThan, size_t& uploaded);
+
+		vk::Device					m_device;
+		VKQuick::MemoryManager&		m_memoryManager;
+		VulkanUploadQueue&			m_uploadQueue;
+		VKQuick::BindlessManager&	m_bindless;
+
+		std::vector<std::unique_ptr<StreamedTexture>>	m_textures;
+		std::unordered_map<uint32_t, StreamedTexture*>	m_bindlessTextures;
+		std::vector<RetiredTexture>						m_retired;
+		std::vector<StreamedTexture*>					m_pending;
+
+		uint32_t	m_framesInFlight;
+		uint64_t	m_frame			= 1;
+		size_t		m_memoryBudget;
+		size_t		m_uploadBudget;
+		size_t		m_residentBytes = 0;
+		size_t		m_settledBytes	= 0;	//What m_residentBytes falls to once every pending and retired image is gone
+	};
+}
\ No newline at end of file
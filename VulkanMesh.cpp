@@ -6,6 +6,13 @@ Contact:richgdavison@gmail.com
 License: MIT (see LICENSE file at the top of the source tree)
 *//////////////////////////////////////////////////////////////////////////////
 #include "VulkanMesh.h"
+#include "MeshOptimiser.h"
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <filesystem>
+#include <span>
 
 #include "../VKQuick/MemoryManager.h"
 #include "../VKQuick/MeshBuilder.h"
@@ -26,101 +33,931 @@ vk::Format attributeFormats[] = {
 	vk::Format::eR32G32B32A32Sfloat, //Generic Vec4s
 	vk::Format::eR32Sint,			//Generic ints
 };
-//Attribute sizes for each of the above
-size_t attributeSizes[] = {
-	sizeof(Vector3),	//Positions 
-	sizeof(Vector4),	//Colours
-	sizeof(Vector2),	//TexCoords
-	sizeof(Vector3),	//Normals
-	sizeof(Vector4),	//Tangents are 4D!
-	sizeof(Vector4),	//Skel Weights
-	sizeof(Vector4),	//Skel indices
-	sizeof(Vector4),	//Generic Vec4s
-	sizeof(int),		//Generic ints
+
+//Compressed formats for VertexFormat::Quantised, in the same order as above
+vk::Format quantisedAttributeFormats[] = {
+	vk::Format::eR32G32B32Sfloat,		//Positions stay at full precision
+	vk::Format::eR8G8B8A8Unorm,			//Colours
+	vk::Format::eR16G16Sfloat,			//TexCoords
+	vk::Format::eR16G16Snorm,			//Normals are octahedral encoded
+	vk::Format::eA2B10G10R10UnormPack32,//Tangents are octahedral encoded, handedness in alpha
+	vk::Format::eR8G8B8A8Unorm,			//Skel Weights
+	vk::Format::eR8G8B8A8Uint,			//Skel indices - promoted to 16 bit if there's > 256 joints
+	vk::Format::eR32G32B32A32Sfloat,	//Generic Vec4s
+	vk::Format::eR32Sint,				//Generic ints
+};
+
+//How VKQuick should treat each attribute, in the same order as above
+VKQuick::AttributeType attributeTypes[] = {
+	VKQuick::AttributeType::Position,
+	VKQuick::AttributeType::Colour,
+	VKQuick::AttributeType::TexCoord,
+	VKQuick::AttributeType::Normals,
+	VKQuick::AttributeType::Tangents,
+	VKQuick::AttributeType::UserData,
+	VKQuick::AttributeType::UserData,
+	VKQuick::AttributeType::UserData,
+	VKQuick::AttributeType::UserData,
 };
 
+//0 for formats no attribute is ever stored in
+static size_t AttributeFormatSize(vk::Format format) {
+	switch (format) {
+		case vk::Format::eR32G32B32A32Sfloat:
+		case vk::Format::eR32G32B32A32Sint:		return 16;
+		case vk::Format::eR32G32B32Sfloat:		return 12;
+		case vk::Format::eR32G32Sfloat:
+		case vk::Format::eR16G16B16A16Uint:		return 8;
+		case vk::Format::eR32Sint:
+		case vk::Format::eR8G8B8A8Unorm:
+		case vk::Format::eR8G8B8A8Uint:
+		case vk::Format::eR16G16Sfloat:
+		case vk::Format::eR16G16Snorm:
+		case vk::Format::eA2B10G10R10UnormPack32:	return 4;
+		default: return 0;
+	}
+}
+
+static size_t FormatSize(vk::Format format) {
+	size_t size = AttributeFormatSize(format);
+	assert(size > 0);
+	return size;
+}
+
+static float ClampUnit(float v, float low = 0.0f) {
+	return v < low ? low : (v > 1.0f ? 1.0f : v);
+}
+
+static uint8_t ToUnorm8(float v) {
+	return (uint8_t)(ClampUnit(v) * 255.0f + 0.5f);
+}
+
+static int16_t ToSnorm16(float v) {
+	return (int16_t)std::round(ClampUnit(v, -1.0f) * 32767.0f);
+}
+
+static uint16_t ToHalf(float f) {
+	uint32_t x;
+	memcpy(&x, &f, sizeof(float));
+
+	uint32_t sign		= (x >> 16) & 0x8000;
+	uint32_t mantissa	= x & 0x007FFFFF;
+	int32_t  exponent	= (int32_t)((x >> 23) & 0xFF) - 127 + 15;
+
+	if (((x >> 23) & 0xFF) == 0xFF) {	//Inf or NaN
+		return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 31) {				//Too big, becomes inf
+		return (uint16_t)(sign | 0x7C00);
+	}
+	if (exponent <= 0) {				//Denormal half, or zero
+		if (exponent < -10) {
+			return (uint16_t)sign;
+		}
+		mantissa |= 0x00800000;
+		uint32_t shift		= 14 - exponent;
+		uint32_t half		= mantissa >> shift;
+		uint32_t remainder	= mantissa & ((1u << shift) - 1);
+		uint32_t halfway	= 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) {
+			half++;
+		}
+		return (uint16_t)(sign | half);
+	}
+	uint32_t half		= sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t remainder	= mantissa & 0x1FFF;
+	//Round to nearest even - a carry into the exponent is still correct
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+		half++;
+	}
+	return (uint16_t)half;
+}
+
+//Maps a unit vector onto the [-1, 1] square
+static Vector2 OctahedralEncode(const Vector3& v) {
+	float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+	if (l1 == 0.0f) {
+		return Vector2(0, 0);
+	}
+	float x = v.x / l1;
+	float y = v.y / l1;
+	if (v.z < 0.0f) {
+		float foldX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldX;
+		y = foldY;
+	}
+	return Vector2(x, y);
+}
+
+std::map<uint32_t, MeshMemoryUsage> VulkanMesh::s_memoryUsage;
+std::mutex							VulkanMesh::s_memoryMutex;
+
 VulkanMesh::VulkanMesh() {
 
 }
 
 VulkanMesh::~VulkanMesh() {
+	ReleaseGPUState();
+}
 
+const VKQuick::UniqueMesh& VulkanMesh::GetMesh() const {
+	static const VKQuick::UniqueMesh noMesh;
+	return m_meshes.empty() ? noMesh : m_meshes[m_currentBuffer];
 }
 
 void	VulkanMesh::UploadAttributes(vk::CommandBuffer  to) {
-	void* allData = m_mesh->MapData();
-
-	auto atrributeFunc = [&](VertexAttribute::Type attribute, size_t count, const char* data) {
-		if (count == 0) {
-			return;
+	if (m_storage == MeshStorage::Dynamic) {
+		//Already mapped, so every buffer can just be written in full
+		for (DynamicBuffer& buffer : m_dynamicBuffers) {
+			WriteGPUData(buffer.data);
+			for (auto& ranges : buffer.dirtyRanges) {
+				ranges.clear();
+			}
+			buffer.indicesDirty = false;
 		}
+		return;
+	}
+	WriteGPUData((char*)m_meshes[0]->MapData());
+	m_meshes[0]->UnmapData(to);
+}
+
+void	VulkanMesh::WriteGPUData(char* allData) const {
+	if (IsCooked()) {
+		memcpy(allData, m_cookedGPUData, m_cookedGPUSize);
+		return;
+	}
+	for (VertexAttribute::Type attribute : m_usedAttributes) {
 		VKQuick::AttributeData	attributeData;
 
-		if (!m_mesh->GeAttributeData((int)attribute, attributeData)) {
-			return;
+		if (!m_meshes[0]->GeAttributeData((int)attribute, attributeData)) {
+			continue;
+		}
+		WriteAttribute(attribute, allData + attributeData.offset);
+	}
+
+	if (GetIndexCount() > 0) {
+		VKQuick::IndexData indexData;
+		if (m_meshes[0]->GetIndexData(indexData)) {
+			WriteIndices(allData + indexData.offset);
+		}
+	}
+}
+
+void	VulkanMesh::MarkDirty(VertexAttribute::Type attribute, uint32_t firstVertex, uint32_t vertexCount) {
+	assert(m_storage == MeshStorage::Dynamic);
+	if (firstVertex >= GetVertexCount()) {
+		return;
+	}
+	vertexCount = std::min(vertexCount, GetVertexCount() - firstVertex);
+
+	for (DynamicBuffer& buffer : m_dynamicBuffers) {
+		std::vector<DirtyRange>& ranges = buffer.dirtyRanges[attribute];
+		//Lots of small edits are cheaper to treat as one big one than to keep track of
+		if (ranges.size() >= 64) {
+			ranges = { { 0, GetVertexCount() } };
 		}
-		char* gpuData = (char*)allData + attributeData.offset;
+		else {
+			ranges.push_back({ firstVertex, vertexCount });
+		}
+	}
+}
 
-		//TODO: check that returned size equals full attribute size!
-		memcpy(gpuData, data, attributeData.size);
-		};
+void	VulkanMesh::MarkIndicesDirty() {
+	assert(m_storage == MeshStorage::Dynamic);
+	for (DynamicBuffer& buffer : m_dynamicBuffers) {
+		buffer.indicesDirty = true;
+	}
+}
 
-	atrributeFunc(VertexAttribute::Positions, GetPositionData().size(), (const char*)GetPositionData().data());
-	atrributeFunc(VertexAttribute::Colours, GetColourData().size(), (const char*)GetColourData().data());
-	atrributeFunc(VertexAttribute::TextureCoords, GetTextureCoordData().size(), (const char*)GetTextureCoordData().data());
-	atrributeFunc(VertexAttribute::Normals, GetNormalData().size(), (const char*)GetNormalData().data());
-	atrributeFunc(VertexAttribute::Tangents, GetTangentData().size(), (const char*)GetTangentData().data());
-	atrributeFunc(VertexAttribute::JointWeights, GetSkinWeightData().size(), (const char*)GetSkinWeightData().data());
-	atrributeFunc(VertexAttribute::JointIndices, GetSkinIndexData().size(), (const char*)GetSkinIndexData().data());
+void	VulkanMesh::UploadDirty(uint32_t frame) {
+	assert(m_storage == MeshStorage::Dynamic && !m_dynamicBuffers.empty());
 
-	atrributeFunc(VertexAttribute::General_Vec4, GetGeneralVec4Data().size(), (const char*)GetGeneralVec4Data().data());
-	atrributeFunc(VertexAttribute::General_Integer, GetGeneralIntegerData().size(), (const char*)GetGeneralIntegerData().data());
+	m_currentBuffer = frame % (uint32_t)m_dynamicBuffers.size();
 
-	if (GetIndexCount() > 0) {
+	DynamicBuffer&				buffer	= m_dynamicBuffers[m_currentBuffer];
+	const VKQuick::UniqueMesh&	mesh	= m_meshes[m_currentBuffer];
+
+	for (VertexAttribute::Type attribute : m_usedAttributes) {
+		std::vector<DirtyRange>& ranges = buffer.dirtyRanges[attribute];
+		if (ranges.empty()) {
+			continue;
+		}
+		VKQuick::AttributeData attributeData;
+		if (!mesh->GeAttributeData((int)attribute, attributeData)) {
+			ranges.clear();
+			continue;
+		}
+		//Merge overlapping and touching ranges, so nothing gets written twice
+		std::sort(ranges.begin(), ranges.end(), [](const DirtyRange& a, const DirtyRange& b) {return a.first < b.first; });
+		DirtyRange current = ranges[0];
+		for (size_t i = 1; i <= ranges.size(); ++i) {
+			if (i < ranges.size() && ranges[i].first <= current.first + current.count) {
+				uint32_t end	= std::max(current.first + current.count, ranges[i].first + ranges[i].count);
+				current.count	= end - current.first;
+				continue;
+			}
+			WriteAttribute(attribute, buffer.data + attributeData.offset, current.first, current.count);
+			if (i < ranges.size()) {
+				current = ranges[i];
+			}
+		}
+		ranges.clear();
+	}
+	if (buffer.indicesDirty && GetIndexCount() > 0) {
 		VKQuick::IndexData indexData;
-		if (!m_mesh->GetIndexData(indexData)) {
-			return;
+		if (mesh->GetIndexData(indexData)) {
+			WriteIndices(buffer.data + indexData.offset);
 		}
-		char* gpuData = (char*)allData + indexData.offset;
+	}
+	buffer.indicesDirty = false;
+}
 
-		memcpy(gpuData, GetIndexData().data(), indexData.size);
+void	VulkanMesh::WriteAttribute(VertexAttribute::Type attribute, char* dst, uint32_t firstVertex, uint32_t vertexCount) const {
+	vk::Format format = m_attributeFormats[attribute];
+
+	//dst is the start of the whole stream, only the given vertices are written
+	dst += firstVertex * FormatSize(format);
+	auto Range = [&](const auto& data) {
+		size_t first = std::min<size_t>(firstVertex, data.size());
+		return std::span(data).subspan(first, std::min<size_t>(vertexCount, data.size() - first));
+	};
+	auto CopyRange = [&](const auto& data) {
+		auto range = Range(data);
+		memcpy(dst, range.data(), range.size_bytes());
+	};
+
+	switch (attribute) {
+		case VertexAttribute::Positions: {
+			CopyRange(GetPositionData());
+		}break;
+		case VertexAttribute::Colours: {
+			if (format == vk::Format::eR8G8B8A8Unorm) {
+				uint8_t* out = (uint8_t*)dst;
+				for (const Vector4& c : Range(GetColourData())) {
+					*out++ = ToUnorm8(c.x);
+					*out++ = ToUnorm8(c.y);
+					*out++ = ToUnorm8(c.z);
+					*out++ = ToUnorm8(c.w);
+				}
+			}
+			else {
+				CopyRange(GetColourData());
+			}
+		}break;
+		case VertexAttribute::TextureCoords: {
+			if (format == vk::Format::eR16G16Sfloat) {
+				uint16_t* out = (uint16_t*)dst;
+				for (const Vector2& t : Range(GetTextureCoordData())) {
+					*out++ = ToHalf(t.x);
+					*out++ = ToHalf(t.y);
+				}
+			}
+			else {
+				CopyRange(GetTextureCoordData());
+			}
+		}break;
+		case VertexAttribute::Normals: {
+			if (format == vk::Format::eR16G16Snorm) {
+				int16_t* out = (int16_t*)dst;
+				for (const Vector3& n : Range(GetNormalData())) {
+					Vector2 oct = OctahedralEncode(n);
+					*out++ = ToSnorm16(oct.x);
+					*out++ = ToSnorm16(oct.y);
+				}
+			}
+			else {
+				CopyRange(GetNormalData());
+			}
+		}break;
+		case VertexAttribute::Tangents: {
+			if (format == vk::Format::eA2B10G10R10UnormPack32) {
+				uint32_t* out = (uint32_t*)dst;
+				for (const Vector4& t : Range(GetTangentData())) {
+					Vector2 oct = OctahedralEncode(Vector3(t.x, t.y, t.z));
+					uint32_t x = (uint32_t)(ClampUnit(oct.x * 0.5f + 0.5f) * 1023.0f + 0.5f);
+					uint32_t y = (uint32_t)(ClampUnit(oct.y * 0.5f + 0.5f) * 1023.0f + 0.5f);
+					uint32_t w = t.w < 0.0f ? 0 : 3;
+					*out++ = x | (y << 10) | (w << 30);
+				}
+			}
+			else {
+				CopyRange(GetTangentData());
+			}
+		}break;
+		case VertexAttribute::JointWeights: {
+			if (format == vk::Format::eR8G8B8A8Unorm) {
+				uint8_t* out = (uint8_t*)dst;
+				for (const Vector4& w : Range(GetSkinWeightData())) {
+					uint8_t weights[4] = { ToUnorm8(w.x), ToUnorm8(w.y), ToUnorm8(w.z), ToUnorm8(w.w) };
+					int sum		= 0;
+					int largest = 0;
+					for (int i = 0; i < 4; ++i) {
+						sum += weights[i];
+						largest = weights[i] > weights[largest] ? i : largest;
+					}
+					if (sum > 0) { //Put any rounding error onto the largest weight so they still sum to 1
+						int fixedWeight = weights[largest] + (255 - sum);
+						weights[largest] = (uint8_t)(fixedWeight < 0 ? 0 : (fixedWeight > 255 ? 255 : fixedWeight));
+					}
+					memcpy(out, weights, 4);
+					out += 4;
+				}
+			}
+			else {
+				CopyRange(GetSkinWeightData());
+			}
+		}break;
+		case VertexAttribute::JointIndices: {
+			const int32_t* in	= (const int32_t*)Range(GetSkinIndexData()).data();
+			size_t count		= Range(GetSkinIndexData()).size() * 4;
+			if (format == vk::Format::eR8G8B8A8Uint) {
+				uint8_t* out = (uint8_t*)dst;
+				for (size_t i = 0; i < count; ++i) {
+					out[i] = (uint8_t)in[i];
+				}
+			}
+			else if (format == vk::Format::eR16G16B16A16Uint) {
+				uint16_t* out = (uint16_t*)dst;
+				for (size_t i = 0; i < count; ++i) {
+					out[i] = (uint16_t)in[i];
+				}
+			}
+			else {
+				memcpy(dst, in, count * sizeof(int32_t));
+			}
+		}break;
+		case VertexAttribute::General_Vec4: {
+			CopyRange(GetGeneralVec4Data());
+		}break;
+		case VertexAttribute::General_Integer: {
+			CopyRange(GetGeneralIntegerData());
+		}break;
+		default: break;
 	}
+}
 
-	m_mesh->UnmapData(to);
+void	VulkanMesh::WriteIndices(char* dst) const {
+	const std::vector<unsigned int>& indices = GetIndexData();
+	if (m_indexType == vk::IndexType::eUint16) {
+		uint16_t* out = (uint16_t*)dst;
+		for (unsigned int i : indices) {
+			*out++ = (uint16_t)i;
+		}
+	}
+	else {
+		memcpy(dst, indices.data(), indices.size() * sizeof(unsigned int));
+	}
 }
 
-void	VulkanMesh::InitialiseGPUState(vk::Device device, VKQuick::MemoryManager& memManager, vk::BufferUsageFlags extraFlags) {
-	VKQuick::MeshBuilder builder = VKQuick::MeshBuilder(device, memManager)
-		.WithVertexCount(GetVertexCount())
-		.WithIndexCount(GetIndexCount(), vk::IndexType::eUint32)
-		.WithBufferUsageFlags(extraFlags)
-		.WithHostVisibleBuffers();
+void	VulkanMesh::ChooseAttributeFormats() {
+	const bool quantise = m_vertexFormat == VertexFormat::Quantised;
+
+	m_gpuVertexCount	= GetVertexCount();
+	m_gpuIndexCount		= GetIndexCount();
+
+	//0xFFFF is left free, as it's the primitive restart value
+	m_indexType = (quantise && m_gpuVertexCount < 0xFFFF) ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
 
 	m_attributeMask = 0;
+	m_usedAttributes.clear();
+	std::fill(std::begin(m_attributeFormats), std::end(m_attributeFormats), vk::Format::eUndefined);
+
+	auto atrributeFunc = [&](VertexAttribute::Type attributeIndex, size_t count) {
+		if (count == 0) {
+			return;
+		}
+		vk::Format format = GetDefaultFormat(m_vertexFormat, attributeIndex);
+
+		if (format == vk::Format::eR8G8B8A8Uint) {
+			const int32_t* joints = (const int32_t*)GetSkinIndexData().data();
+			for (size_t i = 0; i < GetSkinIndexData().size() * 4; ++i) {
+				if (joints[i] > 255) {
+					format = vk::Format::eR16G16B16A16Uint;
+					break;
+				}
+			}
+		}
+		m_attributeFormats[attributeIndex] = format;
+		m_usedAttributes.push_back(attributeIndex);
 
-	auto atrributeFunc = [&](VKQuick::AttributeType attributeType, int attributeIndex, size_t count, const char* data) {
-		if (count > 0) {
-			m_attributeMask |= (1 << attributeIndex);
-			builder.WithVertexAttribute((int)attributeIndex, attributeFormats[attributeIndex], attributeSizes[attributeIndex], attributeType);
+		m_attributeMask |= (1 << attributeIndex);
+		if (format != attributeFormats[attributeIndex]) {
+			m_attributeMask |= (1 << (attributeIndex + QUANTISED_ATTRIBUTE_SHIFT));
 		}
 	};
 
-	atrributeFunc(VKQuick::AttributeType::Position, VertexAttribute::Positions, GetPositionData().size(), (const char*)GetPositionData().data());
-	atrributeFunc(VKQuick::AttributeType::Colour, VertexAttribute::Colours, GetColourData().size(), (const char*)GetColourData().data());
-	atrributeFunc(VKQuick::AttributeType::TexCoord, VertexAttribute::TextureCoords, GetTextureCoordData().size(), (const char*)GetTextureCoordData().data());
-	atrributeFunc(VKQuick::AttributeType::Normals, VertexAttribute::Normals, GetNormalData().size(), (const char*)GetNormalData().data());
-	atrributeFunc(VKQuick::AttributeType::Tangents, VertexAttribute::Tangents, GetTangentData().size(), (const char*)GetTangentData().data());
-	atrributeFunc(VKQuick::AttributeType::UserData, VertexAttribute::JointWeights, GetSkinWeightData().size(), (const char*)GetSkinWeightData().data());
-	atrributeFunc(VKQuick::AttributeType::UserData, VertexAttribute::JointIndices, GetSkinIndexData().size(), (const char*)GetSkinIndexData().data());
+	atrributeFunc(VertexAttribute::Positions, GetPositionData().size());
+	atrributeFunc(VertexAttribute::Colours, GetColourData().size());
+	atrributeFunc(VertexAttribute::TextureCoords, GetTextureCoordData().size());
+	atrributeFunc(VertexAttribute::Normals, GetNormalData().size());
+	atrributeFunc(VertexAttribute::Tangents, GetTangentData().size());
+	atrributeFunc(VertexAttribute::JointWeights, GetSkinWeightData().size());
+	atrributeFunc(VertexAttribute::JointIndices, GetSkinIndexData().size());
+
+	atrributeFunc(VertexAttribute::General_Vec4, GetGeneralVec4Data().size());
+	atrributeFunc(VertexAttribute::General_Integer, GetGeneralIntegerData().size());
+}
+
+bool	VulkanMesh::InitialiseGPUState(vk::Device device, VKQuick::MemoryManager& memManager, vk::BufferUsageFlags extraFlags) {
+	if (!IsCooked()) {
+		ChooseAttributeFormats();
+		ComputeBounds();
+	}
+
+	VKQuick::MeshBuilder builder = VKQuick::MeshBuilder(device, memManager)
+		.WithVertexCount(m_gpuVertexCount)
+		.WithIndexCount(m_gpuIndexCount, m_indexType);
 
-	atrributeFunc(VKQuick::AttributeType::UserData, VertexAttribute::General_Vec4, GetGeneralVec4Data().size(), (const char*)GetGeneralVec4Data().data());
-	atrributeFunc(VKQuick::AttributeType::UserData, VertexAttribute::General_Integer, GetGeneralIntegerData().size(), (const char*)GetGeneralIntegerData().data());
+	if (m_storage == MeshStorage::Dynamic) {
+		builder.WithBufferUsageFlags(extraFlags)
+			.WithHostVisibleBuffers();
+	}
+	else {
+		builder.WithBufferUsageFlags(extraFlags | vk::BufferUsageFlagBits::eTransferDst);
+	}
 
-	for(const SubMesh& sm : subMeshes) {
+	for (VertexAttribute::Type attribute : m_usedAttributes) {
+		vk::Format format = m_attributeFormats[attribute];
+		builder.WithVertexAttribute((int)attribute, format, FormatSize(format), attributeTypes[attribute]);
+	}
+
+	//LOD ranges go after the SubMeshes, so BindlessManager sees them as extra mesh layers
+	for(const SubMesh& sm : GetGPURanges()) {
 		builder.WithMeshRange(sm.start, sm.count, sm.base);
 	}
 
-	m_mesh = builder.Build();
+	ReleaseGPUState();
+
+	uint32_t bufferCount = m_storage == MeshStorage::Dynamic ? std::max(m_dynamicBufferCount, 1u) : 1;
+	for (uint32_t i = 0; i < bufferCount; ++i) {
+		m_meshes.push_back(builder.Build());
+	}
+	//The cooked data is a copy of the buffer VKQuick gave us when it was saved, and is useless if that layout has changed
+	if (IsCooked() && m_meshes[0]->GetBuffer().size != m_cookedGPUSize) {
+		m_meshes.clear();
+		return false;
+	}
+	if (m_storage == MeshStorage::Dynamic) {
+		m_dynamicBuffers.resize(bufferCount);
+		for (uint32_t i = 0; i < bufferCount; ++i) {
+			m_dynamicBuffers[i].data = (char*)m_meshes[i]->MapData();
+		}
+	}
+	TrackMemory(true);
+	return true;
+}
+
+void VulkanMesh::ComputeBounds() {
+	const std::vector<Vector3>& positions = GetPositionData();
+	m_boundsMin = positions.empty() ? Vector3() : positions[0];
+	m_boundsMax = m_boundsMin;
+	for (const Vector3& p : positions) {
+		for (int axis = 0; axis < 3; ++axis) {
+			m_boundsMin[axis] = std::min(m_boundsMin[axis], p[axis]);
+			m_boundsMax[axis] = std::max(m_boundsMax[axis], p[axis]);
+		}
+	}
+}
+
+void VulkanMesh::ReleaseGPUState() {
+	TrackMemory(false);
+	//Host visible buffers have nothing to copy when unmapped, so no command buffer is needed
+	for (size_t i = 0; i < m_dynamicBuffers.size(); ++i) {
+		m_meshes[i]->UnmapData({});
+	}
+	m_dynamicBuffers.clear();
+	m_meshes.clear();
+	m_currentBuffer = 0;
+}
+
+std::vector<SubMesh> VulkanMesh::GetGPURanges() const {
+	if (!m_lodRanges.empty()) {
+		return m_lodRanges;
+	}
+	return subMeshes;
+}
+
+vk::Format VulkanMesh::GetDefaultFormat(VertexFormat format, VertexAttribute::Type attribute) {
+	return format == VertexFormat::Quantised ? quantisedAttributeFormats[attribute] : attributeFormats[attribute];
+}
+
+size_t VulkanMesh::GetFormatSize(vk::Format format) {
+	return FormatSize(format);
+}
+
+void VulkanMesh::TrackMemory(bool add) {
+	if (m_meshes.empty()) {
+		return;
+	}
+	if (add) {
+		m_memoryType = m_meshes[0]->GetBuffer().allocationInfo.memoryType;
+	}
+	//Dynamic meshes count every one of their buffers
+	size_t byteCount = 0;
+	for (const VKQuick::UniqueMesh& mesh : m_meshes) {
+		byteCount += mesh->GetBuffer().size;
+	}
+	std::lock_guard lock(s_memoryMutex);
+	MeshMemoryUsage& usage = s_memoryUsage[m_memoryType];
+	if (add) {
+		usage.meshCount++;
+		usage.byteCount += byteCount;
+	}
+	else {
+		usage.meshCount--;
+		usage.byteCount -= byteCount;
+	}
+}
+
+void VulkanMesh::TrackArenaMemory(const VKQuick::Buffer& pool, bool add) {
+	std::lock_guard lock(s_memoryMutex);
+	MeshMemoryUsage& usage = s_memoryUsage[pool.allocationInfo.memoryType];
+	if (add) {
+		usage.arenaPools++;
+		usage.arenaBytes += pool.size;
+	}
+	else {
+		usage.arenaPools--;
+		usage.arenaBytes -= pool.size;
+	}
+}
+
+std::map<uint32_t, MeshMemoryUsage> VulkanMesh::GetMemoryUsage() {
+	std::lock_guard lock(s_memoryMutex);
+	return s_memoryUsage;
+}
+
+void VulkanMesh::PrintMemoryReport(vk::PhysicalDevice gpu) {
+	vk::PhysicalDeviceMemoryProperties props = gpu.getMemoryProperties();
+
+	std::cout << "VulkanMesh memory report:\n";
+	for (const auto& [type, usage] : GetMemoryUsage()) {
+		if (usage.meshCount == 0 && usage.arenaPools == 0) {
+			continue;
+		}
+		const vk::MemoryType& memType = props.memoryTypes[type];
+		std::cout << "\tHeap " << memType.heapIndex << " (type " << type << ") "
+			<< ((memType.propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal) ? "device local " : "")
+			<< ((memType.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) ? "host visible " : "")
+			<< ": " << usage.meshCount << " meshes, " << usage.byteCount << " bytes, "
+			<< usage.arenaPools << " arena pools, " << usage.arenaBytes << " bytes\n";
+	}
+}
+
+const uint32_t COOKED_MESH_MAGIC	= 0x534D4B56; //"VKMS"
+const uint32_t COOKED_MESH_VERSION	= 2;
+
+/*
+Followed by the SubMeshes, the LOD ranges, the LOD errors, then (aligned to
+16 bytes) the GPU buffer contents, exactly as WriteGPUData would produce them.
+*/
+struct CookedMeshHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t primitiveType;
+	uint32_t vertexFormat;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexType;
+	uint32_t attributeMask;
+	uint32_t attributeFormats[VertexAttribute::MAX_ATTRIBUTES];
+	uint32_t subMeshCount;
+	uint32_t lodRangeCount;
+	uint32_t lodCount;
+	float	 boundsMin[3];
+	float	 boundsMax[3];
+	uint64_t gpuDataOffset;
+	uint64_t gpuDataSize;
+};
+
+bool VulkanMesh::SaveCooked(const std::string& filename, uint64_t sourceHash) const {
+	if (m_meshes.empty() || IsCooked()) {
+		return false;
+	}
+	std::vector<char> gpuData(m_meshes[0]->GetBuffer().size);
+	WriteGPUData(gpuData.data());
+
+	CookedMeshHeader header = {
+		.magic			= COOKED_MESH_MAGIC,
+		.version		= COOKED_MESH_VERSION,
+		.sourceHash		= sourceHash,
+		.primitiveType	= (uint32_t)primType,
+		.vertexFormat	= (uint32_t)m_vertexFormat,
+		.vertexCount	= m_gpuVertexCount,
+		.indexCount		= m_gpuIndexCount,
+		.indexType		= m_indexType == vk::IndexType::eUint16 ? 16u : 32u,
+		.attributeMask	= m_attributeMask,
+		.subMeshCount	= (uint32_t)subMeshes.size(),
+		.lodRangeCount	= (uint32_t)m_lodRanges.size(),
+		.lodCount		= (uint32_t)m_lodErrors.size(),
+		.boundsMin		= { m_boundsMin.x, m_boundsMin.y, m_boundsMin.z },
+		.boundsMax		= { m_boundsMax.x, m_boundsMax.y, m_boundsMax.z },
+		.gpuDataSize	= gpuData.size()
+	};
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		header.attributeFormats[i] = (uint32_t)m_attributeFormats[i];
+	}
+	size_t tableEnd = sizeof(header) + (subMeshes.size() + m_lodRanges.size()) * sizeof(SubMesh) + m_lodErrors.size() * sizeof(float);
+	header.gpuDataOffset = (tableEnd + 15) & ~15ull;
+
+	//Written under a temporary name, so a half written file is never picked up as a valid cache
+	std::string tempName = filename + ".tmp";
+	{
+		std::ofstream file(tempName, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		const char padding[16] = {};
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)subMeshes.data(), subMeshes.size() * sizeof(SubMesh));
+		file.write((const char*)m_lodRanges.data(), m_lodRanges.size() * sizeof(SubMesh));
+		file.write((const char*)m_lodErrors.data(), m_lodErrors.size() * sizeof(float));
+		file.write(padding, header.gpuDataOffset - tableEnd);
+		file.write(gpuData.data(), gpuData.size());
+		if (!file.good()) {
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempName, filename, error);
+	return !error;
+}
+
+bool VulkanMesh::LoadCooked(const std::string& filename, uint64_t sourceHash) {
+	auto file = std::make_unique<MappedFile>(filename);
+	if (!file->IsValid() || file->GetSize() < sizeof(CookedMeshHeader)) {
+		return false;
+	}
+	const char* data = file->GetData();
+
+	CookedMeshHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != COOKED_MESH_MAGIC || header.version != COOKED_MESH_VERSION || header.sourceHash != sourceHash) {
+		return false;
+	}
+	//Anything SaveCooked wouldn't have written means the file is damaged, so is treated as out of date
+	if (header.primitiveType >= GeometryPrimitive::MAX_PRIM || header.vertexFormat > (uint32_t)VertexFormat::Quantised ||
+		(header.indexType != 16 && header.indexType != 32)) {
+		return false;
+	}
+	//Each LOD has the same number of ranges, and LOD ranges are only written alongside LOD errors
+	if ((header.lodCount == 0) != (header.lodRangeCount == 0) || (header.lodCount > 0 && header.lodRangeCount % header.lodCount != 0)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		vk::Format	format	= (vk::Format)header.attributeFormats[i];
+		bool		used	= format != vk::Format::eUndefined;
+		if ((used && AttributeFormatSize(format) == 0) || used != ((header.attributeMask & (1 << i)) != 0)) {
+			return false;
+		}
+	}
+	size_t tableEnd = sizeof(header) + ((size_t)header.subMeshCount + header.lodRangeCount) * sizeof(SubMesh) + (size_t)header.lodCount * sizeof(float);
+	if (tableEnd > header.gpuDataOffset || header.gpuDataOffset + header.gpuDataSize > file->GetSize()) {
+		return false;
+	}
+	const char* tables = data + sizeof(header);
+
+	subMeshes.resize(header.subMeshCount);
+	memcpy(subMeshes.data(), tables, subMeshes.size() * sizeof(SubMesh));
+	tables += subMeshes.size() * sizeof(SubMesh);
+
+	m_lodRanges.resize(header.lodRangeCount);
+	memcpy(m_lodRanges.data(), tables, m_lodRanges.size() * sizeof(SubMesh));
+	tables += m_lodRanges.size() * sizeof(SubMesh);
+
+	m_lodErrors.resize(header.lodCount);
+	memcpy(m_lodErrors.data(), tables, m_lodErrors.size() * sizeof(float));
+
+	primType			= (GeometryPrimitive::Type)header.primitiveType;
+	m_vertexFormat		= (VertexFormat)header.vertexFormat;
+	m_gpuVertexCount	= header.vertexCount;
+	m_gpuIndexCount		= header.indexCount;
+	m_indexType			= header.indexType == 16 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+	m_attributeMask		= header.attributeMask;
+	m_boundsMin			= Vector3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	m_boundsMax			= Vector3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+
+	m_usedAttributes.clear();
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		m_attributeFormats[i] = (vk::Format)header.attributeFormats[i];
+		if (m_attributeFormats[i] != vk::Format::eUndefined) {
+			m_usedAttributes.push_back((VertexAttribute::Type)i);
+		}
+	}
+
+	m_cookedGPUData = data + header.gpuDataOffset;
+	m_cookedGPUSize = header.gpuDataSize;
+	m_cookedFile	= std::move(file);
+	return true;
+}
+
+template<typename T>
+static std::vector<T> RemapVertices(const std::vector<T>& input, const std::vector<uint32_t>& remap) {
+	std::vector<T> output(input.size());
+	for (size_t v = 0; v < input.size(); ++v) {
+		output[remap[v]] = input[v];
+	}
+	return output;
+}
+
+void VulkanMesh::OptimiseForGPU() {
+	if (primType != GeometryPrimitive::Triangles || GetIndexCount() == 0) {
+		return;
+	}
+	std::vector<unsigned int> indices = GetIndexData();
+
+	std::vector<SubMesh> ranges = subMeshes;
+	if (ranges.empty()) {
+		ranges.push_back({ 0, (int)indices.size(), 0 });
+	}
+	//Empty ranges use no vertices, so have no vertex range to keep to themselves
+	std::erase_if(ranges, [](const SubMesh& range) { return range.count == 0; });
+	if (ranges.empty()) {
+		return;
+	}
+
+	struct VertexRange {
+		uint32_t first;
+		uint32_t last;
+	};
+	std::vector<VertexRange> vertexRanges;
+
+	for (const SubMesh& range : ranges) {
+		uint32_t* rangeIndices = &indices[range.start];
+
+		uint32_t maxIndex = 0;
+		uint32_t minIndex = ~0u;
+		for (int i = 0; i < range.count; ++i) {
+			maxIndex = std::max(maxIndex, rangeIndices[i]);
+			minIndex = std::min(minIndex, rangeIndices[i]);
+		}
+		MeshOptimiser::OptimiseVertexCache(rangeIndices, range.count, maxIndex + 1);
+		MeshOptimiser::OptimiseOverdraw(rangeIndices, range.count, GetPositionData().data() + range.base, maxIndex + 1);
+
+		vertexRanges.push_back({ range.base + minIndex, range.base + maxIndex });
+	}
+
+	//Vertices can only be moved if each SubMesh has vertices all to itself
+	std::vector<VertexRange> sortedRanges = vertexRanges;
+	std::sort(sortedRanges.begin(), sortedRanges.end(), [](const VertexRange& a, const VertexRange& b) {return a.first < b.first; });
+	bool overlapping = false;
+	for (size_t i = 1; i < sortedRanges.size(); ++i) {
+		overlapping |= sortedRanges[i].first <= sortedRanges[i - 1].last;
+	}
+	//The generic attributes have no setters, so they can't be reordered
+	if (overlapping || !GetGeneralVec4Data().empty() || !GetGeneralIntegerData().empty()) {
+		SetVertexIndices(indices);
+		return;
+	}
+
+	std::vector<uint32_t> remap(GetVertexCount());
+	for (uint32_t v = 0; v < remap.size(); ++v) {
+		remap[v] = v;
+	}
+	std::vector<uint32_t> rangeRemap;
+	for (size_t r = 0; r < ranges.size(); ++r) {
+		const SubMesh&		range	= ranges[r];
+		const VertexRange&	verts	= vertexRanges[r];
+		uint32_t* rangeIndices		= &indices[range.start];
+		uint32_t offset				= verts.first - range.base;
+
+		//Work relative to the first vertex the range uses, so the range keeps its place in the buffer
+		for (int i = 0; i < range.count; ++i) {
+			rangeIndices[i] -= offset;
+		}
+		MeshOptimiser::BuildFetchRemap(rangeIndices, range.count, verts.last - verts.first + 1, rangeRemap);
+		for (int i = 0; i < range.count; ++i) {
+			rangeIndices[i] = rangeRemap[rangeIndices[i]] + offset;
+		}
+		for (uint32_t v = 0; v < rangeRemap.size(); ++v) {
+			remap[verts.first + v] = verts.first + rangeRemap[v];
+		}
+	}
+
+	SetVertexPositions(RemapVertices(GetPositionData(), remap));
+	SetVertexColours(RemapVertices(GetColourData(), remap));
+	SetVertexTextureCoords(RemapVertices(GetTextureCoordData(), remap));
+	SetVertexNormals(RemapVertices(GetNormalData(), remap));
+	SetVertexTangents(RemapVertices(GetTangentData(), remap));
+	SetVertexSkinWeights(RemapVertices(GetSkinWeightData(), remap));
+	SetVertexSkinIndices(RemapVertices(GetSkinIndexData(), remap));
+	SetVertexIndices(indices);
+}
+
+void VulkanMesh::BuildMeshlets(MeshletData& data, uint32_t maxVertices, uint32_t maxTriangles) const {
+	if (primType != GeometryPrimitive::Triangles || GetIndexCount() == 0) {
+		return;
+	}
+	const std::vector<unsigned int>& indices = GetIndexData();
+
+	for (const SubMesh& range : GetLODRanges(0)) {
+		MeshletBuilder::BuildMeshlets(data, &indices[range.start], range.count, range.base, GetPositionData().data(), maxVertices, maxTriangles);
+	}
+}
+
+void VulkanMesh::GenerateLODs(uint32_t levelCount, float reduction) {
+	if (primType != GeometryPrimitive::Triangles || GetIndexCount() == 0 || levelCount < 2) {
+		return;
+	}
+	std::vector<unsigned int> indices = GetIndexData();
+
+	std::vector<SubMesh> ranges = subMeshes;
+	if (ranges.empty()) {
+		ranges.push_back({ 0, (int)indices.size(), 0 });
+	}
+	m_lodRanges = ranges;
+	m_lodErrors = { 0.0f };
+
+	const size_t subMeshCount = ranges.size();
+
+	std::vector<uint32_t> simplified;
+	for (uint32_t level = 1; level < levelCount; ++level) {
+		const SubMesh*	previous		= &m_lodRanges[(level - 1) * subMeshCount];
+		size_t			previousCount	= 0;
+		size_t			newCount		= 0;
+		float			levelError		= 0.0f;
+
+		std::vector<SubMesh> levelRanges;
+		for (size_t i = 0; i < subMeshCount; ++i) {
+			const SubMesh& range = previous[i];
+
+			uint32_t maxIndex = 0;
+			for (int j = 0; j < range.count; ++j) {
+				maxIndex = std::max(maxIndex, indices[range.start + j]);
+			}
+			simplified.resize(range.count);
+
+			//Each level is built from the last, so the errors add up
+			float error = 0.0f;
+			size_t count = MeshSimplifier::Simplify(simplified.data(), &indices[range.start], range.count,
+				GetPositionData().data() + range.base, maxIndex + 1, (size_t)(range.count * reduction), FLT_MAX, error);
+
+			MeshOptimiser::OptimiseVertexCache(simplified.data(), count, maxIndex + 1);
+
+			levelRanges.push_back({ (int)indices.size(), (int)count, range.base });
+			indices.insert(indices.end(), simplified.begin(), simplified.begin() + count);
+
+			previousCount	+= range.count;
+			newCount		+= count;
+			levelError		= std::max(levelError, error);
+		}
+		//Not worth keeping a level that's barely any simpler than the last
+		if (newCount > previousCount * 0.9f) {
+			indices.resize(levelRanges[0].start);
+			break;
+		}
+		m_lodRanges.insert(m_lodRanges.end(), levelRanges.begin(), levelRanges.end());
+		m_lodErrors.push_back(m_lodErrors.back() + levelError);
+	}
+	if (m_lodErrors.size() < 2) {
+		m_lodRanges.clear();
+		m_lodErrors.clear();
+		return;
+	}
+	SetVertexIndices(indices);
+}
+
+uint32_t VulkanMesh::SelectLOD(float distance, float projectionScale, float maxPixelError) const {
+	if (distance <= 0.0f) {
+		return 0;
+	}
+	for (uint32_t lod = GetLODCount() - 1; lod > 0; --lod) {
+		if (GetLODError(lod) * projectionScale / distance <= maxPixelError) {
+			return lod;
+		}
+	}
+	return 0;
+}
+
+void VulkanMesh::DrawLOD(vk::CommandBuffer toBuffer, uint32_t lod, uint32_t instanceCount, uint32_t firstInstance) const {
+	if (m_lodRanges.empty() && !m_arena) {
+		if (instanceCount == 1 && firstInstance == 0) {
+			GetMesh()->Draw(toBuffer);
+			return;
+		}
+		//Mesh::Draw only draws a single instance
+		if (m_gpuIndexCount == 0) {
+			toBuffer.draw(m_gpuVertexCount, instanceCount, 0, firstInstance);
+			return;
+		}
+	}
+	for (const SubMesh& range : GetLODRanges(lod)) {
+		toBuffer.drawIndexed(range.count, instanceCount, m_arenaAllocation.firstIndex + range.start, m_arenaAllocation.firstVertex + range.base, firstInstance);
+	}
+}
+
+std::vector<SubMesh> VulkanMesh::GetLODRanges(uint32_t lod) const {
+	if (m_lodRanges.empty()) {
+		if (subMeshes.empty()) {
+			return { { 0, (int)m_gpuIndexCount, 0 } };
+		}
+		return subMeshes;
+	}
+	lod = std::min(lod, GetLODCount() - 1);
+	size_t subMeshCount = m_lodRanges.size() / m_lodErrors.size();
+	return std::vector<SubMesh>(m_lodRanges.begin() + lod * subMeshCount, m_lodRanges.begin() + (lod + 1) * subMeshCount);
 }
 
 vk::PrimitiveTopology VulkanMesh::GetPrimitiveTopology() const {
@@ -8,30 +8,250 @@ License: MIT (see LICENSE file at the top of the source tree)
 #pragma once
 #include "../NCLCoreClasses/Mesh.h"
 #include "../VKQuick/Mesh.h"
+#include "MeshletBuilder.h"
+#include "MappedFile.h"
+
+#include <mutex>
 
 namespace NCL::Rendering::Vulkan {
+	/*
+	Quantised meshes keep positions and the generic attributes at full precision,
+	but store normals as octahedral-encoded snorm16 pairs, tangents as octahedral
+	encoded 10:10:10:2 unorm (handedness in alpha), UVs as halfs, colours and
+	skin weights as unorm8, and skin indices as uint8 (or uint16 if needed).
+	Shaders reading quantised normals / tangents must decode the octahedral vectors.
+	*/
+	enum class VertexFormat {
+		Full,
+		Quantised
+	};
+
+	enum class MeshStorage {
+		Static,		//Device local, filled via staging copies
+		Dynamic		//Host visible, written directly by the CPU
+	};
+
+	//Meshes and bytes allocated in a particular memory type
+	struct MeshMemoryUsage {
+		uint32_t	meshCount	= 0;
+		size_t		byteCount	= 0;
+		uint32_t	arenaPools	= 0;	//Buffers of VulkanMeshArenas, which the meshes in them share
+		size_t		arenaBytes	= 0;
+	};
+
+	class VulkanMeshArena;
+
+	//Where a mesh's vertices and indices live within a VulkanMeshArena
+	struct MeshArenaAllocation {
+		uint32_t firstVertex	= 0;
+		uint32_t vertexCount	= 0;
+		uint32_t firstIndex		= 0;
+		uint32_t indexCount		= 0;
+	};
+
 	class VulkanMesh : public Mesh {
 	public:
+		//Set in the upper half of GetAttributeMask for each attribute using a quantised format
+		static const uint32_t QUANTISED_ATTRIBUTE_SHIFT = 16;
+
 		VulkanMesh();
 		~VulkanMesh();
 
+		//Writes through MapData - static meshes are better uploaded via VulkanUploadQueue::UploadMesh
 		void	UploadAttributes(vk::CommandBuffer  to);
-		void	InitialiseGPUState(vk::Device device, VKQuick::MemoryManager& memManager, vk::BufferUsageFlags extraFlags = {});
+		//Fails, leaving the mesh without any buffers, if cooked data doesn't fit the buffer VKQuick builds for it
+		bool	InitialiseGPUState(vk::Device device, VKQuick::MemoryManager& memManager, vk::BufferUsageFlags extraFlags = {});
+
+		bool	HasGPUState() const {
+			return !m_meshes.empty();
+		}
 
 		vk::PrimitiveTopology GetPrimitiveTopology() const;
 
-		const VKQuick::UniqueMesh& GetMesh() const {
-			return m_mesh;
-		}
+		//For dynamic meshes, this is the buffer most recently written by UploadDirty
+		const VKQuick::UniqueMesh& GetMesh() const;
 
 		uint32_t	GetAttributeMask() const;
 
+		//Must be set before InitialiseGPUState
+		void SetVertexFormat(VertexFormat format) {
+			m_vertexFormat = format;
+		}
+
+		VertexFormat GetVertexFormat() const {
+			return m_vertexFormat;
+		}
+
+		vk::IndexType GetIndexType() const {
+			return m_indexType;
+		}
+
+		//Must be set before InitialiseGPUState
+		void SetStorage(MeshStorage storage) {
+			m_storage = storage;
+		}
+
+		MeshStorage GetStorage() const {
+			return m_storage;
+		}
+
+		//Must be set before InitialiseGPUState. Dynamic meshes get a buffer per frame in flight,
+		//so the CPU can write the next frame's vertices while the GPU is still reading the last.
+		void SetDynamicBufferCount(uint32_t count) {
+			m_dynamicBufferCount = count;
+		}
+
+		//Dynamic meshes only - records vertices that have changed since the last UploadDirty
+		void	MarkDirty(VertexAttribute::Type attribute, uint32_t firstVertex = 0, uint32_t vertexCount = ~0u);
+		void	MarkIndicesDirty();
+
+		//Writes everything changed since this frame's buffer was last written, and makes it the one GetMesh returns.
+		//The frame's previous commands must have completed, as they do once its fence has been waited on.
+		void	UploadDirty(uint32_t frame);
+
+		//Reorders each SubMesh's triangles for the post-transform cache and overdraw,
+		//then the vertices into fetch order. Must be called before InitialiseGPUState.
+		void	OptimiseForGPU();
+
+		//Appends up to levelCount - 1 simplified copies of the SubMeshes to the index data, each with
+		//reduction times the indices of the last. Call after OptimiseForGPU, and before InitialiseGPUState.
+		void	GenerateLODs(uint32_t levelCount = 4, float reduction = 0.5f);
+
+		uint32_t GetLODCount() const {
+			return m_lodErrors.empty() ? 1 : (uint32_t)m_lodErrors.size();
+		}
+
+		//Largest distance of the LOD's surface from the full detail mesh, in model space units
+		float GetLODError(uint32_t lod) const {
+			return lod < m_lodErrors.size() ? m_lodErrors[lod] : 0.0f;
+		}
+
+		//Coarsest LOD whose error covers no more than maxPixelError pixels. projectionScale is the
+		//viewport height / (2 * tan(fov / 2)), and distance is in model space units.
+		uint32_t SelectLOD(float distance, float projectionScale, float maxPixelError = 1.0f) const;
+
+		//The mesh (or its arena) must already be bound. LOD 0 of a mesh without LODs draws it as VKQuick::Mesh::Draw does.
+		void	DrawLOD(vk::CommandBuffer toBuffer, uint32_t lod, uint32_t instanceCount = 1, uint32_t firstInstance = 0) const;
+
+		//The index ranges drawn for a LOD, relative to the mesh's own index and vertex data
+		std::vector<SubMesh> GetLODRanges(uint32_t lod) const;
+
+		//Every range stored in the GPU buffer, for all LODs
+		std::vector<SubMesh> GetGPURanges() const;
+
+		//Model space bounds of every vertex, from the CPU side data when InitialiseGPUState
+		//was called, or from the cooked file. Dynamic meshes don't update them as vertices change.
+		const Maths::Vector3& GetBoundsMin() const {
+			return m_boundsMin;
+		}
+
+		const Maths::Vector3& GetBoundsMax() const {
+			return m_boundsMax;
+		}
+
+		//Null unless the mesh was added to a VulkanMeshArena instead of having its own buffer
+		const VulkanMeshArena* GetArena() const {
+			return m_arena;
+		}
+
+		const MeshArenaAllocation& GetArenaAllocation() const {
+			return m_arenaAllocation;
+		}
+
+		//Splits each SubMesh (or the whole mesh if it has none) into meshlets, one MeshletRange per SubMesh
+		void	BuildMeshlets(MeshletData& data, uint32_t maxVertices = MeshletBuilder::MAX_VERTICES, uint32_t maxTriangles = MeshletBuilder::MAX_TRIANGLES) const;
+
+		//Writes every attribute and the indices at their offsets within the mesh's GPU buffer
+		void	WriteGPUData(char* dst) const;
+
+		//Cooked meshes store the final contents of the GPU buffer, so they can be uploaded straight
+		//from the mapped file without rebuilding any vertex data. Call SaveCooked after InitialiseGPUState.
+		bool	SaveCooked(const std::string& filename, uint64_t sourceHash) const;
+		//Fails if the file is missing, out of date, or wasn't cooked from sourceHash
+		bool	LoadCooked(const std::string& filename, uint64_t sourceHash);
+
+		//Cooked meshes have no CPU side vertex data, only what's needed to upload and draw them
+		bool	IsCooked() const {
+			return m_cookedFile != nullptr;
+		}
+
+		//Unmaps the cooked file, once its data has been uploaded
+		void	ReleaseCookedData() {
+			m_cookedFile.reset();
+		}
+
+		uint32_t GetMemoryType() const {
+			return m_memoryType;
+		}
+
+		//Keyed by memory type index. Meshes are created and destroyed on job threads, so this is a copy.
+		static std::map<uint32_t, MeshMemoryUsage> GetMemoryUsage();
+		static void PrintMemoryReport(vk::PhysicalDevice gpu);
+
+		//The format an attribute takes in a vertex format, before any per-mesh promotion
+		static vk::Format	GetDefaultFormat(VertexFormat format, VertexAttribute::Type attribute);
+		static size_t		GetFormatSize(vk::Format format);
+
 	protected:
-		VKQuick::UniqueMesh m_mesh;
+		friend class VulkanMeshArena;
+
+		void	TrackMemory(bool add);
+		static void	TrackArenaMemory(const VKQuick::Buffer& pool, bool add);
+		void	ReleaseGPUState();
+		void	ChooseAttributeFormats();
+		void	ComputeBounds();
+
+		void	WriteAttribute(VertexAttribute::Type attribute, char* dst, uint32_t firstVertex = 0, uint32_t vertexCount = ~0u) const;
+		void	WriteIndices(char* dst) const;
+
+		//Vertices [first, first + count) of one attribute
+		struct DirtyRange {
+			uint32_t first;
+			uint32_t count;
+		};
+
+		//Persistently mapped, with the changes it has missed since it was last written
+		struct DynamicBuffer {
+			char*					data = nullptr;
+			std::vector<DirtyRange>	dirtyRanges[VertexAttribute::MAX_ATTRIBUTES];
+			bool					indicesDirty = false;
+		};
+
+		std::vector<VKQuick::UniqueMesh>	m_meshes;
+		std::vector<DynamicBuffer>			m_dynamicBuffers;
+		uint32_t							m_currentBuffer			= 0;
+		uint32_t							m_dynamicBufferCount	= 1;
 
 		uint32_t	m_attributeMask		= 0;
 
-		std::vector< VertexAttribute::Type >	m_usedAttributes;		
+		//Either from the CPU side data, or a cooked file
+		uint32_t		m_gpuVertexCount = 0;
+		uint32_t		m_gpuIndexCount	 = 0;
+		Maths::Vector3	m_boundsMin;
+		Maths::Vector3	m_boundsMax;
+
+		std::unique_ptr<MappedFile>	m_cookedFile;
+		const char*					m_cookedGPUData = nullptr;
+		size_t						m_cookedGPUSize = 0;
+
+		VertexFormat	m_vertexFormat	= VertexFormat::Full;
+		vk::IndexType	m_indexType		= vk::IndexType::eUint32;
+		vk::Format		m_attributeFormats[VertexAttribute::MAX_ATTRIBUTES] = {};
+
+		MeshStorage		m_storage		= MeshStorage::Static;
+		uint32_t		m_memoryType	= ~0u;
+
+		static std::map<uint32_t, MeshMemoryUsage> s_memoryUsage;
+		static std::mutex							s_memoryMutex;
+
+		std::vector< VertexAttribute::Type >	m_usedAttributes;
+
+		//Every LOD has one range per SubMesh, stored one LOD after another, after LOD 0's ranges
+		std::vector< SubMesh >	m_lodRanges;
+		std::vector< float >	m_lodErrors;
+
+		const VulkanMeshArena*	m_arena = nullptr;
+		MeshArenaAllocation		m_arenaAllocation;
 	};
 
 	using UniqueVulkanMesh = std::unique_ptr<VulkanMesh>;
@@ -0,0 +1,146 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "VulkanMeshArena.h"
+#include "VulkanUploadQueue.h"
+
+#include "../VKQuick/MemoryManager.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+VulkanMeshArena::VulkanMeshArena(vk::Device device, VKQuick::MemoryManager& memManager, VertexFormat format,
+	uint32_t maxVertices, uint32_t maxIndices, uint32_t attributeMask, vk::BufferUsageFlags extraFlags)
+	: m_device(device), m_memoryManager(memManager), m_vertexFormat(format), m_vertexAllocator(maxVertices), m_indexAllocator(maxIndices)
+{
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		if (!(attributeMask & (1 << i))) {
+			continue;
+		}
+		m_attributeFormats[i] = VulkanMesh::GetDefaultFormat(format, (VertexAttribute::Type)i);
+		m_attributeBuffers[i] = memManager.CreateBuffer(
+			{
+				.size	= maxVertices * VulkanMesh::GetFormatSize(m_attributeFormats[i]),
+				.usage	= vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst | extraFlags
+			},
+			vk::MemoryPropertyFlagBits::eDeviceLocal,
+			"Mesh Arena Attribute Pool " + std::to_string(i)
+		);
+		VulkanMesh::TrackArenaMemory(m_attributeBuffers[i], true);
+	}
+	m_indexBuffer = memManager.CreateBuffer(
+		{
+			.size	= maxIndices * sizeof(uint32_t),
+			.usage	= vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst | extraFlags
+		},
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		"Mesh Arena Index Pool"
+	);
+	VulkanMesh::TrackArenaMemory(m_indexBuffer, true);
+}
+
+VulkanMeshArena::~VulkanMeshArena() {
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		if (m_attributeBuffers[i].buffer) {
+			VulkanMesh::TrackArenaMemory(m_attributeBuffers[i], false);
+			m_memoryManager.DiscardBuffer(m_attributeBuffers[i], VKQuick::DiscardMode::Immediate);
+		}
+	}
+	VulkanMesh::TrackArenaMemory(m_indexBuffer, false);
+	m_memoryManager.DiscardBuffer(m_indexBuffer, VKQuick::DiscardMode::Immediate);
+}
+
+bool VulkanMeshArena::AddMesh(VulkanMesh& mesh, VulkanUploadQueue& uploads) {
+	assert(mesh.m_arena == nullptr);
+
+	mesh.SetVertexFormat(m_vertexFormat);
+	mesh.ChooseAttributeFormats();
+	mesh.ComputeBounds();
+
+	for (VertexAttribute::Type attribute : mesh.m_usedAttributes) {
+		if (!m_attributeBuffers[attribute].buffer || mesh.m_attributeFormats[attribute] != m_attributeFormats[attribute]) {
+			return false;
+		}
+	}
+	size_t firstVertex	= 0;
+	size_t firstIndex	= 0;
+	if (!m_vertexAllocator.Allocate(mesh.GetVertexCount(), firstVertex)) {
+		return false;
+	}
+	if (!m_indexAllocator.Allocate(mesh.GetIndexCount(), firstIndex)) {
+		m_vertexAllocator.Free(firstVertex, mesh.GetVertexCount());
+		return false;
+	}
+	mesh.m_arena			= this;
+	mesh.m_indexType		= vk::IndexType::eUint32;
+	mesh.m_arenaAllocation	= {
+		.firstVertex	= (uint32_t)firstVertex,
+		.vertexCount	= mesh.GetVertexCount(),
+		.firstIndex		= (uint32_t)firstIndex,
+		.indexCount		= mesh.GetIndexCount()
+	};
+
+	for (VertexAttribute::Type attribute : mesh.m_usedAttributes) {
+		size_t elementSize	= VulkanMesh::GetFormatSize(m_attributeFormats[attribute]);
+		size_t size			= elementSize * mesh.GetVertexCount();
+
+		StagingAllocation staging = uploads.AllocateStaging(size);
+		mesh.WriteAttribute(attribute, staging.data);
+
+		//Allocating may have flushed the batch, so the copy must go in whichever is current now
+		uploads.GetCommandBuffer().copyBuffer(staging.buffer, m_attributeBuffers[attribute].buffer,
+			vk::BufferCopy{
+				.srcOffset	= staging.offset,
+				.dstOffset	= firstVertex * elementSize,
+				.size		= size
+			}
+		);
+	}
+	if (mesh.GetIndexCount() > 0) {
+		uploads.UploadToBuffer(m_indexBuffer.buffer, firstIndex * sizeof(uint32_t), mesh.GetIndexData().data(), mesh.GetIndexCount() * sizeof(uint32_t));
+	}
+	m_meshCount++;
+	return true;
+}
+
+void VulkanMeshArena::RemoveMesh(VulkanMesh& mesh) {
+	assert(mesh.m_arena == this);
+
+	const MeshArenaAllocation& allocation = mesh.m_arenaAllocation;
+	m_vertexAllocator.Free(allocation.firstVertex, allocation.vertexCount);
+	m_indexAllocator.Free(allocation.firstIndex, allocation.indexCount);
+
+	mesh.m_arena			= nullptr;
+	mesh.m_arenaAllocation	= {};
+	m_meshCount--;
+}
+
+void VulkanMeshArena::Bind(vk::CommandBuffer toBuffer) const {
+	vk::Buffer		buffers[VertexAttribute::MAX_ATTRIBUTES];
+	vk::DeviceSize	offsets[VertexAttribute::MAX_ATTRIBUTES] = {};
+	for (uint32_t i = 0; i < VertexAttribute::MAX_ATTRIBUTES; ++i) {
+		buffers[i] = m_attributeBuffers[i].buffer;
+	}
+	toBuffer.bindVertexBuffers(0, VertexAttribute::MAX_ATTRIBUTES, buffers, offsets);
+	toBuffer.bindIndexBuffer(m_indexBuffer.buffer, 0, vk::IndexType::eUint32);
+}
+
+void VulkanMeshArena::WriteDrawCommands(const VulkanMesh& mesh, uint32_t lod, uint32_t firstInstance, std::vector<vk::DrawIndexedIndirectCommand>& commands) const {
+	assert(mesh.m_arena == this);
+
+	const MeshArenaAllocation& allocation = mesh.m_arenaAllocation;
+	for (const SubMesh& range : mesh.GetLODRanges(lod)) {
+		commands.push_back({
+			.indexCount		= (uint32_t)range.count,
+			.instanceCount	= 1,
+			.firstIndex		= allocation.firstIndex + range.start,
+			.vertexOffset	= (int32_t)(allocation.firstVertex + range.base),
+			.firstInstance	= firstInstance
+		});
+	}
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "VulkanMesh.h"
+#include "RangeAllocator.h"
+
+namespace NCL::Rendering::Vulkan {
+	class VulkanUploadQueue;
+
+	/*
+	Shared, device local vertex and index pools that many meshes are
+	sub-allocated from, so that every mesh in the arena can be drawn after
+	a single Bind, or from one drawIndexedIndirect. Each attribute has its
+	own pool, bound at binding N for VertexAttribute N, and all pools use
+	the same vertex offset for a mesh. Indices are always 32 bit.
+	*/
+	class VulkanMeshArena {
+	public:
+		VulkanMeshArena(vk::Device device, VKQuick::MemoryManager& memManager, VertexFormat format,
+			uint32_t maxVertices, uint32_t maxIndices, uint32_t attributeMask = ~0u, vk::BufferUsageFlags extraFlags = {});
+		~VulkanMeshArena();
+
+		//Copies the mesh's data into the arena via the upload queue. Fails if the arena is full, or
+		//the mesh uses an attribute outside of the arena's mask, or in a format its pools don't store.
+		bool AddMesh(VulkanMesh& mesh, VulkanUploadQueue& uploads);
+
+		//The GPU must have finished with the mesh before its space is reused
+		void RemoveMesh(VulkanMesh& mesh);
+
+		//Binds every attribute pool and the index pool. Attributes outside of the mask get a null buffer.
+		void Bind(vk::CommandBuffer toBuffer) const;
+
+		//Appends one indirect draw per range of the mesh's LOD
+		void WriteDrawCommands(const VulkanMesh& mesh, uint32_t lod, uint32_t firstInstance, std::vector<vk::DrawIndexedIndirectCommand>& commands) const;
+
+		const VKQuick::Buffer& GetAttributeBuffer(VertexAttribute::Type attribute) const {
+			return m_attributeBuffers[attribute];
+		}
+
+		vk::Format GetAttributeFormat(VertexAttribute::Type attribute) const {
+			return m_attributeFormats[attribute];
+		}
+
+		const VKQuick::Buffer& GetIndexBuffer() const {
+			return m_indexBuffer;
+		}
+
+		uint32_t GetMeshCount() const {
+			return m_meshCount;
+		}
+
+		size_t GetFreeVertices() const {
+			return m_vertexAllocator.GetFreeSpace();
+		}
+
+		size_t GetFreeIndices() const {
+			return m_indexAllocator.GetFreeSpace();
+		}
+
+	protected:
+		vk::Device				m_device;
+		VKQuick::MemoryManager&	m_memoryManager;
+
+		VertexFormat		m_vertexFormat;
+		vk::Format			m_attributeFormats[VertexAttribute::MAX_ATTRIBUTES] = {};
+		VKQuick::Buffer		m_attributeBuffers[VertexAttribute::MAX_ATTRIBUTES];
+		VKQuick::Buffer		m_indexBuffer;
+
+		RangeAllocator		m_vertexAllocator;
+		RangeAllocator		m_indexAllocator;
+
+		uint32_t			m_meshCount = 0;
+	};
+}
\ No newline at end of file
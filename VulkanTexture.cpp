@@ -12,10 +12,28 @@ using namespace NCL;
 using namespace Rendering;
 using namespace Vulkan;
 
-VulkanTexture::VulkanTexture(VKQuick::Texture& t) : m_texture(t){
+VulkanTexture::VulkanTexture() : m_isPlaceholder(true) {
 
 }
 
+VulkanTexture::VulkanTexture(VKQuick::Texture& t) : m_texture(t), m_isPlaceholder(false) {
+
+}
+
+VulkanTexture::VulkanTexture(FinishFunction finish) : m_isPlaceholder(true), m_finish(std::move(finish)) {
+
+}
+
+void VulkanTexture::Finish() const {
+	if (!m_isPlaceholder) {
+		return;
+	}
+	assert(m_finish);
+	m_texture		= *(m_finish().release());
+	m_isPlaceholder = false;
+	m_finish		= nullptr;
+}
+
 VulkanTexture::~VulkanTexture()	{
 
 }
\ No newline at end of file
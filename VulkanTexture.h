@@ -9,18 +9,47 @@ License: MIT (see LICENSE file at the top of the source tree)
 #include "../NCLCoreClasses/Texture.h"
 #include "../VKQuick/Texture.h"
 
+#include <functional>
+
 namespace NCL::Rendering::Vulkan {
 	class VulkanTexture : public Texture {
 	public:
+		using FinishFunction = std::function<VKQuick::UniqueTexture()>;
+
+		VulkanTexture();
 		VulkanTexture(VKQuick::Texture& t);
+		//A placeholder for a texture whose data is still being decoded, such as from a GLTF file.
+		//finish creates its image, and is called the first time the texture is needed.
+		VulkanTexture(FinishFunction finish);
 		~VulkanTexture();
 
+		//For textures whose data was still being decoded when they were handed out
+		void SetTexture(VKQuick::Texture& t) {
+			m_texture		= t;
+			m_isPlaceholder = false;
+			m_finish		= nullptr;
+		}
+
+		//Creates a placeholder's image now, waiting for its data to decode if need be
+		void Finish() const;
+
+		//Placeholders have no image until SetTexture or Finish
+		bool IsPlaceholder() const {
+			return m_isPlaceholder;
+		}
+
 		const VKQuick::Texture& GetTex() const {
+			if (m_isPlaceholder) {
+				Finish();
+			}
 			return m_texture;
 		}
 
 	protected:
-		VKQuick::Texture m_texture;
+		//Finishing a placeholder doesn't change what the texture is, so can be done through const
+		mutable VKQuick::Texture	m_texture;
+		mutable bool				m_isPlaceholder;
+		mutable FinishFunction		m_finish;
 	};
 
 	using UniqueVulkanTexture = std::unique_ptr<VulkanTexture>;
@@ -17,6 +17,10 @@ License: MIT (see LICENSE file at the top of the source tree)
 #include "../VKQuick/Texture.h"
 
 #include "MshLoader.h"
+#include "HashUtils.h"
+#include "MappedFile.h"
+#include "KTX2File.h"
+#include "IndirectDrawGenerator.h"
 
 #include "../GLTFLoader/GLTFLoader.h"
 
@@ -24,6 +28,7 @@ License: MIT (see LICENSE file at the top of the source tree)
 #include "Shaders/VK/Camera.glslh"
 
 using namespace NCL;
+using namespace Maths;
 using namespace Rendering;
 using namespace Vulkan;
 
@@ -33,11 +38,12 @@ VulkanTutorial::VulkanTutorial(VKQuick::VKQuickInitialisation& vkInit) : m_contr
 	m_runTime	= 0.0f;
 	m_vkInit	= vkInit;
 
-	VKQuick::TextureLoadFunction tlf = [](const std::string& filename) -> VKQuick::LoadedTexture {
-		VKQuick::LoadedTexture lt;
-		uint32_t flags = 0;
-		TextureLoader::LoadTexture(filename, lt.texData, lt.dimensions.width, lt.dimensions.height, lt.channels, flags);
-		return lt;
+	m_jobSystem = std::make_unique<JobSystem>();
+	m_occlusionCuller = std::make_unique<OcclusionCuller>(m_jobSystem.get());
+
+	//Anything prefetched has already been decoded, or is being decoded right now
+	VKQuick::TextureLoadFunction tlf = [this](const std::string& filename) -> VKQuick::LoadedTexture {
+		return TakeDecodedTexture(filename);
 	};
 
 	VKQuick::TextureLoadReleaseFunction trf = [](VKQuick::LoadedTexture& texture) -> void {
@@ -48,8 +54,14 @@ VulkanTutorial::VulkanTutorial(VKQuick::VKQuickInitialisation& vkInit) : m_contr
 
 	GLTFLoader::SetTextureConstructionFunction(
 		[&](std::string& input) ->  SharedTexture {
-			VulkanTexture* texture = new VulkanTexture(*(LoadTexture(input).release()));
-			return std::shared_ptr<Texture>(texture);
+			PrefetchTextures({ input });
+			//Created by whichever comes first, the texture being used or the next FinishPendingTextures
+			SharedVulkanTexture texture = std::make_shared<VulkanTexture>([this, input]() {
+				return LoadTexture(input);
+			});
+			std::lock_guard lock(m_pendingMutex);
+			m_pendingTextures.push_back(texture);
+			return texture;
 		}
 	);
 
@@ -60,12 +72,32 @@ VulkanTutorial::VulkanTutorial(VKQuick::VKQuickInitialisation& vkInit) : m_contr
 
 VulkanTutorial::~VulkanTutorial() {
 	m_vkQuick->GetDevice().waitIdle();
+
+	//Nothing else will ever take these, so wait for them to finish decoding and throw them away
+	for (auto& [filename, decoded] : m_decodedTextures) {
+		m_jobSystem->Wait(decoded->job);
+		TextureLoader::DeleteTextureData(decoded->texture.texData);
+	}
+	m_decodedTextures.clear();
+	m_pendingTextures.clear();
+	m_occlusionCuller.reset();
+	m_jobSystem.reset();
+
+	VKQuick::TextureBuilder::SetFileHandlingFunctions(
+		[](const std::string& filename) -> VKQuick::LoadedTexture { return DecodeTexture(filename); },
+		[](VKQuick::LoadedTexture& texture) -> void { TextureLoader::DeleteTextureData(texture.texData); }
+	);
+
 	for (auto& state : m_cameraStates) {
 		state.descriptor.reset();
 		m_vkQuick->GetMemoryManager().DiscardBuffer(state.buffer, VKQuick::DiscardMode::Immediate);
 	}
 	m_cameraLayout.reset();
+	m_frameAllocator.reset();
+	m_parallelRecorder.reset();
+	m_materialSets.clear();
 	m_defaultSampler.reset();
+	m_uploadQueue.reset();
 
 	m_triangleMesh.reset();
 	m_quadMesh.reset();
@@ -73,6 +105,9 @@ VulkanTutorial::~VulkanTutorial() {
 	m_cubeMesh.reset();
 	m_sphereMesh.reset();
 
+	m_shaderCache.reset();
+	m_pipelineCache.reset();	//Saves it for the next run
+
 	delete m_vkQuick;
 }
 
@@ -97,6 +132,15 @@ void VulkanTutorial::Initialise() {
 
 	vk::Device device = context.device;
 
+	//Compiling pipelines is most of a cold start, so their cache is kept alongside the shaders
+	m_pipelineCache	= std::make_unique<PipelineCache>(device, m_vkQuick->GetPhysicalDevice(), m_vkInit.shaderRoot + "PipelineCache.bin");
+	m_shaderCache	= std::make_unique<ShaderModuleCache>(device);
+
+	m_uploadQueue = std::make_unique<VulkanUploadQueue>(device,
+		context.queues[VKQuick::CommandType::Graphics],
+		context.queueFamilies[VKQuick::CommandType::Graphics],
+		m_vkQuick->GetMemoryManager());
+
 	m_defaultSampler = device.createSamplerUnique(
 		vk::SamplerCreateInfo()
 		.setAnisotropyEnable(false)
@@ -107,32 +151,23 @@ void VulkanTutorial::Initialise() {
 		.setMaxLod(80.0f)
 	);
 
+	m_frameAllocator = std::make_unique<FrameAllocator>(device, context.descriptorPool, m_vkQuick->GetMemoryManager(), m_vkInit.framesInFlight);
+
 	m_cameraLayout = VKQuick::DescriptorSetLayoutBuilder(device)
 		.WithUniformBuffers(0, 1, vk::ShaderStageFlagBits::eAll)
 		.Build("CameraMatrices"); //Get our m_camera matrices...
 
-	m_cameraStates.resize(m_vkInit.framesInFlight);
-
-	for (auto& state : m_cameraStates) {
-		state.descriptor	= VKQuick::CreateDescriptorSet(device, context.descriptorPool, *m_cameraLayout);
-		state.buffer		= m_vkQuick->GetMemoryManager().CreateBuffer(
-			{
-				.size	= sizeof(ShaderCamera),
-				.usage	= vk::BufferUsageFlagBits::eUniformBuffer,
-			},
-			vk::MemoryPropertyFlagBits::eHostVisible |
-			vk::MemoryPropertyFlagBits::eHostCoherent,
-			"Camera Buffer"
-		);
 
-		WriteBufferDescriptor(device, *state.descriptor, 0, vk::DescriptorType::eUniformBuffer, state.buffer);
-	}
+	m_parallelRecorder = std::make_unique<ParallelRecorder>(device, context.queueFamilies[VKQuick::CommandType::Graphics], m_vkInit.framesInFlight, m_jobSystem.get());
 
 	m_triangleMesh	= GenerateTriangle();
 	m_quadMesh		= GenerateQuad();
 	m_gridMesh		= GenerateGrid();
-	m_cubeMesh		= LoadMesh("Cube.msh");
-	m_sphereMesh	= LoadMesh("Sphere.msh");
+	std::vector<UniqueVulkanMesh> meshes = LoadMeshes({ "Cube.msh", "Sphere.msh" });
+	m_cubeMesh		= std::move(meshes[0]);
+	m_sphereMesh	= std::move(meshes[1]);
+
+	m_uploadQueue->Flush();
 }
 
 void VulkanTutorial::BuildCamera() {
@@ -151,21 +186,54 @@ void VulkanTutorial::BuildCamera() {
 }
 
 const CameraState& VulkanTutorial::GetCameraState(const VKQuick::FrameContext& context) {
-	return m_cameraStates[context.cycleID];
+	if (m_cameraStates.empty()) {
+		m_cameraStates.resize(m_vkInit.framesInFlight);
+		m_cameraStateUploads.resize(m_vkInit.framesInFlight, 0);
+
+		for (auto& state : m_cameraStates) {
+			state.descriptor	= VKQuick::CreateDescriptorSet(context.device, context.descriptorPool, *m_cameraLayout);
+			state.buffer		= m_vkQuick->GetMemoryManager().CreateBuffer(
+				{
+					.size	= sizeof(ShaderCamera),
+					.usage	= vk::BufferUsageFlagBits::eUniformBuffer,
+				},
+				vk::MemoryPropertyFlagBits::eHostVisible |
+				vk::MemoryPropertyFlagBits::eHostCoherent,
+				"Camera Buffer"
+			);
+
+			WriteBufferDescriptor(context.device, *state.descriptor, 0, vk::DescriptorType::eUniformBuffer, state.buffer);
+		}
+	}
+	//BeginFrame has waited for this cycle's last frame, so its buffer is free to rewrite
+	CameraState& s = m_cameraStates[context.cycleID];
+	if (m_cameraData && m_cameraStateUploads[context.cycleID] != m_cameraUploads) {
+		*s.buffer.Map<ShaderCamera>() = *m_cameraData;
+		s.buffer.Unmap();
+		m_cameraStateUploads[context.cycleID] = m_cameraUploads;
+	}
+	return s;
 }
 
-void VulkanTutorial::UploadCameraUniform() {
-	VKQuick::FrameContext const& context = m_vkQuick->GetFrameContext();
+CameraBinding VulkanTutorial::GetCameraBinding() const {
+	return { m_frameAllocator->GetUniformSet(), m_cameraOffset };
+}
 
-	CameraState& s = m_cameraStates[context.cycleID];
+void VulkanTutorial::UploadCameraUniform() {
+	Matrix4 viewMatrix = m_camera.BuildViewMatrix();
+	Matrix4 projMatrix = m_camera.BuildProjectionMatrix(Window::GetWindow()->GetScreenAspect());
 
-	ShaderCamera* shaderCam = s.buffer.Map<ShaderCamera>();
+	FrameAllocator::Allocation a = m_frameAllocator->Allocate(sizeof(ShaderCamera));
+	ShaderCamera* shaderCam = (ShaderCamera*)a.data;
 
-	shaderCam->viewMatrix	= m_camera.BuildViewMatrix();
-	shaderCam->projMatrix	= m_camera.BuildProjectionMatrix(Window::GetWindow()->GetScreenAspect());
+	shaderCam->viewMatrix	= viewMatrix;
+	shaderCam->projMatrix	= projMatrix;
 	shaderCam->position		= m_camera.GetPosition();
 
-	s.buffer.Unmap();
+	m_cameraData		= shaderCam;
+	m_cameraUploads++;
+	m_cameraOffset		= a.offset;
+	m_cameraViewProj	= projMatrix * viewMatrix;
 }
 
 void VulkanTutorial::UpdateCamera(float dt) {
@@ -178,11 +246,18 @@ void VulkanTutorial::RunFrame(float dt) {
 		return;
 	}	
 	m_vkQuick->BeginFrame();
+	//BeginFrame has waited for this cycle's previous frame, so its transient data can be overwritten
+	m_frameAllocator->BeginFrame(m_vkQuick->GetFrameContext().cycleID);
+	m_parallelRecorder->BeginFrame(m_vkQuick->GetFrameContext().cycleID);
 
+	FinishPendingTextures();
 	Update(dt);
 
+	//After Update, so it sees where the camera has moved to this frame
 	UploadCameraUniform();
 	RenderFrame(dt);
+	//Anything uploaded this frame must be submitted ahead of the frame itself
+	m_uploadQueue->Flush();
 	m_vkQuick->EndFrame();
 	m_vkQuick->SwapBuffers();
 };
@@ -207,7 +282,7 @@ UniqueVulkanMesh VulkanTutorial::GenerateTriangle() {
 	triMesh->SetDebugName("Triangle");
 	triMesh->SetPrimitiveType(NCL::GeometryPrimitive::Triangles);
 
-	UploadMeshWait(*triMesh);
+	UploadMesh(*triMesh);
 
 	return UniqueVulkanMesh(triMesh);
 }
@@ -220,7 +295,7 @@ UniqueVulkanMesh VulkanTutorial::GenerateQuad() {
 	quadMesh->SetDebugName("Fullscreen Quad");
 	quadMesh->SetPrimitiveType(NCL::GeometryPrimitive::TriangleStrip);
 
-	UploadMeshWait(*quadMesh);
+	UploadMesh(*quadMesh);
 
 	return UniqueVulkanMesh(quadMesh);
 }
@@ -233,56 +308,145 @@ UniqueVulkanMesh VulkanTutorial::GenerateGrid() {
 	gridMesh->SetDebugName("Test Grid");
 	gridMesh->SetPrimitiveType(NCL::GeometryPrimitive::TriangleStrip);
 
-	UploadMeshWait(*gridMesh);
+	UploadMesh(*gridMesh);
 
 	return UniqueVulkanMesh(gridMesh);
 }
 
-UniqueVulkanMesh VulkanTutorial::LoadMesh(const std::string& filename, vk::BufferUsageFlags flags) {
-	VulkanMesh* newMesh = new VulkanMesh();
+UniqueVulkanMesh VulkanTutorial::LoadMesh(const std::string& filename, vk::BufferUsageFlags flags, const MeshLoadOptions& options) {
+	PendingMesh pending = PrepareMesh(filename, options);
+	return FinishMesh(pending, flags);
+}
 
-	MshLoader::LoadMesh(filename, *newMesh);
-	UploadMeshWait(*newMesh, flags);
-	return UniqueVulkanMesh(newMesh);
+std::vector<UniqueVulkanMesh> VulkanTutorial::LoadMeshes(const std::vector<std::string>& filenames, vk::BufferUsageFlags flags, const MeshLoadOptions& options) {
+	std::vector<PendingMesh> pending(filenames.size());
+	m_jobSystem->ParallelFor((uint32_t)filenames.size(), [&](uint32_t i) {
+		pending[i] = PrepareMesh(filenames[i], options);
+	});
+	std::vector<UniqueVulkanMesh> meshes;
+	for (PendingMesh& p : pending) {
+		meshes.push_back(FinishMesh(p, flags));
+	}
+	return meshes;
+}
+
+//Doesn't touch the device, so is safe to call from any thread
+VulkanTutorial::PendingMesh VulkanTutorial::PrepareMesh(const std::string& filename, const MeshLoadOptions& options, bool useCooked) {
+	PendingMesh pending;
+	pending.mesh		= std::make_unique<VulkanMesh>();
+	pending.filename	= filename;
+	pending.options		= options;
+
+	//Meshes are cooked next to their source file, keyed by a hash of its contents and the options that change
+	//what is cooked. Without a hash nothing is loaded from or saved to the cooked file.
+	pending.cookedFile = Assets::MESHDIR + filename + ".vkmesh";
+	if (!options.keepCPUData) {
+		MappedFile source(Assets::MESHDIR + filename);
+		uint32_t cookFlags = (options.optimise ? 1 : 0) | (options.generateLODs ? 2 : 0);
+		pending.sourceHash = source.IsValid() ? HashValue(cookFlags, HashBytes(source.GetData(), source.GetSize())) : 0;
+	}
+	if (useCooked && pending.sourceHash && pending.mesh->LoadCooked(pending.cookedFile, pending.sourceHash)) {
+		pending.isCooked = true;
+		return pending;
+	}
+	MshLoader::LoadMesh(filename, *pending.mesh);
+	if (options.optimise) {
+		pending.mesh->OptimiseForGPU();
+	}
+	if (options.generateLODs) {
+		pending.mesh->GenerateLODs();
+	}
+	return pending;
+}
+
+UniqueVulkanMesh VulkanTutorial::FinishMesh(PendingMesh& pending, vk::BufferUsageFlags flags) {
+	UploadMesh(*pending.mesh, flags);
+	if (pending.isCooked) {
+		pending.mesh->ReleaseCookedData();
+		if (!pending.mesh->HasGPUState()) {
+			//Cooked for a buffer layout VKQuick no longer builds, so start again from the source file
+			PendingMesh fromSource = PrepareMesh(pending.filename, pending.options, false);
+			return FinishMesh(fromSource, flags);
+		}
+	}
+	else if (pending.sourceHash) {
+		pending.mesh->SaveCooked(pending.cookedFile, pending.sourceHash);
+	}
+	return std::move(pending.mesh);
+}
+
+UploadHandle VulkanTutorial::UploadMesh(VulkanMesh& m, vk::BufferUsageFlags flags) {
+	if (m.GetStorage() == MeshStorage::Dynamic) {
+		m.SetDynamicBufferCount(m_vkInit.framesInFlight);
+	}
+	return m_uploadQueue->UploadMesh(m, flags);
 }
 
 void VulkanTutorial::UploadMeshWait(VulkanMesh& m, vk::BufferUsageFlags flags) {
+	UploadMesh(m, flags).Wait();
+}
+
+VKQuick::UniqueTexture VulkanTutorial::LoadTexture(const std::string& filename) {
 	VKQuick::FrameContext const& context = m_vkQuick->GetFrameContext();
 
-	vk::UniqueCommandBuffer cmdBuffer = VKQuick::CmdBufferCreateBegin(context.device, context.commandPools[VKQuick::CommandType::Graphics], "VulkanMesh upload");
+	return VKQuick::TextureBuilder(context.device, m_vkQuick->GetMemoryManager())
+		.WithCommandBuffer(m_uploadQueue->GetCommandBuffer())
+		.BuildFromFile(filename);
+}
 
-	m.InitialiseGPUState(context.device, m_vkQuick->GetMemoryManager(), flags);
+VKQuick::UniqueTexture VulkanTutorial::LoadCompressedTexture(const std::string& filename, BlockFormat format, bool srgb) {
+	VKQuick::FrameContext const& context = m_vkQuick->GetFrameContext();
 
-	m.UploadAttributes(*cmdBuffer);
+	CompressedTexture compressed;
+	if (!CookTexture(filename, compressed, format, srgb)) {
+		return nullptr;
+	}
 
-	VKQuick::CmdBufferSubmit(
-		{
-			.buffer = *cmdBuffer,
-			.queue = context.queues[VKQuick::CommandType::Graphics],
-			.device = context.device,
-			.wait = true
-		}
-	);
+	//Block compressed formats can't be blitted, so every mip level is copied in from the file
+	VKQuick::UniqueTexture texture = VKQuick::TextureBuilder(context.device, m_vkQuick->GetMemoryManager())
+		.WithFormat(compressed.format)
+		.WithDimension(compressed.width, compressed.height)
+		.WithMips(true)
+		.WithUsages(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst)
+		.Build(filename);
+
+	m_uploadQueue->UploadToImage(texture->GetImage(), compressed);
+	return texture;
 }
 
-VKQuick::UniqueTexture VulkanTutorial::LoadTexture(const std::string& filename) {
-	VKQuick::FrameContext const& context = m_vkQuick->GetFrameContext();
-	vk::UniqueCommandBuffer cmdBuffer = VKQuick::CmdBufferCreateBegin(context.device, context.commandPools[VKQuick::CommandType::Graphics], "VulkanTexture upload");
-	
-	VKQuick::UniqueTexture tex = VKQuick::TextureBuilder(context.device, m_vkQuick->GetMemoryManager())
-	.WithCommandBuffer(*cmdBuffer)
-	.BuildFromFile(filename);
-
-	VKQuick::CmdBufferSubmit(
-		{
-			.buffer = *cmdBuffer,
-			.queue	= context.queues[VKQuick::CommandType::Graphics],
-			.device = context.device,
-			.wait	= true
+bool VulkanTutorial::CookTexture(const std::string& filename, CompressedTexture& texture, BlockFormat format, bool srgb) {
+	//Keyed by the contents of the source image, and the format it was compressed to
+	std::string cookedFile	= Assets::TEXTUREDIR + filename + ".ktx2";
+	uint64_t	sourceHash	= 0;
+	{
+		MappedFile source(Assets::TEXTUREDIR + filename);
+		if (source.IsValid()) {
+			sourceHash = HashBytes(source.GetData(), source.GetSize());
+			sourceHash = HashValue(TextureCompressor::GetFormat(format, srgb), sourceHash);
 		}
-	);
+	}
+	if (sourceHash && KTX2File::Load(cookedFile, texture, sourceHash)) {
+		return true;
+	}
+	VKQuick::LoadedTexture decoded = TakeDecodedTexture(filename);
+	if (!decoded.texData) {
+		return false;
+	}
+	uint32_t texelCount = decoded.dimensions.width * decoded.dimensions.height;
 
-	return tex;
+	std::vector<uint8_t> rgba(texelCount * 4, 255);
+	for (uint32_t i = 0; i < texelCount; ++i) {
+		for (uint32_t c = 0; c < decoded.channels && c < 4; ++c) {
+			rgba[i * 4 + c] = (uint8_t)decoded.texData[i * decoded.channels + c];
+		}
+	}
+	TextureLoader::DeleteTextureData(decoded.texData);
+
+	TextureCompressor::Compress(texture, rgba.data(), decoded.dimensions.width, decoded.dimensions.height, format, srgb, MipFilter::Kaiser, m_jobSystem.get());
+	if (sourceHash) {
+		KTX2File::Save(cookedFile, texture, sourceHash);
+	}
+	return true;
 }
 
 VKQuick::UniqueTexture VulkanTutorial::LoadCubemap(
@@ -292,39 +456,175 @@ VKQuick::UniqueTexture VulkanTutorial::LoadCubemap(
 	const std::string& debugName) {
 
 	VKQuick::FrameContext const& context = m_vkQuick->GetFrameContext();
-	vk::UniqueCommandBuffer cmdBuffer = VKQuick::CmdBufferCreateBegin(context.device, context.commandPools[VKQuick::CommandType::Graphics], "VulkanTexture upload");
 
-	VKQuick::UniqueTexture tex = VKQuick::TextureBuilder(context.device, m_vkQuick->GetMemoryManager())
-		.WithCommandBuffer(*cmdBuffer)
+	//The builder reads the faces one at a time, so get them all decoding at once first
+	PrefetchTextures({ negativeXFile, positiveXFile, negativeYFile, positiveYFile, negativeZFile, positiveZFile });
+
+	return VKQuick::TextureBuilder(context.device, m_vkQuick->GetMemoryManager())
+		.WithCommandBuffer(m_uploadQueue->GetCommandBuffer())
 		.BuildCubemapFromFile(negativeXFile, positiveXFile,
 			negativeYFile, positiveYFile,
 			negativeZFile, positiveZFile,
 			debugName
 	);
+}
 
-	VKQuick::CmdBufferSubmit(
-		{
-			.buffer = *cmdBuffer,
-			.queue	= context.queues[VKQuick::CommandType::Graphics],
-			.device = context.device,
-			.wait	= true
+void VulkanTutorial::PrefetchTextures(const std::vector<std::string>& filenames) {
+	std::lock_guard lock(m_decodeMutex);
+	for (const std::string& filename : filenames) {
+		if (m_decodedTextures.contains(filename)) {
+			continue;
 		}
-	);
+		std::shared_ptr<DecodedTexture> decoded = std::make_shared<DecodedTexture>();
+		decoded->job = m_jobSystem->Submit([decoded, filename]() {
+			decoded->texture = DecodeTexture(filename);
+		});
+		m_decodedTextures.insert({ filename, decoded });
+	}
+}
+
+VKQuick::LoadedTexture VulkanTutorial::DecodeTexture(const std::string& filename) {
+	VKQuick::LoadedTexture lt;
+	uint32_t flags = 0;
+	TextureLoader::LoadTexture(filename, lt.texData, lt.dimensions.width, lt.dimensions.height, lt.channels, flags);
+	return lt;
+}
 
-	return tex;
+VKQuick::LoadedTexture VulkanTutorial::TakeDecodedTexture(const std::string& filename) {
+	std::shared_ptr<DecodedTexture> decoded;
+	{
+		std::lock_guard lock(m_decodeMutex);
+		auto i = m_decodedTextures.find(filename);
+		if (i != m_decodedTextures.end()) {
+			decoded = i->second;
+			m_decodedTextures.erase(i);
+		}
+	}
+	if (!decoded) {
+		return DecodeTexture(filename);
+	}
+	m_jobSystem->Wait(decoded->job);
+	return decoded->texture;
+}
+
+void VulkanTutorial::FinishPendingTextures() {
+	std::vector<SharedVulkanTexture> pending;
+	{
+		std::lock_guard lock(m_pendingMutex);
+		pending.swap(m_pendingTextures);
+	}
+	for (SharedVulkanTexture& texture : pending) {
+		texture->Finish();
+	}
+}
+
+vk::DescriptorSet VulkanTutorial::CreateMaterialSet(vk::DescriptorSetLayout layout) {
+	VKQuick::FrameContext const& context = m_vkQuick->GetFrameContext();
+	m_materialSets.push_back(VKQuick::CreateDescriptorSet(context.device, context.descriptorPool, layout));
+	return *m_materialSets.back();
 }
 
 void VulkanTutorial::RenderSingleObject(RenderObject& o, vk::CommandBuffer  toBuffer, VKQuick::Pipeline& toPipeline, int descriptorSet) {
 	toBuffer.pushConstants(*toPipeline.layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(Matrix4), (void*)&o.transform);
-	toBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *toPipeline.layout, descriptorSet, 1, &*o.descriptorSet, 0, nullptr);
+	toBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *toPipeline.layout, descriptorSet, 1, &o.descriptorSet, 0, nullptr);
 	
-	const VKQuick::UniqueMesh& m = o.mesh->GetMesh();
+	//Arena meshes share buffers, which the caller binds once via VulkanMeshArena::Bind
+	if (!o.mesh->GetArena()) {
+		o.mesh->GetMesh()->BindToCommandBuffer(toBuffer);
+	}
+
+	float distance;
+	o.mesh->DrawLOD(toBuffer, SelectObjectLOD(o, distance));
+}
+
+void VulkanTutorial::QueueObject(RenderQueue& queue, const RenderObject& o, const VKQuick::Pipeline& pipeline) const {
+	float		distance;
+	uint32_t	lod = SelectObjectLOD(o, distance);
+	queue.Add(*pipeline.pipeline, *pipeline.layout, o.descriptorSet, *o.mesh, lod, o.transform, distance);
+}
+
+void VulkanTutorial::RecordQueueInParallel(const RenderQueue& queue, vk::CommandBuffer primary, const vk::CommandBufferInheritanceRenderingInfo& rendering,
+	uint32_t cameraSet, uint32_t materialSet, uint32_t instanceSet) {
+	VKQuick::FrameContext const& context = m_vkQuick->GetFrameContext();
+
+	CameraBinding	camera		= GetCameraBinding();
+	uint32_t		batchCount	= queue.GetBatchCount();
+	uint32_t		chunkCount	= m_parallelRecorder->GetChunkCount();
+
+	m_parallelRecorder->Record(primary, rendering, [&](vk::CommandBuffer cmdBuffer, uint32_t chunk) {
+		uint32_t first	= batchCount * chunk / chunkCount;
+		uint32_t last	= batchCount * (chunk + 1) / chunkCount;
+		if (first == last) {
+			return;
+		}
+		//Secondary command buffers start with no state of their own
+		cmdBuffer.setViewport(0, context.viewport);
+		cmdBuffer.setScissor(0, context.screenRect);
+		camera.Bind(cmdBuffer, vk::PipelineBindPoint::eGraphics, queue.GetBatchLayout(first), cameraSet);
+
+		queue.RecordBatches(cmdBuffer, materialSet, instanceSet, first, last - first);
+	});
+}
+
+uint32_t VulkanTutorial::SelectObjectLOD(const RenderObject& o, float& distance) const {
+	//Distance and LOD errors are in model space, so take the object's scale out of the distance
+	Vector3 position(o.transform.array[3][0], o.transform.array[3][1], o.transform.array[3][2]);
+	float scale = Vector::Length(Vector3(o.transform.array[0][0], o.transform.array[0][1], o.transform.array[0][2]));
+	distance = Vector::Length(position - m_camera.GetPosition());
+
+	if (!m_useLODs) {
+		return 0;
+	}
+	return o.mesh->SelectLOD(scale > 0.0f ? distance / scale : 0.0f, GetLODProjectionScale(), m_lodPixelError);
+}
+
+BoundingBox VulkanTutorial::GetWorldBounds(const RenderObject& o) {
+	const Vector3& localMin = o.mesh->GetBoundsMin();
+	const Vector3& localMax = o.mesh->GetBoundsMax();
+
+	//Each world axis extends by the absolute contribution of every local axis
+	BoundingBox box;
+	for (int row = 0; row < 3; ++row) {
+		float centre = o.transform.array[3][row];
+		float extent = 0.0f;
+		for (int col = 0; col < 3; ++col) {
+			float m = o.transform.array[col][row];
+			centre += m * (localMin[col] + localMax[col]) * 0.5f;
+			extent += fabsf(m) * (localMax[col] - localMin[col]) * 0.5f;
+		}
+		box.min[row] = centre - extent;
+		box.max[row] = centre + extent;
+	}
+	return box;
+}
+
+void VulkanTutorial::BuildObjectBVH(std::span<const RenderObject> objects) {
+	std::vector<BoundingBox> boxes;
+	boxes.reserve(objects.size());
+	for (const RenderObject& o : objects) {
+		boxes.push_back(GetWorldBounds(o));
+	}
+	m_objectBVH.Build(boxes);
+}
+
+void VulkanTutorial::CullObjects(std::vector<uint32_t>& visible) const {
+	Vector4 planes[6];
+	IndirectDrawGenerator::ExtractFrustumPlanes(m_cameraViewProj, planes);
+	m_objectBVH.Cull(planes, visible);
+}
+
+void VulkanTutorial::RemoveOccludedObjects(std::span<const RenderObject> objects, std::vector<uint32_t>& visible) const {
+	m_occlusionCuller->RemoveOccluded(visible, [&](uint32_t i) {
+		return GetWorldBounds(objects[i]);
+	});
+}
 
-	m->BindToCommandBuffer(toBuffer);
-	m->Draw(toBuffer);
+float VulkanTutorial::GetLODProjectionScale() const {
+	float fov = m_camera.GetFieldOfVision() * 3.14159265f / 180.0f;
+	return Window::GetWindow()->GetScreenSize().y / (2.0f * tanf(fov * 0.5f));
 }
 
-VKQuick::VKQuickInitialisation VulkanTutorial::DefaultInitialisation() {
+VKQuick::VKQuickInitialisation VulkanTutorial::DefaultInitialisation(uint32_t framesInFlight) {
 	VKQuick::VKQuickInitialisation m_vkInit;
 
 	m_vkInit.depthStencilFormat = vk::Format::eD32SfloatS8Uint;
@@ -379,7 +679,7 @@ VKQuick::VKQuickInitialisation VulkanTutorial::DefaultInitialisation() {
 	m_vkInit.features.push_back((void*)&timelineSemaphores);
 	m_vkInit.features.push_back((void*)&scalarFeatures);
 
-	m_vkInit.framesInFlight = 1;
+	m_vkInit.framesInFlight = framesInFlight;
 
 	m_vkInit.shaderRoot = Assets::SHADERDIR + "VK/";
 
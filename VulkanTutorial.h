@@ -12,22 +12,57 @@ License: MIT (see LICENSE file at the top of the source tree)
 #include "../NCLCoreClasses/Window.h"
 #include "../VulkanRendering/VulkanMesh.h"
 #include "../VulkanRendering/VulkanTexture.h"
+#include "../VulkanRendering/VulkanUploadQueue.h"
+#include "../VulkanRendering/JobSystem.h"
+#include "../VulkanRendering/TextureCompressor.h"
+#include "../VulkanRendering/CullingBVH.h"
+#include "../VulkanRendering/OcclusionCuller.h"
+#include "../VulkanRendering/FrameAllocator.h"
+#include "../VulkanRendering/RenderQueue.h"
+#include "../VulkanRendering/ParallelRecorder.h"
+#include "../VulkanRendering/PipelineCache.h"
+#include "../VulkanRendering/ShaderModuleCache.h"
 #include "../VKQuick/Instance.h"
+#include "../VKQuick/TextureBuilder.h"
+
+struct ShaderCamera;
 
 namespace NCL::Rendering::Vulkan {
 	struct RenderObject {
-		VulkanMesh*				mesh;
-		Matrix4					transform;
-		vk::UniqueDescriptorSet descriptorSet;
+		VulkanMesh*			mesh;
+		Matrix4				transform;		//Pushed as a constant, so needs no set of its own
+		vk::DescriptorSet	descriptorSet;	//The object's textures, from CreateMaterialSet, shared by objects using the same ones
 	};
 
+	//A frame in flight's ShaderCamera in a buffer of its own, for pipelines built with m_cameraLayout
 	struct CameraState {
 		vk::UniqueDescriptorSet descriptor;
 		VKQuick::Buffer			buffer;
 	};
 
+	//This frame's ShaderCamera, bound with the frame allocator's uniform set
+	struct CameraBinding {
+		vk::DescriptorSet	descriptor;
+		uint32_t			offset;		//The dynamic offset to bind the set with
+
+		void Bind(vk::CommandBuffer cmdBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout layout, uint32_t set = 0) const {
+			cmdBuffer.bindDescriptorSets(bindPoint, layout, set, 1, &descriptor, 1, &offset);
+		}
+	};
+
 	vk::TransformMatrixKHR ToVulkanMatrix(const NCL::Maths::Matrix4& mat4);
 
+	struct MeshLoadOptions {
+		//Meshes are only cooked when this is turned off, to a .vkmesh file next to the source, which later runs
+		//upload straight from. It defaults to on, as cooked meshes have no CPU side vertex data, so can't be used
+		//for BuildMeshlets, OcclusionCuller occluders, a VulkanMeshArena, or dynamic updates.
+		bool keepCPUData	= true;
+		//Reorders the mesh with VulkanMesh::OptimiseForGPU, which changes its index and vertex order
+		bool optimise		= false;
+		//Builds simplified LODs with VulkanMesh::GenerateLODs, which are only drawn when m_useLODs is set
+		bool generateLODs	= false;
+	};
+
 	class VulkanTutorial	{
 	public:
 		VulkanTutorial(VKQuick::VKQuickInitialisation& vkInit);
@@ -36,7 +71,6 @@ namespace NCL::Rendering::Vulkan {
 		virtual void Update(float dt) {
 			m_runTime += dt;
 			UpdateCamera(dt);
-			UploadCameraUniform();
 		}
 
 		virtual void RunFrame(float dt);
@@ -47,9 +81,13 @@ namespace NCL::Rendering::Vulkan {
 
 		static VulkanTutorial*		CreateTutorial(int& chainID, VKQuick::VKQuickInitialisation& vkInit);
 		static VulkanTutorial*		CreateTutorial(const std::string& name, VKQuick::VKQuickInitialisation& vkInit);
-		static VKQuick::VKQuickInitialisation DefaultInitialisation();
+		//With more than one frame in flight, the CPU records the next frame while the GPU is still drawing the last one
+		static VKQuick::VKQuickInitialisation DefaultInitialisation(uint32_t framesInFlight = 2);
 
+		//For pipelines built with m_cameraLayout. The camera is only copied into the frame's buffer the
+		//first time this is called in a frame, so tutorials using GetCameraBinding never pay for it.
 		const CameraState& GetCameraState(const VKQuick::FrameContext& context);
+		CameraBinding GetCameraBinding() const;
 
 	protected:
 		virtual void RenderFrame(float dt) = 0;
@@ -60,36 +98,102 @@ namespace NCL::Rendering::Vulkan {
 
 		void BuildCamera();
 		void UpdateCamera(float dt);
+		//Called once per frame by RunFrame, after Update
 		void UploadCameraUniform();
 
 		void RenderSingleObject(RenderObject& o, vk::CommandBuffer  toBuffer, VKQuick::Pipeline& toPipeline, int descriptorSet = 0);
+		//Adds the object to the queue at the same LOD RenderSingleObject would draw it at, with its descriptor set as the material
+		void QueueObject(RenderQueue& queue, const RenderObject& o, const VKQuick::Pipeline& pipeline) const;
+
+		//The LOD of the object's mesh to draw, and its distance from the camera. Always LOD 0 unless m_useLODs is set.
+		uint32_t SelectObjectLOD(const RenderObject& o, float& distance) const;
 
-		UniqueVulkanMesh	LoadMesh(const std::string& filename, vk::BufferUsageFlags bufferUsage = {});
+		//Records the batches of a prepared queue from primary, split evenly between m_parallelRecorder's chunks.
+		//Each chunk sets the frame's viewport and scissor, and binds the camera at cameraSet.
+		void RecordQueueInParallel(const RenderQueue& queue, vk::CommandBuffer primary, const vk::CommandBufferInheritanceRenderingInfo& rendering,
+			uint32_t cameraSet, uint32_t materialSet, uint32_t instanceSet);
 
+		//World space box around the object's mesh bounds
+		static BoundingBox GetWorldBounds(const RenderObject& o);
+
+		//Objects must stay in the same order afterwards, as m_objectBVH refers to them by index.
+		//Objects that move should be passed to m_objectBVH.UpdateBox, then m_objectBVH.Refit called.
+		void BuildObjectBVH(std::span<const RenderObject> objects);
+		//Indices of the objects given to BuildObjectBVH that may be in view of the camera
+		void CullObjects(std::vector<uint32_t>& visible) const;
+		//Removes objects entirely behind the occluders given to m_occlusionCuller this frame, which must have been rasterised
+		void RemoveOccludedObjects(std::span<const RenderObject> objects, std::vector<uint32_t>& visible) const;
+
+		//Converts a model space distance at one unit from the camera into pixels, for VulkanMesh::SelectLOD
+		float GetLODProjectionScale() const;
+
+		UniqueVulkanMesh	LoadMesh(const std::string& filename, vk::BufferUsageFlags bufferUsage = {}, const MeshLoadOptions& options = {});
+		//Files are parsed in parallel on the job system, only the GPU uploads happen on this thread
+		std::vector<UniqueVulkanMesh> LoadMeshes(const std::vector<std::string>& filenames, vk::BufferUsageFlags bufferUsage = {}, const MeshLoadOptions& options = {});
+
+		//Uploads are batched, and submitted together before the next frame's commands
+		UploadHandle UploadMesh(VulkanMesh& m, vk::BufferUsageFlags bufferUsage = {});
 		void UploadMeshWait(VulkanMesh& m, vk::BufferUsageFlags bufferUsage = {});
 		VKQuick::UniqueTexture LoadTexture(const std::string& filename);
 
+		//Block compressed, with a prebuilt mip chain. Cooked to a .ktx2 file next to the source image.
+		//srgb should be false for anything that isn't a colour, and is ignored for BC5.
+		VKQuick::UniqueTexture LoadCompressedTexture(const std::string& filename, BlockFormat format = BlockFormat::BC7, bool srgb = true);
+		//The CPU side of LoadCompressedTexture, such as for handing to a TextureStreamer. Returns false if the file can't be loaded.
+		bool CookTexture(const std::string& filename, CompressedTexture& texture, BlockFormat format = BlockFormat::BC7, bool srgb = true);
+
 		VKQuick::UniqueTexture LoadCubemap(
 			const std::string& negativeXFile, const std::string& positiveXFile,
 			const std::string& negativeYFile, const std::string& positiveYFile,
 			const std::string& negativeZFile, const std::string& positiveZFile,
 			const std::string& debugName = "CubeMap");
 
+		//Starts decoding the files on the job system, ready for a later LoadTexture or LoadCubemap
+		void PrefetchTextures(const std::vector<std::string>& filenames);
+
+		//GLTF textures are decoded in the background, and each is created the first time its GetTex is called.
+		//This creates any that are left, and is called by RunFrame, so none are left half loaded for long.
+		void FinishPendingTextures();
+
 		UniqueVulkanMesh GenerateTriangle();
 		UniqueVulkanMesh GenerateQuad();
 		UniqueVulkanMesh GenerateGrid();
 
+		//A set for RenderObjects to share, kept until the tutorial is destroyed
+		vk::DescriptorSet CreateMaterialSet(vk::DescriptorSetLayout layout);
+
 		VKQuick::VKQuickInitialisation	m_vkInit;
 		VKQuick::Instance*				m_vkQuick;
+
+		std::unique_ptr<VulkanUploadQueue> m_uploadQueue;
 		
 		KeyboardMouseController m_controller;
 		PerspectiveCamera		m_camera;
 
-		std::vector<CameraState>		m_cameraStates;
+		//Camera matrices and anything else that is rewritten every frame.
+		//Its uniform layout is what new pipelines reading the camera should use, with GetCameraBinding.
+		std::unique_ptr<FrameAllocator>	m_frameAllocator;
+		uint32_t						m_cameraOffset = 0;
+
+		//This frame's camera in m_frameAllocator, and how many frames have uploaded one
+		const ShaderCamera*				m_cameraData	= nullptr;
+		uint64_t						m_cameraUploads	= 0;
 
+		//Buffers per frame in flight for GetCameraState, created when first asked for.
+		//Each records which upload it last copied, so is copied at most once a frame.
+		std::vector<CameraState>		m_cameraStates;
+		std::vector<uint64_t>			m_cameraStateUploads;
 		vk::UniqueDescriptorSetLayout	m_cameraLayout;
 
+		//Secondary command buffers for recording on the job system
+		std::unique_ptr<ParallelRecorder>	m_parallelRecorder;
+
+		//Pass m_pipelineCache->Get() when creating pipelines, so they're ready straight away on the next run
+		std::unique_ptr<PipelineCache>		m_pipelineCache;
+		std::unique_ptr<ShaderModuleCache>	m_shaderCache;
+
 		vk::UniqueSampler				m_defaultSampler;
+		std::vector<vk::UniqueDescriptorSet>	m_materialSets;
 
 		UniqueVulkanMesh	m_triangleMesh;
 		UniqueVulkanMesh	m_quadMesh;
@@ -98,6 +202,43 @@ namespace NCL::Rendering::Vulkan {
 		UniqueVulkanMesh	m_sphereMesh;
 
 		float m_runTime;
+		float m_lodPixelError = 1.0f;
+		bool  m_useLODs = false;
+
+		std::unique_ptr<JobSystem> m_jobSystem;
+
+		CullingBVH m_objectBVH;
+		std::unique_ptr<OcclusionCuller> m_occlusionCuller;
+
+		//As last written to the camera uniform
+		Matrix4 m_cameraViewProj;
+
+	private:
+		struct PendingMesh {
+			UniqueVulkanMesh	mesh;
+			std::string			cookedFile;
+			uint64_t			sourceHash	= 0;
+			bool				isCooked	= false;
+			std::string			filename;
+			MeshLoadOptions		options;
+		};
+		//Without useCooked the source file is always loaded, but is still cooked again if the options ask for it
+		PendingMesh			PrepareMesh(const std::string& filename, const MeshLoadOptions& options, bool useCooked = true);
+		UniqueVulkanMesh	FinishMesh(PendingMesh& pending, vk::BufferUsageFlags bufferUsage);
+
+		struct DecodedTexture {
+			VKQuick::LoadedTexture	texture;
+			JobHandle				job;
+		};
+		static VKQuick::LoadedTexture DecodeTexture(const std::string& filename);
+		VKQuick::LoadedTexture TakeDecodedTexture(const std::string& filename);
+
+		std::mutex m_decodeMutex;
+		std::unordered_map<std::string, std::shared_ptr<DecodedTexture>> m_decodedTextures;
+
+		//The GLTF loader's texture callback may run on any thread
+		std::mutex m_pendingMutex;
+		std::vector<SharedVulkanTexture> m_pendingTextures;
 	};
 
 
@@ -0,0 +1,339 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#include "VulkanUploadQueue.h"
+#include "VulkanMesh.h"
+#include "TextureCompressor.h"
+
+#include "../VKQuick/MemoryManager.h"
+
+using namespace NCL;
+using namespace Rendering;
+using namespace Vulkan;
+
+static size_t AlignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool UploadHandle::IsComplete() const {
+	return !m_queue || m_queue->IsComplete(m_value);
+}
+
+void UploadHandle::Wait() const {
+	if (m_queue) {
+		m_queue->Wait(m_value);
+	}
+}
+
+VulkanUploadQueue::VulkanUploadQueue(vk::Device device, vk::Queue queue, uint32_t queueFamily, VKQuick::MemoryManager& memManager, size_t stagingSize)
+	: m_device(device), m_queue(queue), m_memoryManager(memManager), m_stagingSize(stagingSize)
+{
+	m_pool = device.createCommandPoolUnique(
+		{
+			.flags				= vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+			.queueFamilyIndex	= queueFamily
+		}
+	);
+
+	vk::SemaphoreTypeCreateInfo typeInfo{
+		.semaphoreType	= vk::SemaphoreType::eTimeline,
+		.initialValue	= 0
+	};
+	m_timeline = device.createSemaphoreUnique({ .pNext = &typeInfo });
+
+	m_stagingBuffer = memManager.CreateBuffer(
+		{
+			.size	= stagingSize,
+			.usage	= vk::BufferUsageFlagBits::eTransferSrc
+		},
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		"Upload Queue Staging Buffer"
+	);
+	m_stagingData = m_stagingBuffer.Map<char>();
+}
+
+VulkanUploadQueue::~VulkanUploadQueue() {
+	WaitAll();
+	m_inFlight.clear();
+	m_batchBuffer.reset();
+
+	m_stagingBuffer.Unmap();
+	m_memoryManager.DiscardBuffer(m_stagingBuffer, VKQuick::DiscardMode::Immediate);
+}
+
+UploadHandle VulkanUploadQueue::UploadMesh(VulkanMesh& mesh, vk::BufferUsageFlags extraFlags) {
+	if (!mesh.InitialiseGPUState(m_device, m_memoryManager, extraFlags)) {
+		return {};
+	}
+
+	if (mesh.GetStorage() == MeshStorage::Dynamic) {
+		mesh.UploadAttributes(GetCommandBuffer());
+		return GetBatchHandle();
+	}
+	const VKQuick::Buffer& meshBuffer = mesh.GetMesh()->GetBuffer();
+
+	StagingAllocation staging = AllocateStaging(meshBuffer.size);
+	mesh.WriteGPUData(staging.data);
+
+	GetCommandBuffer().copyBuffer(staging.buffer, meshBuffer.buffer,
+		vk::BufferCopy{
+			.srcOffset	= staging.offset,
+			.dstOffset	= 0,
+			.size		= meshBuffer.size
+		}
+	);
+
+	return GetBatchHandle();
+}
+
+UploadHandle VulkanUploadQueue::UploadToBuffer(vk::Buffer dst, size_t dstOffset, const void* data, size_t size) {
+	StagingAllocation staging = AllocateStaging(size);
+	memcpy(staging.data, data, size);
+
+	GetCommandBuffer().copyBuffer(staging.buffer, dst,
+		vk::BufferCopy{
+			.srcOffset	= staging.offset,
+			.dstOffset	= dstOffset,
+			.size		= size
+		}
+	);
+	return GetBatchHandle();
+}
+
+UploadHandle VulkanUploadQueue::UploadToImage(vk::Image dst, const CompressedTexture& texture, uint32_t firstLevel, vk::ImageLayout finalLayout) {
+	assert(firstLevel < texture.levels.size());
+
+	//Levels are stored largest first, so the ones we want are all at the end
+	size_t dataStart = texture.levels[firstLevel].offset;
+	size_t dataSize	 = texture.data.size() - dataStart;
+
+	StagingAllocation staging = AllocateStaging(dataSize);
+	memcpy(staging.data, texture.data.data() + dataStart, dataSize);
+
+	vk::CommandBuffer cmdBuffer = GetCommandBuffer();
+
+	vk::ImageSubresourceRange allLevels{
+		.aspectMask		= vk::ImageAspectFlagBits::eColor,
+		.baseMipLevel	= 0,
+		.levelCount		= (uint32_t)texture.levels.size() - firstLevel,
+		.baseArrayLayer = 0,
+		.layerCount		= 1
+	};
+	vk::ImageMemoryBarrier2 toTransfer{
+		.srcStageMask		= vk::PipelineStageFlagBits2::eNone,
+		.srcAccessMask		= vk::AccessFlagBits2::eNone,
+		.dstStageMask		= vk::PipelineStageFlagBits2::eTransfer,
+		.dstAccessMask		= vk::AccessFlagBits2::eTransferWrite,
+		.oldLayout			= vk::ImageLayout::eUndefined,
+		.newLayout			= vk::ImageLayout::eTransferDstOptimal,
+		.image				= dst,
+		.subresourceRange	= allLevels
+	};
+	cmdBuffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &toTransfer });
+
+	std::vector<vk::BufferImageCopy> copies;
+	for (uint32_t i = firstLevel; i < texture.levels.size(); ++i) {
+		const TextureLevel& level = texture.levels[i];
+		copies.push_back({
+			.bufferOffset		= staging.offset + level.offset - dataStart,
+			.imageSubresource	= {
+				.aspectMask		= vk::ImageAspectFlagBits::eColor,
+				.mipLevel		= i - firstLevel,
+				.baseArrayLayer = 0,
+				.layerCount		= 1
+			},
+			.imageExtent		= { level.width, level.height, 1 }
+		});
+	}
+	cmdBuffer.copyBufferToImage(staging.buffer, dst, vk::ImageLayout::eTransferDstOptimal, copies);
+
+	vk::ImageMemoryBarrier2 toFinal{
+		.srcStageMask		= vk::PipelineStageFlagBits2::eTransfer,
+		.srcAccessMask		= vk::AccessFlagBits2::eTransferWrite,
+		.dstStageMask		= vk::PipelineStageFlagBits2::eAllCommands,
+		.dstAccessMask		= vk::AccessFlagBits2::eMemoryRead,
+		.oldLayout			= vk::ImageLayout::eTransferDstOptimal,
+		.newLayout			= finalLayout,
+		.image				= dst,
+		.subresourceRange	= allLevels
+	};
+	cmdBuffer.pipelineBarrier2({ .imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &toFinal });
+
+	return GetBatchHandle();
+}
+
+StagingAllocation VulkanUploadQueue::AllocateStaging(size_t size, size_t alignment) {
+	if (size > m_stagingSize) {
+		return AllocateDedicatedStaging(size);
+	}
+
+	size_t start = 0;
+	while (true) {
+		RetireCompleted();
+		if (m_stagingRegions.empty()) {
+			start = 0;
+			break;
+		}
+		size_t tail		= m_stagingRegions.front().start;
+		bool wrapped	= m_stagingRegions.back().start < tail;
+
+		start = AlignUp(m_stagingHead, alignment);
+		if (!wrapped) {
+			if (start + size <= m_stagingSize) {
+				break;
+			}
+			if (size <= tail) {
+				start = 0;
+				break;
+			}
+		}
+		else if (start + size <= tail) {
+			break;
+		}
+		//Ring is full, we must wait for the oldest batch to finish with its region
+		uint64_t oldest = m_stagingRegions.front().value;
+		if (oldest == m_batchValue) {
+			Flush();
+		}
+		Wait(oldest);
+	}
+	m_stagingHead = start + size;
+
+	if (!m_stagingRegions.empty() && m_stagingRegions.back().value == m_batchValue && start >= m_stagingRegions.back().start) {
+		m_stagingRegions.back().end = m_stagingHead;
+	}
+	else {
+		m_stagingRegions.push_back({ start, m_stagingHead, m_batchValue });
+	}
+	//The region is tagged with this batch, so the batch must exist to be flushed and waited on
+	GetCommandBuffer();
+
+	return StagingAllocation{
+		.buffer = m_stagingBuffer.buffer,
+		.offset = start,
+		.data	= m_stagingData + start
+	};
+}
+
+StagingAllocation VulkanUploadQueue::AllocateDedicatedStaging(size_t size) {
+	VKQuick::Buffer buffer = m_memoryManager.CreateBuffer(
+		{
+			.size	= size,
+			.usage	= vk::BufferUsageFlagBits::eTransferSrc
+		},
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		"Upload Queue Dedicated Staging Buffer"
+	);
+	StagingAllocation allocation{
+		.buffer = buffer.buffer,
+		.offset = 0,
+		.data	= buffer.Map<char>()
+	};
+	m_dedicatedStaging.push_back({ buffer, m_batchValue });
+	GetCommandBuffer();
+
+	return allocation;
+}
+
+vk::CommandBuffer VulkanUploadQueue::GetCommandBuffer() {
+	if (!m_batchBuffer) {
+		m_batchBuffer = std::move(m_device.allocateCommandBuffersUnique(
+			{
+				.commandPool		= *m_pool,
+				.level				= vk::CommandBufferLevel::ePrimary,
+				.commandBufferCount = 1
+			}
+		)[0]);
+		m_batchBuffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+	}
+	return *m_batchBuffer;
+}
+
+UploadHandle VulkanUploadQueue::GetBatchHandle() {
+	return UploadHandle(this, m_batchBuffer ? m_batchValue : m_lastSubmitted);
+}
+
+UploadHandle VulkanUploadQueue::Flush() {
+	if (!m_batchBuffer) {
+		return UploadHandle(this, m_lastSubmitted);
+	}
+	vk::MemoryBarrier2 barrier{
+		.srcStageMask	= vk::PipelineStageFlagBits2::eAllCommands,
+		.srcAccessMask	= vk::AccessFlagBits2::eMemoryWrite,
+		.dstStageMask	= vk::PipelineStageFlagBits2::eAllCommands,
+		.dstAccessMask	= vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite
+	};
+	m_batchBuffer->pipelineBarrier2({ .memoryBarrierCount = 1, .pMemoryBarriers = &barrier });
+	m_batchBuffer->end();
+
+	vk::CommandBufferSubmitInfo bufferInfo{
+		.commandBuffer = *m_batchBuffer
+	};
+	vk::SemaphoreSubmitInfo signalInfo{
+		.semaphore	= *m_timeline,
+		.value		= m_batchValue,
+		.stageMask	= vk::PipelineStageFlagBits2::eAllCommands
+	};
+	m_queue.submit2(
+		vk::SubmitInfo2{
+			.commandBufferInfoCount		= 1,
+			.pCommandBufferInfos		= &bufferInfo,
+			.signalSemaphoreInfoCount	= 1,
+			.pSignalSemaphoreInfos		= &signalInfo
+		}
+	);
+
+	m_inFlight.push_back({ std::move(m_batchBuffer), m_batchValue });
+	m_lastSubmitted = m_batchValue;
+	m_batchValue++;
+
+	return UploadHandle(this, m_lastSubmitted);
+}
+
+bool VulkanUploadQueue::IsComplete(uint64_t value) const {
+	return m_device.getSemaphoreCounterValue(*m_timeline) >= value;
+}
+
+void VulkanUploadQueue::Wait(uint64_t value) {
+	if (value >= m_batchValue && m_batchBuffer) {
+		Flush();
+	}
+	vk::SemaphoreWaitInfo waitInfo{
+		.semaphoreCount = 1,
+		.pSemaphores	= &*m_timeline,
+		.pValues		= &value
+	};
+	vk::Result result = m_device.waitSemaphores(waitInfo, UINT64_MAX);
+	assert(result == vk::Result::eSuccess);
+	RetireCompleted();
+}
+
+void VulkanUploadQueue::WaitAll() {
+	Flush();
+	Wait(m_lastSubmitted);
+}
+
+void VulkanUploadQueue::RetireCompleted() {
+	uint64_t completed = m_device.getSemaphoreCounterValue(*m_timeline);
+
+	std::erase_if(m_inFlight, [&](const InFlightBatch& b) { return b.value <= completed; });
+
+	size_t retired = 0;
+	while (retired < m_stagingRegions.size() && m_stagingRegions[retired].value <= completed) {
+		retired++;
+	}
+	m_stagingRegions.erase(m_stagingRegions.begin(), m_stagingRegions.begin() + retired);
+
+	std::erase_if(m_dedicatedStaging, [&](DedicatedStaging& d) {
+		if (d.value > completed) {
+			return false;
+		}
+		d.buffer.Unmap();
+		m_memoryManager.DiscardBuffer(d.buffer, VKQuick::DiscardMode::Immediate);
+		return true;
+	});
+}
\ No newline at end of file
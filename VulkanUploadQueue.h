@@ -0,0 +1,133 @@
+/******************************************************************************
+This file is part of the Newcastle Vulkan Tutorial Series
+
+Author:Rich Davison
+Contact:richgdavison@gmail.com
+License: MIT (see LICENSE file at the top of the source tree)
+*//////////////////////////////////////////////////////////////////////////////
+#pragma once
+#include "../VKQuick/Buffer.h"
+
+namespace VKQuick {
+	class MemoryManager;
+}
+
+namespace NCL::Rendering::Vulkan {
+	class VulkanMesh;
+	class VulkanUploadQueue;
+	struct CompressedTexture;
+
+	//Completes once the upload batch it was recorded into has executed on the GPU
+	class UploadHandle {
+	public:
+		UploadHandle() = default;
+
+		bool IsComplete() const;
+		void Wait() const;
+
+		uint64_t GetValue() const {
+			return m_value;
+		}
+
+	protected:
+		friend class VulkanUploadQueue;
+		UploadHandle(VulkanUploadQueue* queue, uint64_t value) : m_queue(queue), m_value(value) {
+		}
+
+		VulkanUploadQueue*	m_queue = nullptr;
+		uint64_t			m_value = 0;
+	};
+
+	struct StagingAllocation {
+		vk::Buffer	buffer;
+		size_t		offset	= 0;
+		char*		data	= nullptr;
+	};
+
+	/*
+	Records uploads into a single command buffer, which is submitted in one go
+	by Flush, signalling a timeline semaphore with the batch number. Data that
+	needs copying to the GPU goes through a persistently mapped staging ring,
+	whose regions are reused once the batch that read them has completed.
+
+	A trailing barrier makes every batch's writes visible to commands that are
+	submitted later to the same queue. If a queue from a different family is
+	used, consumers must wait on GetTimelineSemaphore and handle queue family
+	ownership of the written resources themselves.
+	*/
+	class VulkanUploadQueue {
+	public:
+		VulkanUploadQueue(vk::Device device, vk::Queue queue, uint32_t queueFamily, VKQuick::MemoryManager& memManager, size_t stagingSize = 64 * 1024 * 1024);
+		~VulkanUploadQueue();
+
+		//Nothing is uploaded if the mesh's GPU state can't be created, check VulkanMesh::HasGPUState
+		UploadHandle UploadMesh(VulkanMesh& mesh, vk::BufferUsageFlags extraFlags = {});
+		UploadHandle UploadToBuffer(vk::Buffer dst, size_t dstOffset, const void* data, size_t size);
+
+		//Fills every mip level of the image from the texture's levels, starting at firstLevel. The
+		//image's previous contents are discarded, and it is left in finalLayout.
+		UploadHandle UploadToImage(vk::Image dst, const CompressedTexture& texture, uint32_t firstLevel = 0, vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+		//The returned memory is only valid until the current batch is flushed. Opens a batch if
+		//there isn't one, so the space is always released by a later Flush. Anything larger than
+		//the ring gets a staging buffer of its own, destroyed once the batch has completed.
+		StagingAllocation AllocateStaging(size_t size, size_t alignment = 16);
+
+		//The command buffer of the batch currently being recorded
+		vk::CommandBuffer GetCommandBuffer();
+
+		//Completes when the batch currently being recorded has executed
+		UploadHandle GetBatchHandle();
+
+		UploadHandle Flush();
+
+		bool IsComplete(uint64_t value) const;
+		void Wait(uint64_t value);
+		void WaitAll();
+
+		vk::Semaphore GetTimelineSemaphore() const {
+			return *m_timeline;
+		}
+
+	protected:
+		void RetireCompleted();
+
+		struct StagingRegion {
+			size_t		start;
+			size_t		end;
+			uint64_t	value;
+		};
+
+		struct InFlightBatch {
+			vk::UniqueCommandBuffer buffer;
+			uint64_t				value;
+		};
+
+		struct DedicatedStaging {
+			VKQuick::Buffer buffer;
+			uint64_t		value;
+		};
+
+		StagingAllocation AllocateDedicatedStaging(size_t size);
+
+		vk::Device				m_device;
+		vk::Queue				m_queue;
+		VKQuick::MemoryManager& m_memoryManager;
+
+		vk::UniqueCommandPool	m_pool;
+		vk::UniqueSemaphore		m_timeline;
+
+		vk::UniqueCommandBuffer		m_batchBuffer;
+		std::vector<InFlightBatch>	m_inFlight;
+
+		uint64_t	m_batchValue		= 1;
+		uint64_t	m_lastSubmitted		= 0;
+
+		VKQuick::Buffer				m_stagingBuffer;
+		char*						m_stagingData = nullptr;
+		size_t						m_stagingSize = 0;
+		size_t						m_stagingHead = 0;
+		std::vector<StagingRegion>	m_stagingRegions;
+		std::vector<DedicatedStaging>	m_dedicatedStaging;
+	};
+}
\ No newline at end of file